@@ -0,0 +1,88 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_ttf.h"
+#include "Store.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TextureAtlasBuilder;
+
+// decodes images and reads font files on worker threads, the main thread only uploads finished work
+// and opens the fonts through poll(), which must be called from the thread owning the renderer
+class AssetLoader
+{
+private:
+    struct DecodedTexture
+    {
+        std::string name;
+        SDL_Surface *surface;
+    };
+    struct ReadFont
+    {
+        std::string name;
+        std::string file_path;
+        std::string data; // the whole file, opened on the main thread
+        int size;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_available;
+    bool stopping{false};
+
+    // finished on a worker, waiting for the main thread
+    std::mutex results_mutex;
+    std::vector<DecodedTexture> decoded_textures;
+    std::vector<ReadFont> read_fonts;
+    std::vector<std::shared_ptr<TextureAtlasBuilder>> packed_atlases;
+
+    std::set<std::string> loaded; // names already in the asset store
+    int total{0};
+    int uploaded{0};
+    std::atomic<int> decoded{0};
+    std::promise<void> all_loaded;
+    std::shared_future<void> all_loaded_future;
+
+    // enqueue is main-thread only and opens a new batch, push_job may be called from workers
+    void enqueue(std::function<void()> job);
+    void push_job(std::function<void()> job);
+    void work();
+    void finish_if_done();
+
+public:
+    AssetLoader(int num_threads = 0);
+    ~AssetLoader();
+
+    void queue_texture(const std::string &name, const std::string &file_path);
+    void queue_font(const std::string &name, const std::string &file_path, int size);
+    // decode every source of the atlas in parallel, then pack (or restore from cache_dir when valid)
+    void queue_texture_atlas(std::shared_ptr<TextureAtlasBuilder> atlas, const std::string &cache_dir = "");
+
+    // move finished assets into the store, at most max_uploads textures per call (-1 for all)
+    void poll(SDL_Renderer *renderer, AssetStore &asset_store, int max_uploads = -1);
+    // block until everything queued so far is in the store
+    void wait(SDL_Renderer *renderer, AssetStore &asset_store);
+
+    // run other loading work on the same workers, not counted in progress()
+    void run_in_background(std::function<void()> job);
+
+    bool is_loaded(const std::string &name) const;
+    bool is_done() const;
+    // fraction of decode + upload steps finished, in [0, 1]
+    float progress() const;
+    std::shared_future<void> done() const;
+};
+
+#endif
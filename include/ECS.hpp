@@ -1,6 +1,7 @@
 #ifndef ECS_H
 #define ECS_H
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <set>
 #include <deque>
@@ -11,41 +12,85 @@
 #include <SDL2/SDL.h>
 #include <typeindex>
 #include <functional>
-#include <list>
+#include <cstdint>
+#include <tuple>
+#include <array>
 #include <sol/sol.hpp>
 #include "constants.hpp"
 #include "Store.hpp"
+#include "ScriptProfiler.hpp"
+#include "TimerWheel.hpp"
+#include "ScriptWorkers.hpp"
+#include "MpscQueue.hpp"
+#include <atomic>
 
 using constants::Signature;
 using glm::vec2;
 using namespace std::string_literals;
 
+// ============================================================
+// Clock
+// ============================================================
+
+// simulation time in milliseconds, components and systems read it instead of SDL_GetTicks
+// the game sets it at the start of every tick so a replay can run on recorded time
+class Clock
+{
+private:
+    static std::uint32_t ticks;
+
+public:
+    static std::uint32_t now();
+    static void set(std::uint32_t ticks);
+};
+
 // ============================================================
 // Pool
 // ============================================================
 
+class Snapshot;
+
 class IPool
 {
 public:
     virtual ~IPool() = default;
     virtual void remove(int entity_id) = 0;
+    virtual void touch_all(std::uint32_t version) = 0;
+    // bumped by every insert, remove and write, equal revisions mean equal contents
+    virtual std::uint32_t get_revision() const = 0;
+    // bulk copies for the rewind buffer, copy_from expects a pool of the same component type
+    virtual std::shared_ptr<IPool> clone() const = 0;
+    virtual void copy_from(const IPool &other) = 0;
 };
 
 template <typename T>
 class Pool : public IPool
 {
 private:
+    friend class Snapshot;
+
     std::vector<T> data;
+    std::vector<std::uint32_t> versions; // registry change version of the last write, per slot
     int n_entities;
+    std::uint32_t revision{0};
 
-    std::unordered_map<int, int> entity_to_index;
-    std::unordered_map<int, int> index_to_entity;
+    // flat so a whole pool copies as a few vectors: slot per entity id (-1 when the entity has
+    // no component here) and entity id per slot
+    std::vector<int> entity_to_index;
+    std::vector<int> index_to_entity;
+
+    int index_of(int entity_id) const
+    {
+        return entity_id < entity_to_index.size() ? entity_to_index[entity_id] : -1;
+    };
 
 public:
     Pool(int capacity = 100)
     {
         n_entities = 0;
         data.resize(capacity);
+        versions.resize(capacity);
+        index_to_entity.resize(capacity);
     };
     ~Pool()
     {
@@ -67,58 +112,145 @@ public:
     {
         n_entities = 0;
         data.clear();
+        versions.clear();
+        entity_to_index.clear();
+        index_to_entity.clear();
+        revision++;
     };
     void resize(int capacity)
     {
         data.resize(capacity);
+        versions.resize(capacity);
+        index_to_entity.resize(capacity);
+    };
+    // make room for count more entities so the next count inserts don't reallocate
+    void reserve(int count)
+    {
+        if (n_entities + count > data.size())
+        {
+            resize(n_entities + count);
+        }
     };
     void set(int entity_id, T element)
     {
-        if (entity_to_index.find(entity_id) != entity_to_index.end())
+        int index = index_of(entity_id);
+        if (index >= 0)
         {
-            int index = entity_to_index[entity_id];
             data[index] = element;
+            revision++;
+            return;
         }
 
+        T &inserted = insert(entity_id);
+        inserted = element;
+    };
+    // append a default constructed component for an entity not yet in the pool
+    T &insert(int entity_id)
+    {
         int index = n_entities;
-        entity_to_index.emplace(entity_id, index);
-        index_to_entity.emplace(index, entity_id);
-
-        if (index >= data.capacity())
+        if (index >= data.size())
         {
-            data.resize(n_entities * 2);
+            resize(std::max(1, n_entities * 2));
         }
-
-        data[index] = element;
-
+        if (entity_id >= entity_to_index.size())
+        {
+            entity_to_index.resize(std::max<std::size_t>(entity_id + 1, entity_to_index.size() * 2), -1);
+        }
+        entity_to_index[entity_id] = index;
+        index_to_entity[index] = entity_id;
         n_entities++;
+        revision++;
+
+        data[index] = T();
+        versions[index] = 0;
+        return data[index];
     };
 
     virtual void remove(int entity_id) override
     {
-        if (entity_to_index.find(entity_id) == entity_to_index.end())
+        int index_of_removed = index_of(entity_id);
+        if (index_of_removed < 0)
         {
             return;
         }
-        int index_of_removed = entity_to_index[entity_id];
         // replace content with last element
         int last_index = n_entities - 1;
         data[index_of_removed] = data[last_index];
+        versions[index_of_removed] = versions[last_index];
 
         int last_index_entity_id = index_to_entity[last_index];
 
         entity_to_index[last_index_entity_id] = index_of_removed;
         index_to_entity[index_of_removed] = last_index_entity_id;
 
-        entity_to_index.erase(entity_id);
-        index_to_entity.erase(last_index);
+        entity_to_index[entity_id] = -1;
         n_entities--;
+        revision++;
     }
     T &get(int entity_id)
     {
         int index = entity_to_index[entity_id];
         return static_cast<T &>(data[index]);
     };
+    // get for writing: the slot is stamped with version so delta snapshots pick it up
+    T &modify(int entity_id, std::uint32_t version)
+    {
+        int index = entity_to_index[entity_id];
+        versions[index] = version;
+        revision++;
+        return data[index];
+    };
+    // the raw arrays, for scripts that read and write components in place through the luajit ffi.
+    // only valid until the next insert, writes through them have to be marked with modify
+    T *get_data()
+    {
+        return data.data();
+    };
+    const int *get_entity_index() const
+    {
+        return entity_to_index.data();
+    };
+    std::size_t get_entity_index_size() const
+    {
+        return entity_to_index.size();
+    };
+    void touch(int entity_id, std::uint32_t version)
+    {
+        versions[entity_to_index[entity_id]] = version;
+    };
+    std::uint32_t get_version(int entity_id) const
+    {
+        return versions[entity_to_index[entity_id]];
+    };
+    virtual void touch_all(std::uint32_t version) override
+    {
+        std::fill(versions.begin(), versions.begin() + n_entities, version);
+    };
+    virtual std::uint32_t get_revision() const override
+    {
+        return revision;
+    };
+    virtual std::shared_ptr<IPool> clone() const override
+    {
+        auto copy = std::make_shared<Pool<T>>(0);
+        copy->copy_from(*this);
+        return copy;
+    };
+    // only the used slots are copied, storage already allocated here is reused
+    virtual void copy_from(const IPool &other) override
+    {
+        const auto &source = static_cast<const Pool<T> &>(other);
+        if (source.n_entities > data.size())
+        {
+            resize(source.n_entities);
+        }
+        std::copy(source.data.begin(), source.data.begin() + source.n_entities, data.begin());
+        std::copy(source.versions.begin(), source.versions.begin() + source.n_entities, versions.begin());
+        std::copy(source.index_to_entity.begin(), source.index_to_entity.begin() + source.n_entities, index_to_entity.begin());
+        entity_to_index = source.entity_to_index;
+        n_entities = source.n_entities;
+        revision++;
+    };
     T &operator[](int index) const
     {
         return data[index];
@@ -184,6 +316,7 @@ public:
     bool is_fixed;
     SDL_RendererFlip flip;
     SDL_Rect src_rect;
+    int texture_id; // resolved from asset_name by RenderSystem on first draw, -1 until then
     SpriteComponent(std::string asset_name = ""s, int width = 32, int height = 32, int z_index = 0, bool is_fixed = false, int src_rect_x = 0, int src_rect_y = 0);
 };
 
@@ -277,7 +410,9 @@ class ScriptComponent
 {
 public:
     sol::function fun;
-    ScriptComponent(sol::function fun = sol::lua_nil);
+    bool is_coroutine; // fun runs as a coroutine that sleeps with wait and wait_until, see ScriptSystem
+    bool is_sandboxed; // fun runs in a lua state of ScriptWorkers, is_coroutine is ignored then
+    ScriptComponent(sol::function fun = sol::lua_nil, bool is_coroutine = false, bool is_sandboxed = false);
 };
 
 // ============================================================
@@ -312,12 +447,34 @@ public:
     bool has_component() const;
     template <typename TComponent>
     TComponent &get_component() const;
+    template <typename TComponent>
+    const TComponent &read_component() const;
+    template <typename TComponent, typename TFunc>
+    void patch(TFunc fn) const;
 };
 
 class Event
 {
 };
 
+class IEventType
+{
+protected:
+    static std::atomic<int> _id; // events may be queued from any thread
+};
+
+template <typename T>
+class EventType : public IEventType
+{
+public:
+    // returns unique id per event type, the index of its handlers and queue in the event bus
+    static int id()
+    {
+        const static int event_id = _id++;
+        return event_id;
+    }
+};
+
 class CollisionEvent : public Event
 {
 public:
@@ -330,68 +487,144 @@ class KeyPressedEvent : public Event
 {
 public:
     SDL_Keycode key;
-    KeyPressedEvent(SDL_Keycode key);
+    int entity_id; // the only controlled entity the key is meant for, -1 for all of them
+    KeyPressedEvent(SDL_Keycode key, int entity_id = -1);
 };
 
 class MouseClickedEvent : public Event
 {
 public:
     int button;
-    MouseClickedEvent(int button);
+    int entity_id; // the only controlled entity the click is meant for, -1 for all of them
+    MouseClickedEvent(int button, int entity_id = -1);
 };
 
-class IEventCallback
+class IEventChannel
 {
-private:
-    virtual void call(Event &e) = 0;
-
 public:
-    virtual ~IEventCallback() = default;
-    void exec(Event &e)
-    {
-        call(e);
-    }
+    virtual ~IEventChannel() = default;
+    virtual void set_queued(bool queued) = 0;
+    // hands every queued event to the handlers, including those queued by the handlers themselves
+    virtual void dispatch_queued() = 0;
 };
 
-template <typename TOwner, typename TEvent>
-class EventCallback : public IEventCallback
+// every handler of one event type in a contiguous array of (owner, function) pairs. the function is
+// generated per handler at compile time and calls the member function directly, so emitting is a loop
+// over the array with one plain call per handler. the event is built once and every handler sees it
+template <typename TEvent>
+class EventChannel : public IEventChannel
 {
 private:
-    typedef void (TOwner::*Callback)(TEvent &);
-    TOwner *owner;
-    Callback callback;
+    struct Delegate
+    {
+        void *owner;
+        void (*call)(void *owner, TEvent &event);
+    };
+
+    std::vector<Delegate> delegates;
+    MpscQueue<TEvent> queue;
+    bool queued{false};
 
-    virtual void call(Event &e) override
+    void call_all(TEvent &event)
     {
-        std::invoke(callback, owner, static_cast<TEvent &>(e));
+        for (std::size_t i = 0; i < delegates.size(); i++)
+        {
+            delegates[i].call(delegates[i].owner, event);
+        }
     }
 
 public:
-    virtual ~EventCallback() override = default;
-    EventCallback(TOwner *owner, Callback callback)
+    // main thread, before anything is queued
+    template <auto callback, typename TOwner>
+    void subscribe(TOwner *owner)
     {
-        this->owner = owner;
-        this->callback = callback;
-    };
-    ;
+        delegates.push_back(Delegate{owner, [](void *owner, TEvent &event)
+                                     { (static_cast<TOwner *>(owner)->*callback)(event); }});
+    }
+    // main thread, handled right away unless the channel is queued
+    template <typename... TArgs>
+    void emit(TArgs &&...args)
+    {
+        if (delegates.empty())
+        {
+            return;
+        }
+        if (queued)
+        {
+            queue.push(std::forward<TArgs>(args)...);
+            return;
+        }
+        TEvent event(std::forward<TArgs>(args)...);
+        call_all(event);
+    }
+    // any thread, handled by the next dispatch_queued
+    template <typename... TArgs>
+    void push(TArgs &&...args)
+    {
+        if (!delegates.empty())
+        {
+            queue.push(std::forward<TArgs>(args)...);
+        }
+    }
+    bool empty() const
+    {
+        return delegates.empty();
+    }
+    virtual void set_queued(bool queued) override
+    {
+        this->queued = queued;
+    }
+    virtual void dispatch_queued() override
+    {
+        while (auto event = queue.pop())
+        {
+            call_all(*event);
+        }
+    }
 };
 
-using HandlerList = std::list<std::unique_ptr<IEventCallback>>;
-
+// one EventChannel per event type in a flat table indexed by EventType<TEvent>::id(). emit calls the
+// handlers right away, queue can be called from any thread and leaves the event in its channel's
+// lock-free queue until the main thread reaches dispatch_queued. in queued mode emit queues too.
+// a system raising many events of one type can hold on to channel<TEvent>() and skip the table.
+// subscribing happens on the main thread before anything is queued, events nobody subscribed to are dropped.
+// the table never moves, a channel is published once and queue reads it from any thread
 class EventBus
 {
 private:
-    std::map<std::type_index, std::unique_ptr<HandlerList>> subscribers;
+    static constexpr int max_event_types = 64;
+    std::array<std::atomic<IEventChannel *>, max_event_types> channels{};
+    std::vector<std::unique_ptr<IEventChannel>> owned_channels; // main thread only
+    bool queued{false};
+
+    IEventChannel *find_channel(int event_id) const
+    {
+        return event_id < max_event_types ? channels[event_id].load(std::memory_order_acquire) : nullptr;
+    };
 
 public:
+    // main thread, while nothing is queued
     void reset()
     {
-        subscribers.clear();
+        for (auto &channel : channels)
+        {
+            channel.store(nullptr, std::memory_order_relaxed);
+        }
+        owned_channels.clear();
     };
+    void set_queued(bool queued);
+    // main thread, created on first use
+    template <typename TEvent>
+    EventChannel<TEvent> &channel();
     template <typename TEvent, typename... TArgs>
     void emit(TArgs &&...args);
-    template <typename TOwner, typename TEvent>
-    void subscribe(TOwner *owner, void (TOwner::*callback)(TEvent &));
+    template <typename TEvent, typename... TArgs>
+    void queue(TArgs &&...args);
+    // main thread only, event types in id order and each type's events in the order they were queued
+    void dispatch_queued();
+    // subscribe<&TOwner::on_event>(owner)
+    template <auto callback, typename TOwner>
+    void subscribe(TOwner *owner);
 };
 
 // ============================================================
@@ -410,7 +643,9 @@ public:
     virtual ~System() = default;
 
     virtual void add_entity(Entity entity);
-    void remove_entity(Entity entity);
+    virtual void add_entities(const std::vector<Entity> &entities);
+    virtual void remove_entity(Entity entity);
+    virtual void remove_all_entities();
     std::vector<Entity> entities() const;
     const Signature &get_component_signature() const;
 
@@ -424,15 +659,76 @@ public:
     MovementSystem();
     void on_collision(CollisionEvent &e);
     void subscribe_events(std::shared_ptr<EventBus> event_bus);
-    void update(const float dt);
+    void update(const float dt, const vec2 map_size);
+};
+
+// loose grid over world space: every entity lives in the single cell holding its top-left corner,
+// queries widen the searched cells by the largest indexed extent and then test exact bounds.
+// an entity is re-binned when its transform, sprite, collider or signature changed since the last update,
+// whoever changed it
+class SpatialIndexSystem : public System
+{
+private:
+    struct Record
+    {
+        bool active{false};
+        bool is_fixed{false}; // screen-space sprite, reported by every query
+        Signature signature;
+        SDL_FRect bounds;
+        std::int64_t cell{0};
+        int slot{0}; // position inside the cell / fixed vector
+    };
+
+    std::vector<Record> records; // indexed by entity id
+    std::unordered_map<std::int64_t, std::vector<Entity>> cells;
+    std::vector<Entity> fixed_entities;
+    std::vector<int> changed_ids; // reused by every update
+    bool tracking{false};         // the registry collects changed entities once the first update asked it to
+    float max_width{0};
+    float max_height{0};
+    bool extents_dirty{false}; // the widest or tallest entry left, max_width / max_height may be too large
+
+    static std::int64_t cell_key(int cell_x, int cell_y);
+    static SDL_FRect compute_bounds(const Entity &entity);
+    void insert_into_cell(const Entity &entity, Record &record);
+    void remove_from_cell(Record &record);
+    void remove_from(std::vector<Entity> &entities, int slot, int Record::*slot_member);
+    void refresh(Registry *registry, int entity_id);
+    void release_extents(const SDL_FRect &bounds);
+    void recompute_extents();
+
+public:
+    SpatialIndexSystem();
+    void add_entity(Entity entity) override final;
+    void add_entities(const std::vector<Entity> &entities) override final;
+    void remove_entity(Entity entity) override final;
+    void remove_all_entities() override final;
+    // re-bin entities whose transform, sprite, collider or signature changed since the last update
+    void update(Registry &registry);
+    // collect entities overlapping rect (world coordinates) whose signature contains `signature`
+    void query(const SDL_Rect &rect, const Signature &signature, std::vector<Entity> &result) const;
 };
 
 class RenderSystem : public System
 {
+private:
+    // sort key is (z_index, layer, bound texture, entity id) packed from the most significant bits down
+    struct RenderItem
+    {
+        std::uint64_t key;
+        int index; // into visible_entities
+    };
+
+    std::vector<Entity> visible_entities;
+    std::vector<RenderItem> render_items;
+    std::vector<RenderItem> sort_buffer;
+
+    static std::uint64_t make_sort_key(const SpriteComponent &sprite, int batch, int entity_id);
+    void radix_sort();
+
 public:
     RenderSystem();
-    void add_entity(Entity entity) override final;
-    void update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera);
+    void update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera, const SpatialIndexSystem &spatial_index);
 };
 
 class AnimationSystem : public System
@@ -451,9 +747,12 @@ public:
 
 class RenderHealthSystem : public System
 {
+private:
+    std::vector<Entity> visible_entities;
+
 public:
     RenderHealthSystem();
-    void update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera);
+    void update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera, const SpatialIndexSystem &spatial_index);
 };
 
 class CollisionSystem : public System
@@ -466,9 +765,12 @@ public:
 
 class RenderColliderSystem : public System
 {
+private:
+    std::vector<Entity> visible_entities;
+
 public:
     RenderColliderSystem();
-    void update(SDL_Renderer *renderer, SDL_Rect &camera);
+    void update(SDL_Renderer *renderer, SDL_Rect &camera, const SpatialIndexSystem &spatial_index);
 };
 
 class DamageSystem : public System
@@ -504,14 +806,18 @@ class CameraMovementSystem : public System
 {
 public:
     CameraMovementSystem();
-    void update(SDL_Rect &camera);
+    void update(SDL_Rect &camera, const vec2 map_size);
 };
 
 class Registry;
+class PrefabRegistry;
 class ProjectileEmitSystem : public System
 {
+private:
+    std::shared_ptr<PrefabRegistry> prefabs; // projectiles are stamped from the "projectile" prefab
+
 public:
-    ProjectileEmitSystem();
+    ProjectileEmitSystem(std::shared_ptr<PrefabRegistry> prefabs);
     void on_key_pressed(KeyPressedEvent &e);
     void on_mouse_clicked(MouseClickedEvent &e);
     void subscribe_events(std::shared_ptr<EventBus> event_bus);
@@ -528,17 +834,128 @@ public:
 
 class RenderGuiSystem : public System
 {
+private:
+    std::shared_ptr<PrefabRegistry> prefabs; // new enemies are stamped from the "enemy" prefab
+
 public:
-    RenderGuiSystem();
+    RenderGuiSystem(std::shared_ptr<PrefabRegistry> prefabs);
     void update(std::shared_ptr<Registry> registry, SDL_Rect &camera);
 };
 
+// per entity scripts are called as fun(entity, delta_time, elapsed_time) and read and write one value per call,
+// or whole components in place through entity:transform() and friends. registry:view(group) iterates a group.
+// a coroutine script starts the same way but keeps running across frames: wait(seconds) and wait_until(condition)
+// suspend it and hand back entity, delta_time and elapsed_time when it resumes. sleeping coroutines sit in a
+// timer wheel and cost nothing per frame, conditions are polled every frame. it ends when fun returns.
+// a group script is called once per frame as fun(batch, delta_time, elapsed_time) for every entity of its group,
+// batch.x, batch.y, batch.vx, batch.vy and batch.rotation hold their transforms and velocities at 1..batch.count
+// and batch.entities the entities themselves, whatever the script writes to the arrays is copied back after it returns.
+// sandboxed scripts run in the lua states of ScriptWorkers after the other entity scripts, see there
 class ScriptSystem : public System
 {
+public:
+    // collector pauses while the script system steps it, in ms
+    struct GcStats
+    {
+        double last_ms{0};
+        double max_ms{0};
+        double total_ms{0};
+        int frames{0};
+        int cycles{0};
+        int forced{0}; // cycles finished in one go because garbage grew faster than the budget collected it
+        int memory_kb{0};
+    };
+
+    // new script functions by the address of the lua function each one replaces
+    using Rebinding = std::unordered_map<const void *, sol::function>;
+
+private:
+    struct GroupScript
+    {
+        std::string group;
+        sol::function fun;
+        sol::table batch;
+        sol::table x, y, vx, vy, rotation, entities;
+        std::vector<Entity> members; // as last written to batch.entities, userdata is only pushed when they change
+        int count{0};
+    };
+
+    std::vector<GroupScript> group_scripts;
+    std::shared_ptr<ScriptProfiler> profiler; // null when profiling is off
+    std::shared_ptr<ScriptWorkers> workers;   // null until start_workers, sandboxed scripts run in the main state till then
+
+    // the running coroutine of a coroutine script, by entity id
+    struct Coroutine
+    {
+        bool active{false};
+        bool done{false};
+        std::uint32_t generation{0}; // bumped when the coroutine is dropped, its timers are ignored from then on
+        sol::function fun;
+        sol::thread thread;
+        sol::coroutine coroutine;
+        sol::function condition; // set while waiting on wait_until
+    };
+
+    lua_State *lua_state{nullptr};
+    std::vector<Coroutine> coroutines;
+    TimerWheel timers;
+    std::vector<TimerWheel::Timer> due_timers;
+    std::vector<int> polling; // entity ids waiting on a condition
+
+    void start_coroutine(Entity entity, const ScriptComponent &script, double delta_time, int elapsed_time);
+    void resume_coroutine(Entity entity, double delta_time, int elapsed_time);
+    void drop_coroutine(int entity_id);
+    static constexpr int min_gc_threshold_kb = 1024; // small heaps aren't worth a cycle every few frames
+    lua_State *gc_state{nullptr};                     // null while lua runs its own collector
+    double gc_budget_ms{0};
+    bool gc_cycle_running{false};
+    int gc_threshold_kb{0}; // a new cycle starts once lua holds this much
+    GcStats gc_stats;
+
+    // what scripts/ffi.lua indexes in a luajit build, the component of entity id is data[index[id]]
+    // when id < index_size and index[id] >= 0. the pointers are only good until the next insert
+    struct PoolView
+    {
+        void *data;
+        const int *index;
+        int index_size;
+    };
+
+    // called from lua through function pointers, touch marks a component written through the view
+    static const PoolView *pool_view(Registry *registry, int pool);
+    static void touch(Registry *registry, int pool, int entity_id);
+    void run_group_script(Registry &registry, GroupScript &script, double delta_time, int elapsed_time);
+
 public:
     ScriptSystem();
-    void create_lua_bindings(sol::state &lua);
-    void update(double delta_time, int elapsed_time);
+    void remove_entity(Entity entity) override;
+    // e.g. a rewind, coroutines start over from the top when their entities come back
+    void remove_all_entities() override;
+    void create_lua_bindings(sol::state &lua, std::shared_ptr<Registry> registry, std::shared_ptr<PrefabRegistry> prefabs);
+    // replaces the group's script, a nil fun removes it
+    void set_group_script(const std::string &group, sol::function fun);
+    void clear_group_scripts();
+    // the key a function has in a Rebinding, the same for every reference to one lua function
+    static const void *function_id(const sol::function &fun);
+    // points every entity whose script is one of the old functions at its new one,
+    // coroutines running an old function start over with the new one on the next update
+    void rebind(const Rebinding &rebinding);
+    // sandboxed scripts run in state_count lua states from the next update on, on threads when there are several
+    void start_workers(sol::state &lua, std::shared_ptr<Registry> registry, int state_count);
+    const ScriptWorkers *get_workers() const;
+    ScriptWorkers *get_workers();
+    // times every script call from the next update on, see ScriptProfiler
+    void start_profiling(sol::state &lua);
+    void stop_profiling();
+    // the stats gathered since profiling started, null when it is off
+    const ScriptProfiler *get_profiler() const;
+    // stops lua's automatic collector, collect_garbage then runs it in incremental steps of at most budget_ms
+    // per frame. a budget of 0 hands collection back to lua
+    void set_gc_budget(sol::state &lua, double budget_ms);
+    // call once per frame after the simulation
+    void collect_garbage();
+    const GcStats &get_gc_stats() const;
+    void update(std::shared_ptr<Registry> registry, double delta_time, int elapsed_time);
 };
 
 // ============================================================
@@ -547,9 +964,22 @@ public:
 class Registry
 {
 private:
-    int num_entities;
+    friend class Snapshot;
+    friend class RewindBuffer;
+    friend class ScriptSystem;
+
+    int num_entities{0};
+    // bumped by every snapshot capture, restore and take_changed_entities, writes are stamped with it so deltas
+    // can tell what changed since
+    std::uint32_t change_version{1};
+    std::vector<std::uint32_t> entity_versions = std::vector<std::uint32_t>(1000); // last tag, group or signature change
+    // bumped when ids, signatures or system membership change, and when tags or groups change,
+    // the rewind buffer shares the previous tick's copy while they stay the same
+    std::uint32_t structure_revision{0};
+    std::uint32_t label_revision{0};
     std::set<Entity> entities_to_add;
     std::set<Entity> entities_to_kill;
+    std::vector<std::vector<Entity>> batches_to_add; // from create_many, registered with systems batch by batch
 
     std::vector<std::shared_ptr<IPool>> component_pools = std::vector<std::shared_ptr<IPool>>(1000);
     std::vector<Signature> entity_component_signatures = std::vector<Signature>(1000);
@@ -564,8 +994,25 @@ private:
     std::unordered_map<std::string, std::set<Entity>> entities_per_group;
     std::unordered_map<int, std::string> group_per_entity;
 
+    // components whose writes are collected into changed_entities, signature changes are collected
+    // as soon as one is tracked. an entity goes in once per change version
+    Signature tracked_components;
+    mutable std::vector<int> changed_entities;
+
+    std::vector<Entity> reserve_entities(int count);
+    void touch_entity(int entity_id);
+    template <typename TComponent>
+    void note_write(const Pool<TComponent> &pool, int entity_id) const;
+    void add_batch_to_systems(const std::vector<Entity> &batch);
+    template <typename TComponent>
+    std::shared_ptr<Pool<TComponent>> get_pool();
+
 public:
     Entity create_entity();
+    // create count entities holding TComponents in one go: ids are reserved and pools grown once,
+    // init(index, entity, components...) fills the default constructed components in place
+    template <typename... TComponents, typename TInit>
+    std::vector<Entity> create_many(int count, TInit init);
     void kill_entity(Entity entity);
 
     // component management for a specific entity
@@ -575,13 +1022,27 @@ public:
     void remove_component(Entity entity);
     template <typename TComponent>
     bool has_component(Entity entity) const;
+    // get_component hands out a writable reference, so the component counts as changed for delta snapshots;
+    // read_component doesn't, use it where the component is only looked at
     template <typename TComponent>
     TComponent &get_component(Entity entity) const;
+    template <typename TComponent>
+    const TComponent &read_component(Entity entity) const;
+    template <typename TComponent, typename TFunc>
+    void patch(Entity entity, TFunc fn);
+    const Signature &get_component_signature(Entity entity) const;
+    // from now on entities are collected whenever their TComponent is written or their signature changes
+    template <typename TComponent>
+    void track_changes();
+    // swaps in the entities collected since the last call, an id can show up more than once.
+    // later writes are stamped with a newer version, so they are collected again
+    void take_changed_entities(std::vector<int> &entity_ids);
 
     // tag and group management
     void tag(Entity entity, const std::string &tag);
     bool has_tag(Entity entity, const std::string &tag) const;
     Entity get_entity_by_tag(const std::string &tag) const;
+    bool has_entity_with_tag(const std::string &tag) const;
     void remove_entity_tag(Entity entity);
 
     void group(Entity entity, const std::string &group);
@@ -634,41 +1095,74 @@ TComponent &Entity::get_component() const
     return registry->get_component<TComponent>(*this);
 }
 
+template <typename TComponent>
+const TComponent &Entity::read_component() const
+{
+    return registry->read_component<TComponent>(*this);
+}
+
+template <typename TComponent, typename TFunc>
+void Entity::patch(TFunc fn) const
+{
+    registry->patch<TComponent>(*this, fn);
+}
+
 // EventBus
 
+template <typename TEvent>
+EventChannel<TEvent> &EventBus::channel()
+{
+    const int event_id = EventType<TEvent>::id();
+    if (event_id >= max_event_types)
+    {
+        throw std::runtime_error("More event types than the event bus has channels for");
+    }
+    IEventChannel *channel = find_channel(event_id);
+    if (!channel)
+    {
+        owned_channels.push_back(std::make_unique<EventChannel<TEvent>>());
+        channel = owned_channels.back().get();
+        channel->set_queued(queued);
+        channels[event_id].store(channel, std::memory_order_release);
+    }
+    return *static_cast<EventChannel<TEvent> *>(channel);
+}
+
 template <typename TEvent, typename... TArgs>
 void EventBus::emit(TArgs &&...args)
 {
-    auto handlers = subscribers[std::type_index(typeid(TEvent))].get();
-    if (handlers)
+    if (IEventChannel *channel = find_channel(EventType<TEvent>::id()))
     {
-        for (auto it = handlers->begin(); it != handlers->end(); ++it)
-        {
-            auto handler = it->get();
-            TEvent event(std::forward<TArgs>(args)...);
-            handler->exec(event);
-        }
+        static_cast<EventChannel<TEvent> *>(channel)->emit(std::forward<TArgs>(args)...);
     }
 };
 
-template <typename TOwner, typename TEvent>
-void EventBus::subscribe(TOwner *owner, void (TOwner::*callback)(TEvent &))
+template <typename TEvent, typename... TArgs>
+void EventBus::queue(TArgs &&...args)
 {
-    if (!subscribers[typeid(TEvent)].get())
+    if (IEventChannel *channel = find_channel(EventType<TEvent>::id()))
     {
-        subscribers[typeid(TEvent)] = std::make_unique<HandlerList>();
+        static_cast<EventChannel<TEvent> *>(channel)->push(std::forward<TArgs>(args)...);
     }
-    auto handler = std::make_unique<EventCallback<TOwner, TEvent>>(owner, callback);
-    subscribers[typeid(TEvent)]->push_back(std::move(handler));
+}
+
+// the event type comes from the callback's parameter
+template <typename TOwner, typename TEvent>
+TEvent event_of(void (TOwner::*)(TEvent &));
+
+template <auto callback, typename TOwner>
+void EventBus::subscribe(TOwner *owner)
+{
+    using TEvent = decltype(event_of(callback));
+    channel<TEvent>().template subscribe<callback>(owner);
 }
 
 // Registry
-template <typename TComponent, typename... TArgs>
-void Registry::add_component(Entity &entity, TArgs &&...args)
+template <typename TComponent>
+std::shared_ptr<Pool<TComponent>> Registry::get_pool()
 {
-    const auto entity_id = entity.id();
     const auto component_id = Component<TComponent>::id();
-    if (component_id > component_pools.size())
+    if (component_id >= component_pools.size())
     {
         component_pools.resize(component_id + 1, nullptr);
     }
@@ -679,16 +1173,58 @@ void Registry::add_component(Entity &entity, TArgs &&...args)
         component_pools[component_id] = new_component_pool_ptr;
     }
 
-    auto component_pool_ptr = std::static_pointer_cast<Pool<TComponent>>(component_pools[component_id]);
+    return std::static_pointer_cast<Pool<TComponent>>(component_pools[component_id]);
+}
+
+template <typename... TComponents, typename TInit>
+std::vector<Entity> Registry::create_many(int count, TInit init)
+{
+    std::vector<Entity> batch = reserve_entities(count);
+
+    Signature signature;
+    (signature.set(Component<TComponents>::id()), ...);
+
+    auto pools = std::make_tuple(get_pool<TComponents>()...);
+    std::apply([count](auto &...pool)
+               { (pool->reserve(count), ...); },
+               pools);
+
+    for (int i = 0; i < count; i++)
+    {
+        Entity &entity = batch[i];
+        entity_component_signatures[entity.id()] |= signature;
+        std::apply([&](auto &...pool)
+                   { init(i, entity, pool->insert(entity.id())...);
+                     (note_write(*pool, entity.id()), ...);
+                     (pool->touch(entity.id(), change_version), ...); },
+                   pools);
+    }
+
+    batches_to_add.push_back(batch);
+    return batch;
+}
+
+template <typename TComponent, typename... TArgs>
+void Registry::add_component(Entity &entity, TArgs &&...args)
+{
+    const auto entity_id = entity.id();
+    const auto component_id = Component<TComponent>::id();
+    auto component_pool_ptr = get_pool<TComponent>();
 
     // create new component
     TComponent new_component(std::forward<TArgs>(args)...);
 
     // add component to the pool, use entity id as index
     component_pool_ptr->set(entity_id, new_component);
+    note_write(*component_pool_ptr, entity_id);
+    component_pool_ptr->touch(entity_id, change_version);
 
     // set entity signature
-    entity_component_signatures.at(entity_id).set(component_id);
+    if (!entity_component_signatures.at(entity_id).test(component_id))
+    {
+        entity_component_signatures[entity_id].set(component_id);
+        touch_entity(entity_id);
+    }
 
     // Logger::info("added component " + std::to_string(component_id) + " to entity " + std::to_string(entity_id));
 };
@@ -699,6 +1235,7 @@ void Registry::remove_component(Entity entity)
     const auto entity_id = entity.id();
     const auto component_id = Component<TComponent>::id();
     entity_component_signatures.at(entity_id).set(component_id, false);
+    touch_entity(entity_id);
 
     // remove component instance from the corresponding component pool
     std::shared_ptr<Pool<TComponent>> component_pool_ptr = std::static_pointer_cast<Pool<TComponent>>(component_pools[component_id]);
@@ -722,7 +1259,38 @@ TComponent &Registry::get_component(Entity entity) const
     const auto component_id = Component<TComponent>::id();
     auto component_pool = std::static_pointer_cast<Pool<TComponent>>(component_pools.at(component_id));
 
-    return component_pool->get(entity_id);
+    note_write(*component_pool, entity_id);
+    return component_pool->modify(entity_id, change_version);
+};
+
+template <typename TComponent>
+const TComponent &Registry::read_component(Entity entity) const
+{
+    const auto component_id = Component<TComponent>::id();
+    auto component_pool = std::static_pointer_cast<Pool<TComponent>>(component_pools.at(component_id));
+
+    return component_pool->get(entity.id());
+};
+
+template <typename TComponent, typename TFunc>
+void Registry::patch(Entity entity, TFunc fn)
+{
+    fn(get_component<TComponent>(entity));
+};
+
+template <typename TComponent>
+void Registry::track_changes()
+{
+    tracked_components.set(Component<TComponent>::id());
+};
+
+template <typename TComponent>
+void Registry::note_write(const Pool<TComponent> &pool, int entity_id) const
+{
+    if (tracked_components.test(Component<TComponent>::id()) && pool.get_version(entity_id) != change_version)
+    {
+        changed_entities.push_back(entity_id);
+    }
 };
 
 // System
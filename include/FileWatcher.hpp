@@ -0,0 +1,31 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// inotify on the directories of the watched files, so files saved by writing a temporary and renaming it
+// over the original are still seen. only finished writes count, a file is never reported half written
+class FileWatcher
+{
+private:
+    int fd{-1};
+    std::unordered_map<int, std::string> directories; // by watch descriptor
+    std::set<std::string> files;                      // as passed to watch
+    std::vector<char> buffer;
+
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    // false when inotify is unavailable or the file's directory can't be watched
+    bool watch(const std::string &path);
+    // never blocks, each watched path changed since the last poll once
+    std::vector<std::string> poll();
+};
+
+#endif
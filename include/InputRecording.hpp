@@ -0,0 +1,54 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one play session as the simulation saw it: the clock and delta time of every tick, the input events
+// fed in before each tick and a hash of the state after it, enough to run it again without a window
+class InputRecording
+{
+public:
+    struct Tick
+    {
+        std::uint32_t time; // Clock::now() during the tick
+        float dt;
+        std::uint64_t state_hash;
+    };
+
+    enum class InputType : std::uint32_t
+    {
+        key_pressed,
+        mouse_clicked
+    };
+
+    struct Input
+    {
+        std::uint32_t tick; // emitted right before this tick ran
+        InputType type;
+        std::int32_t code;          // SDL keycode or mouse button
+        std::int32_t entity_id{-1}; // the only entity it drives, e.g. a client's player, -1 for all of them
+    };
+
+    static constexpr std::uint32_t magic = 0x49443252; // "R2DI"
+    static constexpr std::uint32_t version = 2;
+
+    // what the session started from
+    std::int32_t level{0};
+    std::uint32_t seed{0};       // passed to math.randomseed before the level loaded
+    std::uint32_t start_time{0}; // clock while the level loaded
+    std::int32_t camera_width{0};
+    std::int32_t camera_height{0};
+
+    std::vector<Tick> ticks;
+    std::vector<Input> inputs;
+
+    // false when the file can't be written
+    bool save(const std::string &path) const;
+    // false when the file is missing, of another version or truncated
+    bool load(const std::string &path);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef LEVEL_FORMAT_H
+#define LEVEL_FORMAT_H
+
+#include <sol/sol.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// plain records mirroring the component constructor arguments, stored as flat arrays in compiled levels
+// every field is fixed size so a whole array can be copied in one go
+
+struct TransformRecord
+{
+    float position_x, position_y;
+    float scale_x, scale_y;
+    double rotation;
+};
+
+struct RigidBodyRecord
+{
+    float velocity_x, velocity_y;
+};
+
+struct SprintRecord
+{
+    std::uint8_t in_sprint;
+    float sprint_speed;
+    std::int32_t sprint_duration;
+    std::int32_t sprint_cooldown;
+};
+
+struct SpriteRecord
+{
+    std::uint32_t asset_name; // string table index
+    std::int32_t width, height;
+    std::int32_t z_index;
+    std::uint8_t is_fixed;
+    std::int32_t src_rect_x, src_rect_y;
+};
+
+struct AnimationRecord
+{
+    std::int32_t num_frames;
+    std::int32_t frame_rate;
+    std::uint8_t should_loop;
+};
+
+struct BoxColliderRecord
+{
+    std::int32_t width, height;
+    float offset_x, offset_y;
+};
+
+struct HealthRecord
+{
+    std::int32_t health;
+};
+
+struct ProjectileEmitterRecord
+{
+    float velocity_x, velocity_y;
+    std::int32_t freq;
+    std::int32_t duration;
+    std::uint8_t is_friendly;
+    std::int32_t damage;
+};
+
+struct KeyboardControlRecord
+{
+    float up_x, up_y;
+    float right_x, right_y;
+    float down_x, down_y;
+    float left_x, left_y;
+};
+
+struct ProjectileRecord
+{
+    std::int32_t duration;
+    std::uint8_t is_friendly;
+    std::int32_t damage;
+};
+
+// components without data only record which entities have them
+struct CameraFollowRecord
+{
+    std::uint8_t unused;
+};
+
+struct MouseControlRecord
+{
+    std::uint8_t unused;
+};
+
+struct ScriptRecord
+{
+    std::uint32_t bytecode; // string table index of the string.dump output
+    std::uint8_t is_coroutine;
+    std::uint8_t is_sandboxed;
+};
+
+// level.group_scripts: one function run over every entity of a group each frame
+struct GroupScriptRecord
+{
+    std::uint32_t group;    // string table index
+    std::uint32_t bytecode; // string table index of the string.dump output
+};
+
+struct EntityRecord
+{
+    std::int32_t tag;    // string table index, -1 when untagged
+    std::int32_t group;  // string table index, -1 when not grouped
+    std::int32_t prefab; // string table index of the prefab stamped before the entity's own components, -1 for none
+};
+
+// a prefab declared by the level, its components are stored under a definition entity that is never created
+struct PrefabRecord
+{
+    std::uint32_t name;
+    std::uint32_t entity;
+};
+
+struct AssetRecord
+{
+    std::uint32_t type; // 0 texture, 1 font
+    std::uint32_t id;
+    std::uint32_t file;
+    std::int32_t font_size;
+};
+
+// level.prelude: run on every load, compiled or not, for choices that mustn't be frozen into the binary
+struct PreludeRecord
+{
+    std::uint32_t bytecode; // string table index of the string.dump output
+};
+
+// scalar globals the level script declared or changed, restored before the level's scripts run
+struct GlobalRecord
+{
+    std::uint32_t name;
+    std::uint32_t type; // 0 number, 1 string, 2 boolean
+    double number;
+    std::uint32_t string;
+};
+
+// tile grid of the level, tiles holds rows * cols codes
+struct TilemapRecord
+{
+    std::uint32_t texture; // string table index
+    std::int32_t rows;
+    std::int32_t cols;
+};
+
+// files the compiled level was built from, used to detect a stale binary
+struct SourceRecord
+{
+    std::uint32_t path;
+    std::int64_t modified_time;
+};
+
+template <typename TRecord>
+struct ComponentRecords
+{
+    std::vector<std::uint32_t> entities; // index into LevelData::entities
+    std::vector<TRecord> records;
+
+    void add(std::uint32_t entity, const TRecord &record)
+    {
+        entities.push_back(entity);
+        records.push_back(record);
+    }
+};
+
+// everything needed to build a level, filled either by walking the lua tables or from a compiled file
+struct LevelData
+{
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, std::uint32_t> string_ids;
+
+    std::vector<SourceRecord> sources;
+    std::vector<AssetRecord> assets;
+    std::vector<GlobalRecord> globals;
+    std::vector<EntityRecord> entities;
+    std::vector<PrefabRecord> prefabs;
+
+    // tile codes as written in the .map file: tens digit is the tileset row, ones digit the column
+    TilemapRecord tilemap{0, 0, 0};
+    std::vector<std::uint8_t> tiles;
+
+    ComponentRecords<TransformRecord> transforms;
+    ComponentRecords<RigidBodyRecord> rigid_bodies;
+    ComponentRecords<SprintRecord> sprints;
+    ComponentRecords<SpriteRecord> sprites;
+    ComponentRecords<AnimationRecord> animations;
+    ComponentRecords<BoxColliderRecord> box_colliders;
+    ComponentRecords<HealthRecord> healths;
+    ComponentRecords<ProjectileEmitterRecord> projectile_emitters;
+    ComponentRecords<ProjectileRecord> projectiles;
+    ComponentRecords<CameraFollowRecord> camera_follows;
+    ComponentRecords<KeyboardControlRecord> keyboard_controls;
+    ComponentRecords<MouseControlRecord> mouse_controls;
+    ComponentRecords<ScriptRecord> scripts;
+
+    std::vector<GroupScriptRecord> group_scripts;
+    std::vector<PreludeRecord> preludes; // at most one
+
+    // runtime only, one per scripts record: taken from the lua tables or loaded back from bytecode
+    std::vector<sol::function> script_functions;
+    // runtime only, one per group_scripts record
+    std::vector<sol::function> group_script_functions;
+    // runtime only, one per preludes record
+    std::vector<sol::function> prelude_functions;
+    // runtime only, why the level can't be compiled, empty when it can
+    std::string not_compilable;
+
+    std::uint32_t intern(const std::string &value);
+    std::uint32_t add_entity(const std::string &tag = "", const std::string &group = "", const std::string &prefab = "");
+    void add_source(const std::string &path);
+    void clear();
+};
+
+// versioned binary form of LevelData, read back through a memory mapping
+class CompiledLevel
+{
+public:
+    static constexpr std::uint32_t magic = 0x4c443252; // "R2DL"
+    static constexpr std::uint32_t version = 7;
+
+    // dump the scripts to bytecode and write the level, false when the file can't be written or the level
+    // can't be compiled: it defines functions or tables outside level, or one of its scripts has upvalues
+    static bool save(const std::string &path, LevelData &level, sol::state &lua);
+    // false when the file is missing, of another version, older than one of its sources or holds an index
+    // past its string table or entity list
+    static bool load(const std::string &path, LevelData &level, sol::state &lua);
+};
+
+#endif
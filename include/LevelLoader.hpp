@@ -1,18 +1,80 @@
+#ifndef LEVEL_LOADER_H
+#define LEVEL_LOADER_H
+
 #include <SDL2/SDL.h>
 #include <sol/sol.hpp>
 #include "ECS.hpp"
 #include "Store.hpp"
+#include "LevelFormat.hpp"
+
+class AssetLoader;
+class PrefabRegistry;
+class WorldStreamer;
+
+// a script function of the loaded level and the key it is found by again once the script changed:
+// the tag of its entity, the prefab it belongs to, its entity's position in level.entities when that has
+// neither, or the group of a group script
+struct LevelScript
+{
+    std::string key;
+    sol::function fun;
+};
 
 class LevelLoader
 {
 private:
     std::shared_ptr<Registry> registry;
     std::shared_ptr<AssetStore> asset_store;
-    SDL_Renderer *renderer;
+    std::shared_ptr<AssetLoader> asset_loader;
+    std::shared_ptr<PrefabRegistry> prefabs;
+    std::shared_ptr<WorldStreamer> world_streamer; // null when the whole level is resident
+    vec2 map_size{0};
+    std::vector<LevelScript> scripts;
+
+    // walk the level script's tables into records, false when the script fails to load
+    bool parse_script(sol::state &lua, const std::string &script_path, LevelData &data);
+    static bool is_same_value(const sol::object &a, const sol::object &b);
+    // level.prelude = function() return {tilemap = {texture_asset_id = ...}} end runs on every load, compiled
+    // or not, and what it returns replaces the parsed fields
+    void run_prelude(LevelData &data);
+    // runs a script that sets a global prefabs table and parses that, false when the script fails to load
+    bool parse_prefabs_script(sol::state &lua, const std::string &script_path, LevelData &data);
+    // prefabs_table maps names to {group, components}, each becomes a definition entity in data
+    void parse_prefabs(sol::table prefabs_table, LevelData &data);
+    void parse_components(sol::table entity, LevelData &data, std::uint32_t new_entity);
+    void parse_tilemap(const std::string &map_file_path, const std::string &texture_asset_id, LevelData &data);
+    void queue_assets(sol::state &lua, int level, const LevelData &data, AssetScope &level_assets);
+    void register_prefabs(const LevelData &data);
+    void create_entities(const LevelData &data);
+    static std::vector<LevelScript> collect_scripts(const LevelData &data);
+    // swaps the functions of scripts for those with the same key in data, in every entity and prefab
+    void rebind_scripts(const LevelData &data, std::vector<LevelScript> &scripts, ScriptSystem::Rebinding &rebinding);
 
 public:
-    LevelLoader(std::shared_ptr<Registry> registry, std::shared_ptr<AssetStore> asset_store, SDL_Renderer *renderer);
+    LevelLoader(std::shared_ptr<Registry> registry, std::shared_ptr<AssetStore> asset_store, std::shared_ptr<AssetLoader> asset_loader, std::shared_ptr<PrefabRegistry> prefabs,
+                std::shared_ptr<WorldStreamer> world_streamer = nullptr);
     ~LevelLoader() = default;
 
-    void load(sol::state &lua, int level);
-};
\ No newline at end of file
+    // every asset the level declares is referenced through level_assets until that scope is cleared
+    // with config.compiled_levels enabled the level is read from its compiled binary while that is up to date,
+    // otherwise the lua script is run and compiled for the next load
+    // without entities only the assets and map size are loaded, a replication client gets its entities from the server
+    void load(sol::state &lua, int level, AssetScope &level_assets, bool with_entities = true);
+    // compile the prefabs table declared by a script once, instances are stamped from PrefabRegistry
+    void load_prefabs(sol::state &lua, const std::string &script_path);
+    static std::string script_path(int level);
+    // runs a changed level script again in the same state and points the entities, prefabs and group scripts
+    // using its old functions at the new ones, found by their keys in scripts. tiles, entities and the asset
+    // store stay as they are, assets the script adds come with the next load. rebinding gets every swap for
+    // snapshots taken before, false and nothing swapped when the script fails
+    bool reload_scripts(sol::state &lua, int level, std::vector<LevelScript> &scripts, ScriptSystem::Rebinding &rebinding);
+    // the same for the script load_prefabs ran
+    bool reload_prefabs(sol::state &lua, const std::string &script_path, std::vector<LevelScript> &scripts,
+                        ScriptSystem::Rebinding &rebinding);
+    // world size covered by the loaded tilemap
+    vec2 get_map_size() const;
+    // the script functions of what load or load_prefabs loaded last
+    const std::vector<LevelScript> &get_scripts() const;
+};
+
+#endif
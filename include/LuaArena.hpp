@@ -0,0 +1,67 @@
+#ifndef LUA_ARENA_H
+#define LUA_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// lua allocator that serves the small blocks tables, strings and closures are made of from slabs, every slab
+// holding blocks of one size class, bigger blocks go to malloc. a slab goes back to the system with its last
+// block unless it is the only one of its class with room. the arena has to outlive the lua state it was
+// handed to, Game only uses it when lua_gc.arena is set in config.lua
+class LuaArena
+{
+private:
+    static constexpr std::size_t granularity = 16; // keeps every block aligned for any lua type
+    static constexpr std::size_t max_small = 256;
+    static constexpr std::size_t class_count = max_small / granularity;
+    static constexpr std::size_t slab_size = 16 * 1024; // slabs are aligned to their size, a block finds its slab by masking
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct Slab
+    {
+        Slab *prev; // slabs of the same class with room
+        Slab *next;
+        FreeBlock *free_blocks;
+        char *bump; // blocks from here on were never handed out
+        std::uint32_t live;
+        std::uint32_t size_class;
+        std::size_t index; // in slabs
+    };
+    static constexpr std::size_t header_size = (sizeof(Slab) + granularity - 1) / granularity * granularity;
+
+    Slab *with_room[class_count] = {};
+    std::vector<Slab *> slabs;
+    std::unordered_set<void *> kept_large; // malloc blocks lua shrank to a small size, they stay where they are
+    std::size_t small_bytes{0};            // handed out from the slabs and not freed yet
+
+    static std::size_t class_of(std::size_t size);
+    static Slab *slab_of(void *block);
+    static bool has_room(const Slab *slab);
+    Slab *create_slab(std::size_t size_class);
+    void destroy_slab(Slab *slab);
+    void link(Slab *slab);
+    void unlink(Slab *slab);
+    void *allocate_small(std::size_t size);
+    void free_small(void *block);
+    bool take_kept_large(void *block);
+
+public:
+    LuaArena() = default;
+    LuaArena(const LuaArena &) = delete;
+    LuaArena &operator=(const LuaArena &) = delete;
+    ~LuaArena();
+
+    // lua_Alloc, ud is the arena. shrinking never fails or moves a block
+    static void *allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize);
+
+    std::size_t get_small_bytes() const;
+    std::size_t get_slab_bytes() const;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// read only memory mapping of a whole file, unmapped on destruction
+// get_data is null when the file is missing or empty
+class MappedFile
+{
+private:
+    const char *data{nullptr};
+    std::size_t size{0};
+
+public:
+    MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *get_data() const;
+    std::size_t get_size() const;
+};
+
+#endif
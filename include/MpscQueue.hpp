@@ -0,0 +1,180 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// unbounded lock-free queue, any number of threads push and a single thread pops. every pushing thread
+// gets a chain of fixed-size blocks of its own, so a push never waits on another thread and only touches
+// the heap when its blocks run out. the consumer hands drained blocks back to their producer, so once the
+// chains are long enough for the busiest frame nothing is allocated any more. values of one thread come
+// out in the order it pushed them, a value pushed while pop runs may only show up on the next pop
+template <typename T>
+class MpscQueue
+{
+private:
+    static constexpr std::size_t block_size = 256;
+    static constexpr std::size_t max_producers = 64;
+
+    struct Block
+    {
+        alignas(T) unsigned char slots[block_size * sizeof(T)];
+        std::atomic<Block *> next{nullptr}; // the chain while in use, the free stack once drained
+
+        T *slot(std::size_t index)
+        {
+            return std::launder(reinterpret_cast<T *>(slots + index * sizeof(T)));
+        }
+    };
+
+    struct alignas(64) Producer
+    {
+        std::atomic<std::thread::id> owner{};
+        std::atomic<std::size_t> pushed{0};
+        std::atomic<Block *> free_blocks{nullptr}; // drained by the consumer, taken all at once by the producer
+
+        // producer side
+        Block *tail{nullptr};
+        std::size_t tail_index{0};
+        Block *cache{nullptr}; // free blocks the producer took, linked through next
+
+        // consumer side, set up by the producer before its first push is published
+        Block *head{nullptr};
+        std::size_t head_index{0};
+        std::size_t popped{0};
+    };
+
+    std::array<Producer, max_producers> producers;
+    std::atomic<std::size_t> producer_count{0};
+
+    Producer &producer_of_this_thread()
+    {
+        const auto id = std::this_thread::get_id();
+        const std::size_t count = producer_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count && i < max_producers; i++)
+        {
+            if (producers[i].owner.load(std::memory_order_relaxed) == id)
+            {
+                return producers[i];
+            }
+        }
+        const std::size_t claimed = producer_count.fetch_add(1, std::memory_order_acq_rel);
+        if (claimed >= max_producers)
+        {
+            throw std::runtime_error("More threads push to an MpscQueue than it has producer slots for");
+        }
+        Producer &producer = producers[claimed];
+        producer.tail = new Block();
+        producer.head = producer.tail;
+        producer.owner.store(id, std::memory_order_release);
+        return producer;
+    }
+
+    static Block *take_block(Producer &producer)
+    {
+        if (!producer.cache)
+        {
+            producer.cache = producer.free_blocks.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (!producer.cache)
+        {
+            return new Block();
+        }
+        Block *block = producer.cache;
+        producer.cache = block->next.load(std::memory_order_relaxed);
+        block->next.store(nullptr, std::memory_order_relaxed);
+        return block;
+    }
+
+    static void give_back(Producer &producer, Block *block)
+    {
+        Block *top = producer.free_blocks.load(std::memory_order_relaxed);
+        do
+        {
+            block->next.store(top, std::memory_order_relaxed);
+        } while (!producer.free_blocks.compare_exchange_weak(top, block, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    static void delete_chain(Block *block)
+    {
+        while (block)
+        {
+            Block *next = block->next.load(std::memory_order_relaxed);
+            delete block;
+            block = next;
+        }
+    }
+
+public:
+    MpscQueue() = default;
+    ~MpscQueue()
+    {
+        while (pop())
+        {
+        }
+        const std::size_t count = std::min(producer_count.load(std::memory_order_acquire), max_producers);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            // head reaches tail once everything is popped
+            delete_chain(producers[i].head);
+            delete_chain(producers[i].cache);
+            delete_chain(producers[i].free_blocks.load(std::memory_order_acquire));
+        }
+    }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    template <typename... TArgs>
+    void push(TArgs &&...args)
+    {
+        Producer &producer = producer_of_this_thread();
+        if (producer.tail_index == block_size)
+        {
+            Block *block = take_block(producer);
+            // published by the pushed store below, before the consumer can get here
+            producer.tail->next.store(block, std::memory_order_relaxed);
+            producer.tail = block;
+            producer.tail_index = 0;
+        }
+        new (producer.tail->slot(producer.tail_index)) T(std::forward<TArgs>(args)...);
+        producer.tail_index++;
+        producer.pushed.store(producer.pushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer thread only, producers in the order they first pushed
+    std::optional<T> pop()
+    {
+        const std::size_t count = std::min(producer_count.load(std::memory_order_acquire), max_producers);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            Producer &producer = producers[i];
+            if (producer.popped == producer.pushed.load(std::memory_order_acquire))
+            {
+                continue;
+            }
+            if (producer.head_index == block_size)
+            {
+                Block *drained = producer.head;
+                producer.head = drained->next.load(std::memory_order_relaxed);
+                producer.head_index = 0;
+                give_back(producer, drained);
+            }
+            T *slot = producer.head->slot(producer.head_index);
+            std::optional<T> value(std::move(*slot));
+            slot->~T();
+            producer.head_index++;
+            producer.popped++;
+            return value;
+        }
+        return std::nullopt;
+    }
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PREFAB_H
+#define PREFAB_H
+
+#include "ECS.hpp"
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// components carrying a start time get it reset when they are copied into a new instance
+template <typename TComponent>
+void restart_timers(TComponent &component) {}
+void restart_timers(SprintComponent &component);
+void restart_timers(AnimationComponent &component);
+void restart_timers(ProjectileEmitterComponent &component);
+void restart_timers(ProjectileComponent &component);
+
+class IPrefabComponent
+{
+public:
+    virtual ~IPrefabComponent() = default;
+    virtual void add_to(Entity &entity) const = 0;
+};
+
+template <typename TComponent>
+class PrefabComponent : public IPrefabComponent
+{
+public:
+    TComponent component;
+    PrefabComponent(const TComponent &component) : component(component) {}
+    void add_to(Entity &entity) const override
+    {
+        TComponent copy = component;
+        restart_timers(copy);
+        entity.add_component<TComponent>(std::move(copy));
+    }
+};
+
+// a component bundle built once, instances are stamped out by copying it
+class Prefab
+{
+private:
+    std::string group;
+    std::unordered_map<int, std::shared_ptr<IPrefabComponent>> components; // by component id
+    Signature signature;
+
+public:
+    void set_group(const std::string &group);
+    const std::string &get_group() const;
+
+    // replaces a component of the same type already in the bundle
+    template <typename TComponent>
+    void add(const TComponent &component)
+    {
+        components[Component<TComponent>::id()] = std::make_shared<PrefabComponent<TComponent>>(component);
+        signature.set(Component<TComponent>::id());
+    }
+
+    // the bundle's copy of a component, null when the prefab doesn't have one
+    template <typename TComponent>
+    const TComponent *get() const
+    {
+        auto it = components.find(Component<TComponent>::id());
+        if (it == components.end())
+        {
+            return nullptr;
+        }
+        return &static_cast<const PrefabComponent<TComponent> &>(*it->second).component;
+    }
+    const Signature &get_signature() const;
+
+    // copy every component into an existing entity, overwriting the ones it already has
+    void stamp(Entity &entity) const;
+    // new entity in the prefab's group holding a copy of the bundle
+    Entity instantiate(Registry &registry) const;
+};
+
+class PrefabRegistry
+{
+private:
+    std::unordered_map<std::string, Prefab> prefabs;
+
+public:
+    void add(const std::string &name, const Prefab &prefab);
+    bool has(const std::string &name) const;
+    const Prefab &get(const std::string &name) const;
+
+    Entity instantiate(Registry &registry, const std::string &name) const;
+    // override(entity) runs right after the bundle is copied, e.g. to place the instance
+    template <typename TOverride>
+    Entity instantiate(Registry &registry, const std::string &name, TOverride override) const
+    {
+        Entity entity = instantiate(registry, name);
+        override(entity);
+        return entity;
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "ECS.hpp"
+#include "InputRecording.hpp"
+#include "Prefab.hpp"
+#include <cstdint>
+#include <deque>
+#include <netinet/in.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// non-blocking UDP socket on 127.0.0.1
+class UdpSocket
+{
+private:
+    int fd{-1};
+
+public:
+    UdpSocket() = default;
+    UdpSocket(const UdpSocket &) = delete;
+    UdpSocket &operator=(const UdpSocket &) = delete;
+    ~UdpSocket();
+
+    // port 0 binds any free port, false when the socket can't be opened or bound
+    bool open(std::uint16_t port);
+    void close();
+    bool send_to(const sockaddr_in &address, const std::vector<char> &packet);
+    // false when no packet is waiting
+    bool receive(std::vector<char> &packet, sockaddr_in &from);
+};
+
+// an entity as it goes over the wire: position in 1/16 pixel, rotation in 1/65536 of a turn, scale in 1/256
+class NetEntity
+{
+public:
+    enum Flags : std::uint8_t
+    {
+        has_health = 1,
+        is_fixed = 2,
+        is_dynamic = 4, // moved by physics or scripts
+        follows_camera = 8
+    };
+
+    std::int32_t x{0};
+    std::int32_t y{0};
+    std::uint16_t rotation{0};
+    std::uint16_t frame_x{0};
+    std::uint16_t frame_y{0};
+    std::uint8_t health{0};
+
+    // only sent when the entity comes into view or its id was reused for something else
+    std::string asset_name;
+    std::uint16_t width{0};
+    std::uint16_t height{0};
+    std::int16_t z_index{0};
+    std::uint16_t scale_x{0};
+    std::uint16_t scale_y{0};
+    std::uint8_t flip{0};
+    std::uint8_t flags{0};
+
+    static NetEntity quantize(const Entity &entity);
+    // equal spawn fields, the client can update the entity in place
+    bool same_kind(const NetEntity &other) const;
+};
+
+// by server entity id
+using NetState = std::unordered_map<int, NetEntity>;
+
+// sends every client the entities around its camera, each state only holds what changed since the last
+// state the client acknowledged. inputs the clients send are handed to the game to emit, aimed at the
+// client's own player once set_player gave clients one
+class ReplicationServer
+{
+private:
+    struct Client
+    {
+        sockaddr_in address;
+        SDL_Rect camera{0, 0, 0, 0};
+        std::uint32_t acked_tick{0}; // newest state the client has, 0 before the first
+        std::uint32_t last_heard{0};
+        std::deque<std::pair<std::uint32_t, NetState>> sent; // states since acked_tick, by tick
+        std::uint64_t bytes_sent{0};
+        int player{-1}; // entity id of the client's player, -1 when clients only watch
+    };
+
+    std::shared_ptr<Registry> registry;
+    UdpSocket socket;
+    std::vector<Client> clients;
+    std::shared_ptr<Prefab> player; // null when clients only watch
+    std::uint32_t timeout;
+    std::uint64_t bytes_sent{0};
+    std::vector<char> packet;
+    std::vector<Entity> visible;
+
+    void send_state(Client &client, std::uint32_t tick);
+    void drop_player(const Client &client);
+
+public:
+    ReplicationServer(std::shared_ptr<Registry> registry, std::uint32_t timeout = 2000);
+
+    bool open(std::uint16_t port);
+    // clients joining from now on get an instance of prefab, their inputs only drive that entity
+    void set_player(const Prefab &prefab);
+    // handles every waiting packet and drops clients silent for longer than timeout ms
+    void receive(std::uint32_t now, std::vector<InputRecording::Input> &inputs);
+    // call after the tick ran
+    void send(std::uint32_t tick);
+
+    int get_client_count() const;
+    // bytes sent to all clients so far
+    std::uint64_t get_bytes_sent() const;
+};
+
+// mirrors the server's entities around the camera into the local registry
+class ReplicationClient
+{
+private:
+    struct Mirror
+    {
+        Entity entity;
+        NetEntity state; // as last applied
+    };
+
+    std::shared_ptr<Registry> registry;
+    UdpSocket socket;
+    sockaddr_in server;
+    std::deque<std::pair<std::uint32_t, NetState>> received; // recent states, the server's deltas build on them
+    std::unordered_map<int, Mirror> mirrors;                 // by server id
+    std::uint32_t last_heard{0};
+    std::vector<InputRecording::Input> inputs;
+    std::uint64_t bytes_received{0};
+    std::vector<char> packet;
+
+    // decodes the packet into received, false when it is stale, malformed or its baseline is gone
+    bool read_state();
+    void apply(const NetState &state);
+    Entity spawn(const NetEntity &net_entity);
+
+public:
+    ReplicationClient(std::shared_ptr<Registry> registry);
+
+    bool connect(std::uint16_t port);
+    void queue_input(InputRecording::InputType type, std::int32_t code);
+    // applies the newest state that arrived, false once the server was silent for longer than timeout ms
+    bool receive(std::uint32_t now, std::uint32_t timeout);
+    // acknowledges the newest state, sends the camera and the inputs queued since the last send
+    void send(const SDL_Rect &camera);
+    void disconnect();
+
+    std::uint64_t get_bytes_received() const;
+};
+
+#endif
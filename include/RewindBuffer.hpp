@@ -0,0 +1,90 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+
+#include "ECS.hpp"
+#include <cstdint>
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+// the registry as it was at the end of each of the last capacity ticks, kept in memory for rollback.
+// a tick only copies the pools written during it, everything else is shared with the tick before,
+// so recording every tick costs about one copy of the pools that actually move
+class RewindBuffer
+{
+public:
+    // what a recorded tick ran with, enough to run it again
+    struct Timing
+    {
+        std::uint32_t tick;
+        std::uint32_t time;
+        float dt;
+    };
+
+private:
+    // ids, signatures, pending creations and kills and the entities of every system, in system order
+    struct EntityState
+    {
+        int num_entities;
+        std::vector<Signature> signatures;
+        std::deque<int> free_ids;
+        std::set<Entity> entities_to_add;
+        std::set<Entity> entities_to_kill;
+        std::vector<std::vector<Entity>> batches_to_add;
+        std::vector<std::pair<std::type_index, std::vector<Entity>>> system_entities;
+    };
+
+    struct Labels
+    {
+        std::unordered_map<int, std::string> tag_per_entity;
+        std::unordered_map<int, std::string> group_per_entity;
+    };
+
+    struct Frame
+    {
+        std::uint32_t tick;
+        std::uint32_t time;
+        float dt;
+        std::vector<std::shared_ptr<const IPool>> pools; // by component id, null when the registry had no pool
+        std::shared_ptr<const EntityState> entities;
+        std::shared_ptr<const Labels> labels;
+    };
+
+    // what the newest frame was copied from, a live pool with the same address and revision is unchanged
+    struct Source
+    {
+        const IPool *pool;
+        std::uint32_t revision;
+    };
+
+    std::vector<Frame> frames; // ring, tick t lives at t % capacity
+    std::size_t count{0};
+    std::uint32_t newest_tick{0};
+    std::vector<Source> sources;
+    const Registry *source_registry{nullptr};
+    std::uint32_t structure_revision{0};
+    std::uint32_t label_revision{0};
+
+    void remember_sources(const Registry &registry);
+
+public:
+    RewindBuffer(std::size_t capacity = 120);
+
+    // call once per tick after the systems ran, a tick that doesn't follow the newest one
+    // or a different registry starts the buffer over
+    void record(const Registry &registry, std::uint32_t tick, std::uint32_t time, float dt);
+    // puts the registry back to the end of tick and forgets every newer tick,
+    // false and the registry untouched when tick is not in the buffer
+    bool rewind(Registry &registry, std::uint32_t tick);
+    // the ticks after tick, oldest first, taken before a rewind to simulate them again
+    std::vector<Timing> get_timings_after(std::uint32_t tick) const;
+
+    bool contains(std::uint32_t tick) const;
+    std::uint32_t get_oldest_tick() const;
+    std::uint32_t get_newest_tick() const;
+    std::size_t size() const;
+    std::size_t get_capacity() const;
+    void clear();
+};
+
+#endif
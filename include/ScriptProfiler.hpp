@@ -0,0 +1,112 @@
+#ifndef SCRIPT_PROFILER_H
+#define SCRIPT_PROFILER_H
+
+#include <sol/sol.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// times every script call grouped by where the lua function was defined, counts the binding calls each
+// function makes and the bytes lua allocates while it runs. while it lives, the lua state's allocator is
+// wrapped to count allocations, so there should be one profiler per state at a time
+class ScriptProfiler
+{
+public:
+    enum Binding
+    {
+        set_position,
+        get_position,
+        set_velocity,
+        get_velocity,
+        set_rotation,
+        set_animation_frame,
+        set_projectile_velocity,
+        spawn_wave,
+        spawn,
+        component,
+        view,
+        binding_count
+    };
+    static const char *binding_names[binding_count];
+
+    struct FunctionStats
+    {
+        std::string source; // file:line the function was defined at
+        std::uint64_t calls{0};
+        double total_ms{0};
+        double max_ms{0};
+        std::uint64_t allocated{0};
+        std::array<std::uint64_t, binding_count> binding_calls{};
+
+        // the last frame
+        int frame_calls{0};
+        double frame_ms{0};
+        std::uint64_t frame_allocated{0};
+        int slowest_entity{-1}; // entity of the frame's slowest call, -1 for group scripts
+        double slowest_ms{0};
+    };
+
+private:
+    lua_State *L;
+    lua_Alloc alloc;
+    void *alloc_ud;
+    std::uint64_t allocated{0}; // by lua since the profiler started
+
+    // a function's stats are found by where it was defined, closures of the same code share them. the cache
+    // skips lua_getinfo for functions seen before and holds them, so a collected closure's address can't
+    // come back as another function
+    struct CachedFunction
+    {
+        sol::function fun;
+        std::size_t slot;
+    };
+    static constexpr std::size_t max_cached = 4096; // the cache starts over beyond this many closures
+    std::unordered_map<std::string, std::size_t> source_slots; // index into functions by file:line
+    std::unordered_map<const void *, CachedFunction> function_cache;
+    std::vector<FunctionStats> functions;
+    FunctionStats *current{nullptr};
+    int current_entity{-1};
+    std::chrono::steady_clock::time_point call_start;
+    std::uint64_t call_allocated{0};
+
+    int frames{0};
+    double total_ms{0};
+    double frame_ms{0};
+    std::uint64_t frame_allocated{0};
+    std::uint64_t frame_start_allocated{0};
+    std::chrono::steady_clock::time_point frame_start;
+
+    static void *count_alloc(void *ud, void *ptr, std::size_t osize, std::size_t nsize);
+    FunctionStats &stats_of(const sol::function &fun);
+
+public:
+    ScriptProfiler(lua_State *L);
+    ScriptProfiler(const ScriptProfiler &) = delete;
+    ScriptProfiler &operator=(const ScriptProfiler &) = delete;
+    // hands the state its own allocator back
+    ~ScriptProfiler();
+
+    void begin_frame();
+    void end_frame();
+    // around one script call, entity_id -1 for group scripts
+    void begin_call(const sol::function &fun, int entity_id);
+    void end_call();
+    // called by the bindings, counted for the script running at the time
+    void count_binding(Binding binding);
+    // lets go of the functions looked up so far, e.g. after scripts were reloaded
+    void clear_cache();
+
+    const std::vector<FunctionStats> &get_functions() const;
+    int get_frames() const;
+    double get_frame_ms() const;
+    double get_average_ms() const;
+    std::uint64_t get_frame_allocated() const;
+    std::uint64_t get_allocated() const;
+    // a text table of every function, slowest total first, false when the file can't be written
+    bool dump(const std::string &path) const;
+};
+
+#endif
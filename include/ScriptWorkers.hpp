@@ -0,0 +1,128 @@
+#ifndef SCRIPT_WORKERS_H
+#define SCRIPT_WORKERS_H
+
+#include <sol/sol.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Registry;
+
+// runs sandboxed entity scripts in lua states of their own, an entity's script always runs in state
+// id % state count and each state has a thread when there is more than one. scripts only touch the world
+// through command buffers applied in a fixed order, so unless they keep state in lua globals the result
+// doesn't depend on the number of states. a script is its main state function's bytecode loaded into the
+// state, so only functions capturing nothing but _ENV move, the rest run in the main state. the number, string
+// and boolean globals of the main state are copied in by copy_globals. it is called as
+// fun(id, delta_time, elapsed_time) with the entity's id and reaches
+// the world only through
+//   get_position(id), get_velocity(id), get_rotation(id)  any entity as it was before the states started
+//   set_position, set_velocity, set_rotation, set_animation_frame, set_projectile_velocity  its own entity only,
+//                                                         queued and applied once every state finished
+//   send(to, name, value)                                 a message to the script of entity to
+//   receive(id)                                           what was sent to its own entity last run, as
+//                                                         {from, name, value} tables ordered by from,
+//                                                         which is -1 for the main state
+class ScriptWorkers
+{
+public:
+    struct Message
+    {
+        int from;
+        int to;
+        std::string name;
+        double value;
+    };
+
+private:
+    enum class CommandType
+    {
+        position,
+        velocity,
+        rotation,
+        animation_frame,
+        projectile_velocity
+    };
+
+    // a write to the world, queued by a script and applied by the main thread
+    struct Command
+    {
+        CommandType type;
+        int entity_id;
+        double x;
+        double y;
+    };
+
+    struct Job
+    {
+        int entity_id;
+        sol::protected_function *fun;
+    };
+
+    struct Worker
+    {
+        sol::state lua;
+        std::unordered_map<const void *, sol::protected_function> functions; // by the main state function loaded
+        std::vector<Job> jobs;
+        std::vector<Command> commands;
+        std::vector<Message> outbox;
+        std::vector<std::string> errors;
+        int current{-1}; // the entity whose script is running, the only one it writes to
+        std::thread thread;
+    };
+
+    Registry *registry;
+    lua_State *main_state;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unordered_map<const void *, std::string> bytecode; // dumped once per main state function
+    std::vector<sol::function> dumped;                      // kept alive so their addresses aren't reused
+    std::unordered_map<int, std::vector<Message>> inbox;    // only read while the states run
+    std::vector<Message> main_outbox;
+    std::set<std::string> reported; // each error is logged once
+    double delta_time{0};
+    int elapsed_time{0};
+
+    std::mutex mutex;
+    std::condition_variable frame_started;
+    std::condition_variable frame_finished;
+    std::uint64_t frame{0};
+    int running{0};
+    bool stopping{false};
+
+    void create_bindings(Worker &worker);
+    sol::protected_function *load(Worker &worker, const sol::function &fun);
+    void run_jobs(Worker &worker);
+    void work(Worker &worker);
+    void apply(const Command &command);
+
+public:
+    // a state_count of 0 or less gives one state per core, the registry has to outlive the workers
+    ScriptWorkers(sol::state &lua, Registry *registry, int state_count);
+    ~ScriptWorkers();
+    ScriptWorkers(const ScriptWorkers &) = delete;
+    ScriptWorkers &operator=(const ScriptWorkers &) = delete;
+
+    // queues the entity's script for the next run, false when fun can't be moved to another state
+    bool add(int entity_id, const sol::function &fun);
+    // runs every queued script, waits for all states and applies their commands and messages in state order,
+    // so the outcome doesn't depend on which thread finished first
+    void run(double delta_time, int elapsed_time);
+    // every state draws its own math.random sequence from seed, the same on every run with that seed
+    void seed(std::uint32_t seed);
+    // the scalar globals of the main state, e.g. map_height, are copied into every state.
+    // call once the level script ran and again when it is reloaded
+    void copy_globals();
+    // from a script of the main state, delivered with the next run
+    void send(int to, const std::string &name, double value);
+    // e.g. after a rewind, messages in flight are dropped
+    void clear_messages();
+    int get_state_count() const;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "ECS.hpp"
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// appends values to a snapshot, lua functions can't be turned into bytes in memory
+// so they are kept aside and written as an index into the function table
+class SnapshotWriter
+{
+private:
+    std::vector<char> &bytes;
+    std::vector<sol::function> &functions;
+
+public:
+    SnapshotWriter(std::vector<char> &bytes, std::vector<sol::function> &functions);
+
+    void write_bytes(const void *data, std::size_t size);
+    template <typename T>
+    void write(const T &value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(&value, sizeof(T));
+    }
+    void write_string(const std::string &value);
+    void write_function(const sol::function &fun);
+};
+
+// reads values back in the order they were written, a read past the end marks the reader invalid
+// and fills the value with zeroes instead
+class SnapshotReader
+{
+private:
+    const std::vector<char> &bytes;
+    const std::vector<sol::function> &functions;
+    std::size_t position{0};
+    bool valid{true};
+
+public:
+    SnapshotReader(const std::vector<char> &bytes, const std::vector<sol::function> &functions);
+
+    bool is_valid() const;
+    std::size_t remaining() const;
+    void read_bytes(void *data, std::size_t size);
+    template <typename T>
+    T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+    std::string read_string();
+    sol::function read_function();
+};
+
+// components holding strings or lua references are written field by field,
+// every other component is plain data and written as a whole pool at once
+void encode_component(SnapshotWriter &writer, const SpriteComponent &sprite);
+void decode_component(SnapshotReader &reader, SpriteComponent &sprite);
+void encode_component(SnapshotWriter &writer, const TextComponent &text);
+void decode_component(SnapshotReader &reader, TextComponent &text);
+void encode_component(SnapshotWriter &writer, const ScriptComponent &script);
+void decode_component(SnapshotReader &reader, ScriptComponent &script);
+
+// the whole state of a registry: entity ids, free ids, tags, groups and every component pool
+// signatures are rebuilt from the pools on restore, component ids depend on the order types were first used
+// so pools are stored under a name instead
+// a delta snapshot only holds what changed since a baseline captured from the same registry
+class Snapshot
+{
+private:
+    struct PoolCodec
+    {
+        std::string name;
+        int component_id;
+        // slots written after version since, 0 writes all of them
+        void (*write)(const IPool &pool, std::uint32_t since, SnapshotWriter &writer);
+        // null when malformed or holding ids past num_entities
+        std::shared_ptr<IPool> (*read)(SnapshotReader &reader, int num_entities, std::vector<int> &entity_ids);
+        // copy decoded components into the registry's pool
+        void (*merge)(Registry &registry, const IPool &changes, const std::vector<int> &entity_ids);
+    };
+
+    // an entity whose signature, tag or group changed since the baseline, or which was killed
+    struct EntityChange
+    {
+        int id;
+        bool alive;
+        std::string tag;
+        std::string group;
+        std::uint64_t pools; // bit i set when it has a component of codecs()[i]
+    };
+
+    std::vector<char> bytes;
+    std::vector<sol::function> functions;
+    bool delta{false};
+    std::uint32_t change_version{0}; // registry change version at capture
+    const Registry *source{nullptr};
+
+    static const std::vector<PoolCodec> &codecs();
+    template <typename TComponent>
+    static PoolCodec make_codec(const std::string &name);
+    template <typename TComponent>
+    static void write_pool(const IPool &pool, std::uint32_t since, SnapshotWriter &writer);
+    template <typename TComponent>
+    static std::shared_ptr<IPool> read_pool(SnapshotReader &reader, int num_entities, std::vector<int> &entity_ids);
+    template <typename TComponent>
+    static void merge_pool(Registry &registry, const IPool &changes, const std::vector<int> &entity_ids);
+
+    void begin_capture(Registry &registry);
+    bool restore_full(Registry &registry) const;
+    bool apply_delta(Registry &registry) const;
+
+public:
+    static constexpr std::uint32_t magic = 0x53443252; // "R2DS"
+    static constexpr std::uint32_t version = 3;
+
+    // entities queued for creation are captured, kills still pending in the registry are not applied
+    void capture(Registry &registry);
+    // components written and entities changed since baseline, restoring it on a registry that is in
+    // the baseline's state brings it to the current one. a baseline from another registry gives a full capture
+    void capture_delta(Registry &registry, const Snapshot &baseline);
+    // a full snapshot replaces everything in the registry and re-registers the entities with its systems,
+    // false and the registry untouched when the snapshot can't be decoded
+    bool restore(Registry &registry) const;
+
+    // scripts are written as string.dump bytecode, false when a function can't be dumped or the file written
+    bool save(const std::string &path, sol::state &lua) const;
+    bool load(const std::string &path, sol::state &lua);
+    // restoring afterwards gives the scripts that replaced the captured ones, see ScriptSystem::rebind
+    void rebind(const ScriptSystem::Rebinding &rebinding);
+
+    // cheap fingerprint of the simulation: which entities exist, what they have, where they are and their health
+    static std::uint64_t hash(const Registry &registry);
+
+    bool is_delta() const;
+    bool is_empty() const;
+    std::size_t get_size() const;
+    void clear();
+};
+
+#endif
@@ -3,14 +3,110 @@
 
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_ttf.h"
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
-class AssetStore
+class TextureAtlasBuilder;
+class AssetStore;
+
+enum class AssetType
+{
+    texture,
+    font
+};
+
+// keeps one asset referenced for as long as the handle (or a copy of it) lives
+class AssetHandle
+{
+private:
+    std::shared_ptr<AssetStore> asset_store;
+    AssetType type;
+    std::string name;
+
+public:
+    AssetHandle(std::shared_ptr<AssetStore> asset_store, AssetType type, const std::string &name);
+    AssetHandle(const AssetHandle &other);
+    AssetHandle(AssetHandle &&other) = default;
+    AssetHandle &operator=(AssetHandle other);
+    ~AssetHandle();
+
+    const std::string &get_name() const;
+};
+
+// the assets one level holds on to, released together when the scope is cleared or destroyed
+class AssetScope
 {
 private:
-    std::map<std::string, SDL_Texture *> textures;
-    std::map<std::string, TTF_Font *> fonts;
+    std::vector<AssetHandle> handles;
+
+public:
+    void add(AssetHandle handle);
+    void clear();
+    std::size_t size() const;
+};
+
+struct AssetStats
+{
+    std::string name;
+    AssetType type;
+    std::size_t bytes; // for atlas regions, the bytes of the region inside the shared page
+    int ref_count;
+    bool is_loaded;
+};
+
+class AssetStore : public std::enable_shared_from_this<AssetStore>
+{
+private:
+    // textures are addressable by a dense id, assigned once per name and never reused,
+    // so ids cached in sprites stay valid when the texture is unloaded and loaded again
+    struct TextureEntry
+    {
+        std::string name;
+        SDL_Texture *texture{nullptr};
+        SDL_Point offset{0, 0}; // top-left corner inside the atlas page, {0, 0} for standalone textures
+        int page{-1};           // index into atlas_pages, -1 for standalone textures
+        std::size_t bytes{0};
+        int ref_count{0};
+        std::uint64_t last_used{0};
+    };
+    struct FontEntry
+    {
+        TTF_Font *font{nullptr};
+        std::string data; // file contents the font reads from, when it was opened from memory
+        std::size_t bytes{0};
+        int ref_count{0};
+        std::uint64_t last_used{0};
+    };
+    // atlas pages are shared by many texture names and owned here
+    struct AtlasPage
+    {
+        SDL_Texture *texture{nullptr};
+        std::size_t bytes{0};
+        std::vector<int> texture_ids;
+    };
+
+    std::map<std::string, int> texture_ids;
+    std::vector<TextureEntry> textures;
+    std::vector<AtlasPage> atlas_pages;
+    std::map<std::string, FontEntry> fonts;
+
+    std::size_t texture_bytes{0};
+    std::size_t font_bytes{0};
+    // 0 means unlimited, unreferenced assets are then only freed by unload_unreferenced
+    std::size_t texture_budget{0};
+    std::size_t font_budget{0};
+    std::uint64_t clock{0};
+
+    void set_texture(const std::string &name, SDL_Texture *texture, SDL_Point offset, int page, std::size_t bytes);
+    void unload_texture(int texture_id);
+    void unload_page(int page);
+    void unload_font(FontEntry &font);
+    bool is_page_referenced(int page) const;
+    std::uint64_t page_last_used(int page) const;
+    void enforce_budget();
 
 public:
     AssetStore() = default;
@@ -18,10 +114,42 @@ public:
     void clear_assets();
 
     void add_texture(SDL_Renderer *renderer, const std::string &name, const std::string &file_path);
+    // upload an already decoded surface, the store frees it
+    void add_texture(SDL_Renderer *renderer, const std::string &name, SDL_Surface *surface);
     SDL_Texture *get_texture(const std::string &name);
+    int get_texture_id(const std::string &name);
+    SDL_Texture *get_texture(int texture_id) const;
+    const SDL_Point &get_texture_offset(int texture_id) const;
+    // the same for every id drawn from the same SDL texture: the atlas page, or a number past the pages
+    int get_texture_batch(int texture_id) const;
+    bool has_texture(const std::string &name) const;
+
+    // upload packed pages and register every packed name as a region of its page
+    void add_texture_atlas(SDL_Renderer *renderer, const TextureAtlasBuilder &atlas);
 
     void add_font(SDL_Renderer *renderer, const std::string &name, const std::string &file_path, int size);
+    // take ownership of an already opened font, bytes is its estimated memory footprint
+    void add_font(const std::string &name, TTF_Font *font, std::size_t bytes = 0);
+    // open a font from the contents of its file, which are kept as long as the font is loaded
+    void add_font(const std::string &name, std::string data, int size);
     TTF_Font *get_font(const std::string &name);
+    bool has_font(const std::string &name) const;
+
+    // reference counting, usually through AssetHandle rather than directly
+    AssetHandle acquire(AssetType type, const std::string &name);
+    void retain(AssetType type, const std::string &name);
+    void release(AssetType type, const std::string &name);
+
+    // least recently used unreferenced assets are evicted while usage is over budget
+    void set_memory_budget(std::size_t texture_budget, std::size_t font_budget);
+    // free every texture and font nobody holds a reference to
+    void unload_unreferenced();
+    // after scopes were released: without a budget unload right away, with one keep them cached until evicted
+    void collect_unreferenced();
+
+    std::vector<AssetStats> get_stats() const;
+    std::size_t get_texture_bytes() const;
+    std::size_t get_font_bytes() const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "SDL2/SDL.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// where a packed texture ended up: page index and pixel rectangle inside that page
+struct AtlasRegion
+{
+    int page;
+    SDL_Rect rect;
+};
+
+// packs many small images into a few large surfaces (shelf packing, tallest images first)
+class TextureAtlasBuilder
+{
+private:
+    struct Source
+    {
+        std::string name;
+        std::string file_path;
+        SDL_Surface *surface;
+    };
+
+    int max_size;
+    int padding;
+    std::vector<Source> sources;
+    std::vector<SDL_Surface *> pages;
+    std::map<std::string, AtlasRegion> regions;
+    std::map<std::string, std::string> oversized; // too large for a page, loaded as standalone textures
+
+    std::string cache_signature() const;
+    void free_pages();
+
+public:
+    TextureAtlasBuilder(int max_size = 2048, int padding = 1);
+    ~TextureAtlasBuilder();
+
+    void add(const std::string &name, const std::string &file_path);
+    bool empty() const;
+
+    std::size_t size() const;
+    const std::string &get_name(int index) const;
+
+    // decode every image and pack them into pages
+    void build();
+    // the two halves of build: decode can run concurrently for distinct indices, pack runs once all are decoded
+    void decode(int index);
+    void pack();
+
+    // restore pages and regions from a previous save_cache, false when missing or stale
+    bool load_cache(const std::string &cache_dir);
+    void save_cache(const std::string &cache_dir) const;
+
+    const std::vector<SDL_Surface *> &get_pages() const;
+    const std::map<std::string, AtlasRegion> &get_regions() const;
+    const std::map<std::string, std::string> &get_oversized() const;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// hashed timer wheel over game time in ms: a timer sits in the slot its due time falls in, modulo the wheel.
+// advancing only visits the slots time passed over, so sleeping timers cost nothing until their slot comes
+// up, and timers further out than one turn of the wheel are looked at once per turn
+class TimerWheel
+{
+public:
+    struct Timer
+    {
+        std::uint32_t due;
+        int id;
+        std::uint32_t generation; // lets the owner recognise timers of something it already dropped
+    };
+
+private:
+    std::uint32_t slot_ms;
+    std::vector<std::vector<Timer>> slots;
+    std::uint32_t now{0};
+    bool started{false};
+    std::size_t count{0};
+
+    std::size_t slot_of(std::uint32_t time) const;
+
+public:
+    TimerWheel(std::uint32_t slot_ms = 16, std::size_t slot_count = 256);
+
+    // a due time already passed fires on the next advance
+    void schedule(std::uint32_t due, int id, std::uint32_t generation);
+    // moves the wheel to time and appends every timer due by then to expired, in slot order
+    void advance(std::uint32_t time, std::vector<Timer> &expired);
+    void clear();
+    std::size_t size() const;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef WORLD_STREAMER_H
+#define WORLD_STREAMER_H
+
+#include "ECS.hpp"
+#include "Prefab.hpp"
+#include <mutex>
+#include <vector>
+
+class AssetLoader;
+
+// keeps only the map chunks near the camera alive as entities: tiles and static scenery of a chunk are
+// created once it comes within residency_radius chunks of the view and killed again when it moves further away
+class WorldStreamer
+{
+private:
+    // what a chunk is built from, shared with the workers preparing chunks
+    struct TileSource
+    {
+        std::string texture;
+        int rows;
+        int cols;
+        int chunk_size;
+        int chunk_cols;
+        std::vector<std::uint8_t> tiles;
+    };
+
+    // tile components of one chunk, built off the main thread
+    struct PreparedChunk
+    {
+        int index;
+        int generation;
+        std::vector<TransformComponent> transforms;
+        std::vector<SpriteComponent> sprites;
+    };
+
+    struct Chunk
+    {
+        bool resident{false};
+        bool requested{false};
+        std::vector<Entity> entities;
+        std::vector<int> scenery; // indices into WorldStreamer::scenery
+    };
+
+    // filled by the workers, drained by update()
+    struct ReadyQueue
+    {
+        std::mutex mutex;
+        std::vector<PreparedChunk> chunks;
+    };
+
+    std::shared_ptr<Registry> registry;
+    std::shared_ptr<AssetLoader> asset_loader;
+    int chunk_size;
+    int residency_radius;
+    int max_commits_per_frame;
+    bool synchronous{false};
+
+    std::shared_ptr<const TileSource> source;
+    int generation{0}; // bumped on every new tilemap so chunks prepared for an older one are dropped
+    int chunk_rows{0};
+    int chunk_cols{0};
+    std::vector<Chunk> chunks;
+    std::vector<int> resident_chunks;
+    std::vector<Prefab> scenery;
+    std::shared_ptr<ReadyQueue> ready;
+
+    static PreparedChunk prepare(const TileSource &source, int index, int generation);
+    float chunk_world_size() const;
+    void commit(PreparedChunk &prepared);
+    void evict(int index);
+
+public:
+    WorldStreamer(std::shared_ptr<Registry> registry, std::shared_ptr<AssetLoader> asset_loader,
+                  int chunk_size = 16, int residency_radius = 1, int max_commits_per_frame = 2);
+
+    // replaces the streamed world, every resident chunk of the previous one is killed
+    void set_tilemap(const std::string &texture, int rows, int cols, const std::vector<std::uint8_t> &tiles);
+    // ungrouped entities made of a transform, a sprite and optionally an animation can be streamed with their chunk
+    static bool can_stream(const Prefab &bundle);
+    void add_scenery(const Prefab &bundle);
+    void clear();
+    // call after the registry was restored from a snapshot, chunks are streamed again from scratch
+    void resync();
+
+    // chunks in view are built right away, the ring around them is prepared in the background
+    void update(const SDL_Rect &camera);
+    // build every chunk on the calling thread as soon as it is in range, entities are then created in the
+    // same order on every run, which recordings and replays rely on
+    void set_synchronous(bool synchronous);
+
+    int get_resident_chunk_count() const;
+    int get_chunk_count() const;
+};
+
+#endif
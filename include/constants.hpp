@@ -14,12 +14,10 @@ namespace constants
     inline constexpr int MAX_COMPONENTS{32};
     inline constexpr int tile_size{32};
     inline constexpr double tile_scale{2};
-    inline constexpr int map_rows{20};
-    inline constexpr int map_cols{25};
-    inline constexpr double map_width{map_cols * tile_size * tile_scale};
-    inline constexpr double map_height{map_rows * tile_size * tile_scale};
     inline constexpr int healthbar_width{15};
     inline constexpr int healthbar_height{3};
+    inline constexpr int spatial_cell_size{256}; // world pixels per spatial index cell
+    inline constexpr int culling_padding{50};    // extra world pixels kept around the camera
 
     using Signature = std::bitset<MAX_COMPONENTS>;
 
@@ -3,6 +3,16 @@
 
 #include "ECS.hpp"
 #include "Store.hpp"
+#include "AssetLoader.hpp"
+#include "Prefab.hpp"
+#include "WorldStreamer.hpp"
+#include "Snapshot.hpp"
+#include "InputRecording.hpp"
+#include "RewindBuffer.hpp"
+#include "Replication.hpp"
+#include "LuaArena.hpp"
+#include "LevelLoader.hpp"
+#include "FileWatcher.hpp"
 #include "constants.hpp"
 #include <SDL2/SDL.h>
 #include <sol/sol.hpp>
@@ -12,14 +22,38 @@ class Game
 private:
     bool running{false};
     std::uint64_t cum_ticks{0};
-    SDL_Window *window;
-    SDL_Renderer *renderer;
+    SDL_Window *window{nullptr};
+    SDL_Renderer *renderer{nullptr};
     std::shared_ptr<Registry> registry;
     std::shared_ptr<AssetStore> asset_store;
+    std::shared_ptr<AssetLoader> asset_loader;
+    AssetScope level_assets;
     std::shared_ptr<EventBus> event_bus;
+    std::shared_ptr<PrefabRegistry> prefabs;
+    std::shared_ptr<WorldStreamer> world_streamer; // null when world_streaming is off
+    Snapshot level_start; // taken once the level is loaded, restored by restart_level()
+    Snapshot autosave_base; // autosaves only write what changed since this one
+    int autosave_interval{0}; // milliseconds, 0 when off
+    std::uint32_t last_autosave{0};
+    InputRecording recording; // the session so far when record_input, the session to play when replaying
+    bool record_input{false};
+    bool replaying{false};
+    bool headless{false}; // no window or renderer: replays, servers and bot clients
+    std::uint32_t current_tick{0};
+    std::shared_ptr<RewindBuffer> rewind_buffer; // null when rewind is off
+    std::vector<InputRecording::Input> recent_inputs; // inputs of the ticks still in the rewind buffer
+    bool rollback_check_requested{false};              // F4, run after the current tick
+    std::shared_ptr<ReplicationServer> server; // set while serving
+    std::shared_ptr<ReplicationClient> client; // set while joined to a server, the registry only holds mirrors
+    std::shared_ptr<FileWatcher> script_watcher; // null when hot_reload is off
+    int level{0};
+    std::vector<LevelScript> level_scripts;  // the loaded level's functions, matched against a changed level script
+    std::vector<LevelScript> prefab_scripts; // the same for prefabs.lua
     SDL_Rect camera;
+    vec2 map_size{constants::window_width, constants::window_height}; // replaced by the tilemap size on load
     bool debug{false};
     bool show_gui{false};
+    LuaArena lua_arena; // small lua objects come from here when lua_gc.arena is set, declared first so it outlives the state
     sol::state lua;
     sol::table config;
 
@@ -27,13 +61,48 @@ public:
     Game();
 
     void init();
+    bool create_window();
     void setup();
-    void load_level(int level);
+    // the settings that can change while the game runs, again whenever config.lua is reloaded
+    void apply_config();
+    // with hot_reload, runs the scripts saved since the last frame again, see LevelLoader::reload_scripts
+    void reload_changed_scripts();
+    void reload_config();
+    void load_level(int level, bool with_entities = true);
+    void restart_level();
+    std::string snapshot_path(const std::string &name) const;
+    void save_snapshot(const std::string &name);
+    void load_snapshot(const std::string &name);
+    void restore_snapshot(const Snapshot &snapshot);
+    void autosave();
+    // F6: starts timing scripts, or writes what was timed to script_profiler.file and stops
+    void toggle_script_profiling();
+    // entity_id limits the input to one controlled entity, a client's player when serving
+    void emit_input(InputRecording::InputType type, std::int32_t code, std::int32_t entity_id = -1);
+    void stop_recording(const std::string &reason);
+    void save_recording();
+    // plays a recording back as fast as possible, false on the first tick whose state differs from the recorded one
+    bool replay(const std::string &path);
+    // times the level1 enemy script over count entities through the sol2 bindings and, with luajit, the ffi
+    bool bench_scripts(int count);
+    // runs the simulation headless for clients on localhost, seconds 0 serves until the process is stopped
+    bool serve(int seconds);
+    // shows what the server sends, a headless client wanders the map on its own
+    bool join(bool headless_client);
     void run();
     void destroy();
     void process_input();
     void render();
+    void render_loading_screen();
     void update();
+    // one step of the simulation with the clock fixed at time
+    void tick(std::uint32_t time, float dt);
+    // back to the end of an earlier tick, the game carries on from there
+    bool rewind(std::uint32_t tick);
+    // back to the end of an earlier tick and run every tick since again with the inputs known now
+    bool rollback(std::uint32_t tick);
+    // rolls back about a second and logs whether the re-simulation ends in the same state
+    void check_rollback();
 };
 
 #endif
\ No newline at end of file
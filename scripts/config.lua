@@ -2,8 +2,87 @@ config = {
     title = "Real2D Game",
     full_screen = false,
     level = 2,
+    -- keep simulating while level assets load in the background
+    async_loading = true,
     resolution = {
         width = 1200,
         height = 800
+    },
+    -- unreferenced textures and fonts are kept cached up to these sizes, least recently used go first
+    -- asset_budget = {
+    --     texture_mb = 256,
+    --     font_mb = 16
+    -- },
+    texture_atlas = {
+        enabled = true,
+        max_size = 2048,
+        -- packed pages are written here and reused while the source images are unchanged
+        cache_dir = "./assets/cache"
+    },
+    -- levels are compiled to binary files here and loaded from them while the lua and map files are unchanged,
+    -- globals the level script sets (like the day or night tilemap) are kept as they were when compiled
+    compiled_levels = {
+        enabled = true,
+        dir = "./assets/cache"
+    },
+    -- only the map chunks within residency_radius chunks of the camera are kept as entities,
+    -- tiles and untagged static scenery are created and destroyed as the camera moves
+    world_streaming = {
+        enabled = true,
+        chunk_size = 16,
+        residency_radius = 1
+    },
+    -- F2 restarts the level, F5 / F9 quick save and load, a crash leaves crash.snap behind
+    -- autosave.snap is rewritten rarely, autosave-delta.snap every autosave_interval ms with what changed since
+    snapshots = {
+        dir = "./saves",
+        autosave_interval = 1000
+        -- restore_on_start = "crash"
+    },
+    -- the last ticks of the world are kept in memory, F3 rewinds about a second,
+    -- F4 re-simulates it and logs whether the world comes out the same
+    rewind = {
+        enabled = true,
+        ticks = 180
+    },
+    -- every session's input is written to file on exit, run with --replay <file> to play it back
+    -- headless and check each tick against the recorded state. restoring a snapshot stops the recording
+    replay = {
+        record = true,
+        file = "./saves/last.replay"
+    },
+    -- lua's collector only runs after each frame's simulation, for at most budget_ms, 0 leaves it to lua.
+    -- the pauses show in the F1 overlay
+    -- arena serves small lua objects from pooled slabs instead of malloc, read once at start
+    lua_gc = {
+        budget_ms = 1.0,
+        arena = false
+    },
+    -- config.lua, prefabs.lua and the level script run again when saved, entities and prefabs switch to the
+    -- new script functions found by tag, prefab name or place in level.entities. textures stay loaded;
+    -- the level, window and systems are set up from the old config until the next start
+    hot_reload = {
+        enabled = true
+    },
+    -- scripts declared with sandboxed = true run in this many extra lua states, each on a thread of its own
+    -- when there are several, 0 is one per core. they get the entity's id and only write to it, see ScriptWorkers
+    script_workers = {
+        states = 4
+    },
+    -- F6 times every script function, shown in the F1 overlay and written to file when F6 stops it
+    script_profiler = {
+        enabled = false,
+        file = "./saves/scripts.profile"
+    },
+    -- queued events wait in lock-free queues any thread can fill and are handled after input, collisions
+    -- and scripts each tick instead of the moment they are raised
+    events = {
+        queued = false
+    },
+    -- --server runs the simulation for --client processes on localhost, a side that hears nothing
+    -- for timeout ms drops the other. every client flies its own copy of the level's player
+    network = {
+        port = 7777,
+        timeout = 2000
     }
 }
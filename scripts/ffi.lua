@@ -0,0 +1,85 @@
+-- luajit builds only: loaded by the script system to read and write component pools in place,
+-- the structs and pool numbers have to match ECS.hpp and ScriptSystem.cpp
+-- scripts pass entity:id() once and use the ffi_ functions instead of get_position, set_velocity...
+local ffi = require("ffi")
+
+ffi.cdef [[
+typedef struct { float x, y; } vec2;
+typedef struct { vec2 position; vec2 scale; double rotation; } TransformComponent;
+typedef struct { vec2 velocity; } RigidBodyComponent;
+typedef struct { vec2 velocity; int freq; int duration; bool is_friendly; int damage; int last_emission_time; } ProjectileEmitterComponent;
+typedef struct { void *data; const int *index; int index_size; } PoolView;
+]]
+
+local registry = ffi_bindings.registry
+local pool_view = ffi.cast("const PoolView *(*)(void *, int)", ffi_bindings.pool_view)
+local touch = ffi.cast("void (*)(void *, int, int)", ffi_bindings.touch)
+
+local transforms, rigid_bodies, projectile_emitters = 0, 1, 2
+local transform_ptr = ffi.typeof("TransformComponent *")
+local rigid_body_ptr = ffi.typeof("RigidBodyComponent *")
+local projectile_emitter_ptr = ffi.typeof("ProjectileEmitterComponent *")
+
+-- the entity's component, nil when it has none. the view is fetched on every call since pools move when they grow
+local function component(pool, ptr_type, id)
+    local view = pool_view(registry, pool)
+    if id >= view.index_size then
+        return nil
+    end
+    local index = view.index[id]
+    if index < 0 then
+        return nil
+    end
+    return ffi.cast(ptr_type, view.data) + index
+end
+
+function ffi_get_position(id)
+    local transform = component(transforms, transform_ptr, id)
+    if transform == nil then
+        return 0, 0
+    end
+    return transform.position.x, transform.position.y
+end
+
+function ffi_set_position(id, x, y)
+    local transform = component(transforms, transform_ptr, id)
+    if transform ~= nil then
+        transform.position.x = x
+        transform.position.y = y
+        touch(registry, transforms, id)
+    end
+end
+
+function ffi_set_rotation(id, angle)
+    local transform = component(transforms, transform_ptr, id)
+    if transform ~= nil then
+        transform.rotation = angle
+        touch(registry, transforms, id)
+    end
+end
+
+function ffi_get_velocity(id)
+    local rigid_body = component(rigid_bodies, rigid_body_ptr, id)
+    if rigid_body == nil then
+        return 0, 0
+    end
+    return rigid_body.velocity.x, rigid_body.velocity.y
+end
+
+function ffi_set_velocity(id, x, y)
+    local rigid_body = component(rigid_bodies, rigid_body_ptr, id)
+    if rigid_body ~= nil then
+        rigid_body.velocity.x = x
+        rigid_body.velocity.y = y
+        touch(registry, rigid_bodies, id)
+    end
+end
+
+function ffi_set_projectile_velocity(id, x, y)
+    local emitter = component(projectile_emitters, projectile_emitter_ptr, id)
+    if emitter ~= nil then
+        emitter.velocity.x = x
+        emitter.velocity.y = y
+        touch(registry, projectile_emitters, id)
+    end
+end
@@ -1,13 +1,15 @@
--- Load a different tilemap image depending on the current system time
-local current_system_hour = os.date("*t").hour
--- Use a day-map or night-map texture (9am - 6pm)
-if current_system_hour >= 9 and current_system_hour < 18 then
-    map_texture_asset_id = "tilemap-texture-day"
-else
-    map_texture_asset_id = "tilemap-texture-night"
-end
-
 level = {
+    -- runs on every load, also from the compiled level, and replaces the fields it returns
+    prelude = function()
+        -- Load a different tilemap image depending on the current system time
+        local current_system_hour = os.date("*t").hour
+        -- Use a day-map or night-map texture (9am - 6pm)
+        if current_system_hour >= 9 and current_system_hour < 18 then
+            return { tilemap = { texture_asset_id = "tilemap-texture-day" } }
+        end
+        return { tilemap = { texture_asset_id = "tilemap-texture-night" } }
+    end,
+
     assets = {{
         type = "texture",
         id = "tilemap-texture-day",
@@ -306,7 +308,7 @@ level = {
 
     tilemap = {
         map_file = "./assets/tilemaps/jungle.map",
-        texture_asset_id = map_texture_asset_id
+        texture_asset_id = "tilemap-texture-day"
     },
     entities = {{
         tag = "player",
@@ -2573,44 +2575,24 @@ level = {
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 669,
                     y = 549
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 685,
                     y = 549
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
@@ -2636,23 +2618,13 @@ level = {
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 330,
                     y = 507
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
@@ -2678,170 +2650,90 @@ level = {
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 449,
                     y = 408
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 431,
                     y = 416
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 940,
                     y = 695
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 955,
                     y = 705
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1085,
                     y = 507
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1075,
                     y = 527
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1075,
                     y = 547
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1085,
                     y = 567
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
@@ -2888,107 +2780,57 @@ level = {
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1435,
                     y = 195
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1425,
                     y = 215
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1425,
                     y = 235
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1425,
                     y = 255
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacles
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1435,
                     y = 275
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
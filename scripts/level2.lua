@@ -2192,611 +2192,321 @@ level = {
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 400,
                     y = 500
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1350,
                     y = 400
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1920,
                     y = 1700
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 920,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 940,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 960,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 980,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1000,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1020,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 800
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 920,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 940,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 960,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 980,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1000,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1020,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 710
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 725
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 740
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 755
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 770
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 900,
                     y = 785
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 725
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 740
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 755
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 770
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
         -- Obstacle
+        prefab = "obstacle",
         components = {
             transform = {
                 position = {
                     x = 1040,
                     y = 785
-                },
-                scale = {
-                    x = 1.0,
-                    y = 1.0
-                },
-                rotation = 0.0 -- degrees
-            },
-            sprite = {
-                texture_asset_id = "obstacles7-texture",
-                width = 16,
-                height = 16,
-                z_index = 2
+                }
             }
         }
     }, {
@@ -0,0 +1,82 @@
+-- component bundles compiled once at startup and stamped out by name,
+-- level entities use them with prefab = "name" and only list the components they change
+prefabs = {
+    projectile = {
+        group = "projectiles",
+        components = {
+            transform = {
+                position = {
+                    x = 0,
+                    y = 0
+                }
+            },
+            rigid_body = {
+                velocity = {
+                    x = 0,
+                    y = 0
+                }
+            },
+            sprite = {
+                texture_asset_id = "bullet-texture",
+                width = 4,
+                height = 4,
+                z_index = 1
+            },
+            box_collider = {
+                width = 4,
+                height = 4
+            },
+            projectile = {
+                duration = 5,
+                friendly = true,
+                damage = 20
+            }
+        }
+    },
+    enemy = {
+        group = "enemies",
+        components = {
+            transform = {
+                position = {
+                    x = 0,
+                    y = 0
+                }
+            },
+            rigid_body = {
+                velocity = {
+                    x = 0,
+                    y = 0
+                }
+            },
+            sprite = {
+                texture_asset_id = "tank-panther-right-texture",
+                width = 32,
+                height = 32,
+                z_index = 3
+            },
+            box_collider = {
+                width = 32,
+                height = 32
+            },
+            health = {
+                health_percentage = 100
+            }
+        }
+    },
+    obstacle = {
+        components = {
+            transform = {
+                position = {
+                    x = 0,
+                    y = 0
+                }
+            },
+            sprite = {
+                texture_asset_id = "obstacles7-texture",
+                width = 16,
+                height = 16,
+                z_index = 2
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+-- the level1 fighter jet script twice for --script-bench: through the sol2 bindings and, in luajit builds,
+-- through the ffi functions of ffi.lua. both do the same work on the same components.
+-- components does it through the component usertypes. bindings and crowd run in the main state and
+-- sandboxed in the script_workers states
+map_height = 2000
+
+script_bench = {
+    bindings = function(entity, delta_time, ellapsed_time)
+        local map_height = map_height
+        local current_position_x, current_position_y = get_position(entity)
+        local current_velocity_x, current_velocity_y = get_velocity(entity)
+
+        if current_position_y < 10 or current_position_y > map_height - 32 then
+            set_velocity(entity, 0, current_velocity_y * -1)
+        else
+            set_velocity(entity, 0, current_velocity_y)
+        end
+
+        if (current_velocity_y < 0) then
+            set_rotation(entity, 0)
+            set_projectile_velocity(entity, 0, -200)
+        else
+            set_rotation(entity, 180)
+            set_projectile_velocity(entity, 0, 200)
+        end
+    end,
+
+    -- the same through component references, fields are read and written in place
+    components = function(entity, delta_time, ellapsed_time)
+        local map_height = map_height
+        local transform = entity:transform()
+        local velocity = entity:rigid_body().velocity
+        local emitter_velocity = entity:projectile_emitter().velocity
+        local y = transform.position.y
+
+        if y < 10 or y > map_height - 32 then
+            velocity.y = -velocity.y
+        end
+        velocity.x = 0
+
+        emitter_velocity.x = 0
+        if velocity.y < 0 then
+            transform.rotation = 0
+            emitter_velocity.y = -200
+        else
+            transform.rotation = 180
+            emitter_velocity.y = 200
+        end
+    end,
+
+    -- steering that computes much more than it writes, like crowd ai: picks the best of 16 headings
+    crowd = function(entity, delta_time, ellapsed_time)
+        local x, y = get_position(entity)
+        local target_x, target_y = 2000 + math.sin(ellapsed_time * 0.001) * 1000, 1000
+        local best_x, best_y, best = 0, 0, math.huge
+        for i = 0, 15 do
+            local angle = i * math.pi / 8
+            local dx, dy = math.cos(angle), math.sin(angle)
+            local distance = (x + dx * 50 - target_x) ^ 2 + (y + dy * 50 - target_y) ^ 2
+            if distance < best then
+                best_x, best_y, best = dx, dy, distance
+            end
+        end
+        set_velocity(entity, best_x * 50, best_y * 50)
+        set_rotation(entity, math.deg(math.atan(best_y / best_x)))
+    end,
+
+    ffi = function(entity, delta_time, ellapsed_time)
+        local map_height = map_height
+        local id = entity:id()
+        local current_position_x, current_position_y = ffi_get_position(id)
+        local current_velocity_x, current_velocity_y = ffi_get_velocity(id)
+
+        if current_position_y < 10 or current_position_y > map_height - 32 then
+            ffi_set_velocity(id, 0, current_velocity_y * -1)
+        else
+            ffi_set_velocity(id, 0, current_velocity_y)
+        end
+
+        if (current_velocity_y < 0) then
+            ffi_set_rotation(id, 0)
+            ffi_set_projectile_velocity(id, 0, -200)
+        else
+            ffi_set_rotation(id, 180)
+            ffi_set_projectile_velocity(id, 0, 200)
+        end
+    end
+}
@@ -9,5 +9,5 @@ AnimationComponent::AnimationComponent(int num_frames, int normal_frame_rate, bo
     this->frame_rate = normal_frame_rate;
     this->sprint_frame_rate = normal_frame_rate * 2;
     this->should_loop = should_loop;
-    this->start_time = SDL_GetTicks();
+    this->start_time = Clock::now();
 }
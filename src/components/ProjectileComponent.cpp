@@ -6,5 +6,5 @@ ProjectileComponent::ProjectileComponent(
     this->duration = duration;
     this->is_friendly = is_friendly;
     this->damage = damage;
-    this->start_time = SDL_GetTicks();
+    this->start_time = Clock::now();
 };
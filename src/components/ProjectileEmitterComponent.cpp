@@ -7,5 +7,5 @@ ProjectileEmitterComponent::ProjectileEmitterComponent(vec2 velocity, int freq,
     this->duration = duration;
     this->is_friendly = is_friendly;
     this->damage = damage;
-    this->last_emission_time = SDL_GetTicks();
+    this->last_emission_time = Clock::now();
 }
\ No newline at end of file
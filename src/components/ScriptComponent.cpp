@@ -1,6 +1,8 @@
 #include "ECS.hpp"
 
-ScriptComponent::ScriptComponent(sol::function fun)
+ScriptComponent::ScriptComponent(sol::function fun, bool is_coroutine, bool is_sandboxed)
 {
     this->fun = fun;
+    this->is_coroutine = is_coroutine;
+    this->is_sandboxed = is_sandboxed;
 }
\ No newline at end of file
@@ -6,5 +6,5 @@ SprintComponent::SprintComponent(bool in_sprint, float sprint_speed, int sprint_
     this->sprint_speed = sprint_speed;
     this->sprint_duration = sprint_duration;
     this->sprint_cooldown = sprint_cooldown;
-    this->last_sprint_time = SDL_GetTicks() - sprint_cooldown - sprint_duration;
+    this->last_sprint_time = Clock::now() - sprint_cooldown - sprint_duration;
 }
\ No newline at end of file
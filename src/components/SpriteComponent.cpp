@@ -10,4 +10,5 @@ SpriteComponent::SpriteComponent(std::string asset_name, int width, int height,
     this->is_fixed = is_fixed;
     this->flip = SDL_FLIP_NONE;
     this->src_rect = {src_rect_x, src_rect_y, width, height};
+    this->texture_id = -1;
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#include "ECS.hpp"
+
+std::uint32_t Clock::ticks = 0;
+
+std::uint32_t Clock::now()
+{
+    return ticks;
+}
+
+void Clock::set(std::uint32_t ticks)
+{
+    Clock::ticks = ticks;
+}
@@ -0,0 +1,86 @@
+#include "Prefab.hpp"
+
+void restart_timers(SprintComponent &component)
+{
+    component.last_sprint_time = Clock::now() - component.sprint_cooldown - component.sprint_duration;
+}
+
+void restart_timers(AnimationComponent &component)
+{
+    component.start_time = Clock::now();
+}
+
+void restart_timers(ProjectileEmitterComponent &component)
+{
+    component.last_emission_time = Clock::now();
+}
+
+void restart_timers(ProjectileComponent &component)
+{
+    component.start_time = Clock::now();
+}
+
+// ============================================================
+// Prefab
+// ============================================================
+void Prefab::set_group(const std::string &group)
+{
+    this->group = group;
+}
+
+const std::string &Prefab::get_group() const
+{
+    return group;
+}
+
+const Signature &Prefab::get_signature() const
+{
+    return signature;
+}
+
+void Prefab::stamp(Entity &entity) const
+{
+    for (const auto &pair : components)
+    {
+        pair.second->add_to(entity);
+    }
+}
+
+Entity Prefab::instantiate(Registry &registry) const
+{
+    Entity entity = registry.create_entity();
+    if (!group.empty())
+    {
+        entity.group(group);
+    }
+    stamp(entity);
+    return entity;
+}
+
+// ============================================================
+// PrefabRegistry
+// ============================================================
+void PrefabRegistry::add(const std::string &name, const Prefab &prefab)
+{
+    prefabs[name] = prefab;
+}
+
+bool PrefabRegistry::has(const std::string &name) const
+{
+    return prefabs.find(name) != prefabs.end();
+}
+
+const Prefab &PrefabRegistry::get(const std::string &name) const
+{
+    auto it = prefabs.find(name);
+    if (it == prefabs.end())
+    {
+        throw std::runtime_error("Prefab not found: " + name);
+    }
+    return it->second;
+}
+
+Entity PrefabRegistry::instantiate(Registry &registry, const std::string &name) const
+{
+    return get(name).instantiate(registry);
+}
@@ -10,7 +10,7 @@ Entity Registry::create_entity()
     if (free_ids.empty())
     {
         id = num_entities++;
-        if (id > entity_component_signatures.size())
+        if (id >= entity_component_signatures.size())
         {
             entity_component_signatures.resize(id + 1);
         }
@@ -23,13 +23,69 @@ Entity Registry::create_entity()
 
     auto entity{Entity{id, this}};
     entities_to_add.insert(entity);
+    touch_entity(id);
 
     return entity;
 }
 
+std::vector<Entity> Registry::reserve_entities(int count)
+{
+    std::vector<Entity> batch;
+    batch.reserve(count);
+    while (!free_ids.empty() && batch.size() < count)
+    {
+        batch.push_back(Entity{free_ids.front(), this});
+        free_ids.pop_front();
+    }
+
+    // the rest is one contiguous block of new ids
+    int first_id = num_entities;
+    num_entities += count - batch.size();
+    if (num_entities > entity_component_signatures.size())
+    {
+        entity_component_signatures.resize(num_entities);
+    }
+    for (int id = first_id; id < num_entities; id++)
+    {
+        batch.push_back(Entity{id, this});
+    }
+    for (const auto &entity : batch)
+    {
+        touch_entity(entity.id());
+    }
+    return batch;
+}
+
+void Registry::touch_entity(int entity_id)
+{
+    if (entity_id >= entity_versions.size())
+    {
+        entity_versions.resize(std::max<std::size_t>(entity_id + 1, entity_versions.size() * 2));
+    }
+    if (tracked_components.any() && entity_versions[entity_id] != change_version)
+    {
+        changed_entities.push_back(entity_id);
+    }
+    entity_versions[entity_id] = change_version;
+    structure_revision++;
+}
+
 void Registry::kill_entity(Entity entity)
 {
     entities_to_kill.insert(entity);
+    structure_revision++;
+}
+
+const Signature &Registry::get_component_signature(Entity entity) const
+{
+    return entity_component_signatures.at(entity.id());
+}
+
+void Registry::take_changed_entities(std::vector<int> &entity_ids)
+{
+    entity_ids.clear();
+    std::swap(entity_ids, changed_entities);
+    change_version++;
 }
 
 // ============================================================
@@ -40,6 +96,8 @@ void Registry::tag(Entity entity, const std::string &tag)
 
     tag_per_entity.emplace(entity.id(), tag);
     entity_per_tag.emplace(tag, entity);
+    touch_entity(entity.id());
+    label_revision++;
 }
 
 bool Registry::has_tag(Entity entity, const std::string &tag) const
@@ -62,6 +120,11 @@ Entity Registry::get_entity_by_tag(const std::string &tag) const
     return entity_per_tag.at(tag);
 }
 
+bool Registry::has_entity_with_tag(const std::string &tag) const
+{
+    return entity_per_tag.count(tag) > 0;
+}
+
 void Registry::remove_entity_tag(Entity entity)
 {
     auto it = tag_per_entity.find(entity.id());
@@ -70,6 +133,8 @@ void Registry::remove_entity_tag(Entity entity)
         auto tag = it->second;
         entity_per_tag.erase(tag);
         tag_per_entity.erase(it);
+        touch_entity(entity.id());
+        label_revision++;
     }
 }
 
@@ -83,6 +148,8 @@ void Registry::group(Entity entity, const std::string &group)
 
     entities_per_group[group].emplace(entity);
     group_per_entity.emplace(entity.id(), group);
+    touch_entity(entity.id());
+    label_revision++;
 }
 
 bool Registry::belongs_to_group(Entity entity, const std::string &group) const
@@ -98,8 +165,12 @@ bool Registry::belongs_to_group(Entity entity, const std::string &group) const
 
 std::vector<Entity> Registry::get_entities_by_group(const std::string &group) const
 {
-    auto &entities = entities_per_group.at(group);
-    return std::vector<Entity>(entities.begin(), entities.end());
+    auto it = entities_per_group.find(group);
+    if (it == entities_per_group.end())
+    {
+        return {};
+    }
+    return std::vector<Entity>(it->second.begin(), it->second.end());
 }
 
 void Registry::remove_entity_group(Entity entity)
@@ -114,6 +185,8 @@ void Registry::remove_entity_group(Entity entity)
             group->second.erase(it);
         }
         group_per_entity.erase(it);
+        touch_entity(entity.id());
+        label_revision++;
     }
 }
 
@@ -122,6 +195,7 @@ void Registry::remove_entity_group(Entity entity)
 // ============================================================
 void Registry::add_entity_to_systems(Entity entity)
 {
+    structure_revision++;
     const auto entity_id = entity.id();
     const auto &entity_component_signature = entity_component_signatures[entity_id];
     for (const auto &system_pair : systems)
@@ -137,8 +211,32 @@ void Registry::add_entity_to_systems(Entity entity)
     }
 }
 
+// each system gets the matching part of a batch in one call
+void Registry::add_batch_to_systems(const std::vector<Entity> &batch)
+{
+    structure_revision++;
+    std::vector<Entity> matching;
+    for (const auto &system_pair : systems)
+    {
+        const auto &system_component_signature = system_pair.second->get_component_signature();
+        matching.clear();
+        for (const auto &entity : batch)
+        {
+            if ((entity_component_signatures[entity.id()] & system_component_signature) == system_component_signature)
+            {
+                matching.push_back(entity);
+            }
+        }
+        if (!matching.empty())
+        {
+            system_pair.second->add_entities(matching);
+        }
+    }
+}
+
 void Registry::remove_entity_from_systems(Entity entity)
 {
+    structure_revision++;
     for (auto &system_pair : systems)
     {
         system_pair.second->remove_entity(entity);
@@ -153,6 +251,12 @@ void Registry::update()
     }
     entities_to_add.clear();
 
+    for (const auto &batch : batches_to_add)
+    {
+        add_batch_to_systems(batch);
+    }
+    batches_to_add.clear();
+
     for (auto &entity : entities_to_kill)
     {
         // remove entity from the system's entity vector
@@ -161,6 +265,7 @@ void Registry::update()
         // reset component signature at that entity id
         const auto entity_id = entity.id();
         entity_component_signatures[entity_id].reset();
+        touch_entity(entity_id);
 
         // remove entity's component instance from the corresponding component pool
         for (auto &pool : component_pools)
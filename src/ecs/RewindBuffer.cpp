@@ -0,0 +1,217 @@
+#include "RewindBuffer.hpp"
+
+RewindBuffer::RewindBuffer(std::size_t capacity)
+{
+    // the newest frame is shared from while the oldest is overwritten, they can't be the same slot
+    frames.resize(std::max<std::size_t>(2, capacity));
+}
+
+void RewindBuffer::remember_sources(const Registry &registry)
+{
+    sources.resize(registry.component_pools.size());
+    for (std::size_t i = 0; i < registry.component_pools.size(); i++)
+    {
+        const IPool *pool = registry.component_pools[i].get();
+        sources[i] = Source{pool, pool ? pool->get_revision() : 0};
+    }
+    structure_revision = registry.structure_revision;
+    label_revision = registry.label_revision;
+}
+
+void RewindBuffer::record(const Registry &registry, std::uint32_t tick, std::uint32_t time, float dt)
+{
+    if (count > 0 && (tick != newest_tick + 1 || &registry != source_registry))
+    {
+        clear();
+    }
+    const Frame *previous = count > 0 ? &frames[newest_tick % frames.size()] : nullptr;
+    Frame &frame = frames[tick % frames.size()];
+
+    // copies held only by the frame being overwritten are copied into instead of allocating new ones
+    std::vector<std::shared_ptr<const IPool>> recycled = std::move(frame.pools);
+    frame.pools.assign(registry.component_pools.size(), nullptr);
+    for (std::size_t i = 0; i < registry.component_pools.size(); i++)
+    {
+        const IPool *live = registry.component_pools[i].get();
+        if (!live)
+        {
+            continue;
+        }
+        if (previous && i < sources.size() && i < previous->pools.size() &&
+            sources[i].pool == live && sources[i].revision == live->get_revision())
+        {
+            frame.pools[i] = previous->pools[i];
+        }
+        else if (i < recycled.size() && recycled[i] && recycled[i].use_count() == 1)
+        {
+            auto copy = std::const_pointer_cast<IPool>(recycled[i]);
+            copy->copy_from(*live);
+            frame.pools[i] = copy;
+        }
+        else
+        {
+            frame.pools[i] = live->clone();
+        }
+    }
+
+    if (previous && structure_revision == registry.structure_revision)
+    {
+        frame.entities = previous->entities;
+    }
+    else
+    {
+        auto entities = std::make_shared<EntityState>();
+        entities->num_entities = registry.num_entities;
+        entities->signatures = registry.entity_component_signatures;
+        entities->free_ids = registry.free_ids;
+        entities->entities_to_add = registry.entities_to_add;
+        entities->entities_to_kill = registry.entities_to_kill;
+        entities->batches_to_add = registry.batches_to_add;
+        for (const auto &[type, system] : registry.systems)
+        {
+            entities->system_entities.emplace_back(type, system->entities());
+        }
+        frame.entities = entities;
+    }
+
+    if (previous && label_revision == registry.label_revision)
+    {
+        frame.labels = previous->labels;
+    }
+    else
+    {
+        frame.labels = std::make_shared<Labels>(Labels{registry.tag_per_entity, registry.group_per_entity});
+    }
+
+    frame.tick = tick;
+    frame.time = time;
+    frame.dt = dt;
+    newest_tick = tick;
+    count = std::min(count + 1, frames.size());
+    source_registry = &registry;
+    remember_sources(registry);
+}
+
+bool RewindBuffer::rewind(Registry &registry, std::uint32_t tick)
+{
+    if (!contains(tick) || &registry != source_registry)
+    {
+        return false;
+    }
+    const Frame &frame = frames[tick % frames.size()];
+
+    // pools are copied back into the registry's own storage, everything counts as changed for delta snapshots
+    if (frame.pools.size() > registry.component_pools.size())
+    {
+        registry.component_pools.resize(frame.pools.size(), nullptr);
+    }
+    for (std::size_t i = 0; i < registry.component_pools.size(); i++)
+    {
+        auto &pool = registry.component_pools[i];
+        if (i >= frame.pools.size() || !frame.pools[i])
+        {
+            pool.reset();
+            continue;
+        }
+        if (pool)
+        {
+            pool->copy_from(*frame.pools[i]);
+        }
+        else
+        {
+            pool = frame.pools[i]->clone();
+        }
+        pool->touch_all(registry.change_version);
+    }
+
+    const EntityState &entities = *frame.entities;
+    registry.num_entities = entities.num_entities;
+    registry.entity_component_signatures = entities.signatures;
+    registry.free_ids = entities.free_ids;
+    registry.entities_to_add = entities.entities_to_add;
+    registry.entities_to_kill = entities.entities_to_kill;
+    registry.batches_to_add = entities.batches_to_add;
+    registry.entity_versions.assign(
+        std::max<std::size_t>(registry.entity_versions.size(), entities.num_entities), registry.change_version);
+    // writes after the restore get a newer stamp, so the registry collects them as changes again
+    registry.change_version++;
+
+    // systems get their entities back in the order they had them, so a re-simulation visits them the same way
+    for (auto &[type, system] : registry.systems)
+    {
+        system->remove_all_entities();
+        for (const auto &[system_type, system_entities] : entities.system_entities)
+        {
+            if (system_type == type)
+            {
+                system->add_entities(system_entities);
+                break;
+            }
+        }
+    }
+
+    registry.tag_per_entity = frame.labels->tag_per_entity;
+    registry.entity_per_tag.clear();
+    for (const auto &[id, tag] : registry.tag_per_entity)
+    {
+        registry.entity_per_tag.emplace(tag, Entity{id, &registry});
+    }
+    registry.group_per_entity = frame.labels->group_per_entity;
+    registry.entities_per_group.clear();
+    for (const auto &[id, group] : registry.group_per_entity)
+    {
+        registry.entities_per_group[group].emplace(Entity{id, &registry});
+    }
+    registry.structure_revision++;
+    registry.label_revision++;
+
+    count -= newest_tick - tick;
+    newest_tick = tick;
+    remember_sources(registry);
+    return true;
+}
+
+std::vector<RewindBuffer::Timing> RewindBuffer::get_timings_after(std::uint32_t tick) const
+{
+    std::vector<Timing> timings;
+    for (std::uint32_t t = tick + 1; contains(t); t++)
+    {
+        const Frame &frame = frames[t % frames.size()];
+        timings.push_back(Timing{frame.tick, frame.time, frame.dt});
+    }
+    return timings;
+}
+
+bool RewindBuffer::contains(std::uint32_t tick) const
+{
+    return count > 0 && tick <= newest_tick && newest_tick - tick < count;
+}
+
+std::uint32_t RewindBuffer::get_oldest_tick() const
+{
+    return newest_tick - (count > 0 ? count - 1 : 0);
+}
+
+std::uint32_t RewindBuffer::get_newest_tick() const
+{
+    return newest_tick;
+}
+
+std::size_t RewindBuffer::size() const
+{
+    return count;
+}
+
+std::size_t RewindBuffer::get_capacity() const
+{
+    return frames.size();
+}
+
+void RewindBuffer::clear()
+{
+    frames.assign(frames.size(), Frame{});
+    count = 0;
+    newest_tick = 0;
+    sources.clear();
+    source_registry = nullptr;
+}
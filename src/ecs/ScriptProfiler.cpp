@@ -0,0 +1,204 @@
+#include "ScriptProfiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+const char *ScriptProfiler::binding_names[binding_count] = {
+    "set_position", "get_position", "set_velocity", "get_velocity", "set_rotation",
+    "set_animation_frame", "set_projectile_velocity", "spawn_wave", "spawn", "component", "view"};
+
+ScriptProfiler::ScriptProfiler(lua_State *L) : L(L)
+{
+    alloc = lua_getallocf(L, &alloc_ud);
+    lua_setallocf(L, count_alloc, this);
+}
+
+ScriptProfiler::~ScriptProfiler()
+{
+    lua_setallocf(L, alloc, alloc_ud);
+}
+
+void *ScriptProfiler::count_alloc(void *ud, void *ptr, std::size_t osize, std::size_t nsize)
+{
+    auto *profiler = static_cast<ScriptProfiler *>(ud);
+    // without a block osize is the type of the new object, not a size
+    std::size_t old_size = ptr ? osize : 0;
+    if (nsize > old_size)
+    {
+        profiler->allocated += nsize - old_size;
+    }
+    return profiler->alloc(profiler->alloc_ud, ptr, osize, nsize);
+}
+
+ScriptProfiler::FunctionStats &ScriptProfiler::stats_of(const sol::function &fun)
+{
+    lua_State *state = fun.lua_state();
+    fun.push();
+    const void *key = lua_topointer(state, -1);
+    auto it = function_cache.find(key);
+    if (it != function_cache.end())
+    {
+        lua_pop(state, 1);
+        return functions[it->second.slot];
+    }
+
+    // pops the function
+    lua_Debug info;
+    lua_getinfo(state, ">S", &info);
+    std::string source = std::string(info.short_src) + ":" + std::to_string(info.linedefined);
+    auto [slot, inserted] = source_slots.emplace(source, functions.size());
+    if (inserted)
+    {
+        FunctionStats stats;
+        stats.source = source;
+        functions.push_back(stats);
+    }
+    if (function_cache.size() >= max_cached)
+    {
+        function_cache.clear();
+    }
+    function_cache.emplace(key, CachedFunction{fun, slot->second});
+    return functions[slot->second];
+}
+
+void ScriptProfiler::clear_cache()
+{
+    function_cache.clear();
+}
+
+void ScriptProfiler::begin_frame()
+{
+    for (auto &stats : functions)
+    {
+        stats.frame_calls = 0;
+        stats.frame_ms = 0;
+        stats.frame_allocated = 0;
+        stats.slowest_entity = -1;
+        stats.slowest_ms = 0;
+    }
+    current = nullptr;
+    frame_start_allocated = allocated;
+    frame_start = std::chrono::steady_clock::now();
+}
+
+void ScriptProfiler::end_frame()
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frame_start;
+    frame_ms = elapsed.count();
+    frame_allocated = allocated - frame_start_allocated;
+    total_ms += frame_ms;
+    frames++;
+}
+
+void ScriptProfiler::begin_call(const sol::function &fun, int entity_id)
+{
+    // the lookup stays outside the timed part of the call
+    current = &stats_of(fun);
+    current_entity = entity_id;
+    call_allocated = allocated;
+    call_start = std::chrono::steady_clock::now();
+}
+
+void ScriptProfiler::end_call()
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - call_start;
+    const double ms = elapsed.count();
+    const std::uint64_t bytes = allocated - call_allocated;
+    FunctionStats &stats = *current;
+    stats.calls++;
+    stats.total_ms += ms;
+    stats.max_ms = std::max(stats.max_ms, ms);
+    stats.allocated += bytes;
+    stats.frame_calls++;
+    stats.frame_ms += ms;
+    stats.frame_allocated += bytes;
+    if (ms > stats.slowest_ms)
+    {
+        stats.slowest_ms = ms;
+        stats.slowest_entity = current_entity;
+    }
+    current = nullptr;
+}
+
+void ScriptProfiler::count_binding(Binding binding)
+{
+    if (current)
+    {
+        current->binding_calls[binding]++;
+    }
+}
+
+const std::vector<ScriptProfiler::FunctionStats> &ScriptProfiler::get_functions() const
+{
+    return functions;
+}
+
+int ScriptProfiler::get_frames() const
+{
+    return frames;
+}
+
+double ScriptProfiler::get_frame_ms() const
+{
+    return frame_ms;
+}
+
+double ScriptProfiler::get_average_ms() const
+{
+    return frames > 0 ? total_ms / frames : 0;
+}
+
+std::uint64_t ScriptProfiler::get_frame_allocated() const
+{
+    return frame_allocated;
+}
+
+std::uint64_t ScriptProfiler::get_allocated() const
+{
+    return allocated;
+}
+
+bool ScriptProfiler::dump(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<const FunctionStats *> sorted;
+    for (const auto &stats : functions)
+    {
+        sorted.push_back(&stats);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const FunctionStats *a, const FunctionStats *b)
+              { return a->total_ms > b->total_ms; });
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%d frames, %.3f ms per frame in scripts, %llu bytes allocated by lua\n\n",
+                  frames, get_average_ms(), static_cast<unsigned long long>(allocated));
+    file << line;
+    std::snprintf(line, sizeof(line), "%-40s %10s %12s %12s %10s %14s  %s\n",
+                  "function", "calls", "ms/frame", "us/call", "max us", "bytes/frame", "bindings per call");
+    file << line;
+    for (const FunctionStats *stats : sorted)
+    {
+        const double per_frame = frames > 0 ? stats->total_ms / frames : 0;
+        const double per_call = stats->calls > 0 ? stats->total_ms * 1000 / stats->calls : 0;
+        std::snprintf(line, sizeof(line), "%-40s %10llu %12.3f %12.2f %10.1f %14llu ",
+                      stats->source.c_str(), static_cast<unsigned long long>(stats->calls), per_frame, per_call,
+                      stats->max_ms * 1000, static_cast<unsigned long long>(frames > 0 ? stats->allocated / frames : 0));
+        file << line;
+        for (int i = 0; i < binding_count; i++)
+        {
+            if (stats->binding_calls[i] > 0)
+            {
+                std::snprintf(line, sizeof(line), " %s %.1f", binding_names[i],
+                              static_cast<double>(stats->binding_calls[i]) / stats->calls);
+                file << line;
+            }
+        }
+        file << "\n";
+    }
+    file.close();
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,388 @@
+#include "ScriptWorkers.hpp"
+#include "ECS.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// another state only gives a loaded chunk fresh upvalues, so a function moves when _ENV is all it captures
+static bool is_movable(const sol::function &fun)
+{
+    lua_State *state = fun.lua_state();
+    fun.push();
+    bool movable = true;
+    for (int i = 1; const char *name = lua_getupvalue(state, -1, i); i++)
+    {
+        lua_pop(state, 1);
+        if (i > 1 || std::strcmp(name, "_ENV") != 0)
+        {
+            movable = false;
+            break;
+        }
+    }
+    lua_pop(state, 1);
+    return movable;
+}
+
+ScriptWorkers::ScriptWorkers(sol::state &lua, Registry *registry, int state_count)
+    : registry(registry), main_state(lua.lua_state())
+{
+    if (state_count <= 0)
+    {
+        state_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < state_count; i++)
+    {
+        auto worker = std::make_unique<Worker>();
+        // no os, io or package and no loading code or files: a sandboxed script only has the bindings below
+        worker->lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::string, sol::lib::table);
+        for (const char *name : {"dofile", "loadfile", "load", "loadstring"})
+        {
+            worker->lua[name] = sol::lua_nil;
+        }
+        create_bindings(*worker);
+        workers.push_back(std::move(worker));
+    }
+    if (workers.size() > 1)
+    {
+        for (auto &worker : workers)
+        {
+            worker->thread = std::thread(&ScriptWorkers::work, this, std::ref(*worker));
+        }
+    }
+}
+
+ScriptWorkers::~ScriptWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frame_started.notify_all();
+    for (auto &worker : workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void ScriptWorkers::create_bindings(Worker &worker)
+{
+    Worker *self = &worker;
+    Registry *registry = this->registry;
+    sol::state &lua = worker.lua;
+
+    // reads go straight to the registry, nothing writes to it while the states run
+    lua.set_function("get_position", [registry](int id) -> std::tuple<double, double>
+                     {
+        Entity entity{id, registry};
+        if (!entity.has_component<TransformComponent>())
+        {
+            return {0.0, 0.0};
+        }
+        const auto &transform = entity.read_component<TransformComponent>();
+        return {transform.position.x, transform.position.y}; });
+    lua.set_function("get_velocity", [registry](int id) -> std::tuple<double, double>
+                     {
+        Entity entity{id, registry};
+        if (!entity.has_component<RigidBodyComponent>())
+        {
+            return {0.0, 0.0};
+        }
+        const auto &rigid_body = entity.read_component<RigidBodyComponent>();
+        return {rigid_body.velocity.x, rigid_body.velocity.y}; });
+    lua.set_function("get_rotation", [registry](int id) -> double
+                     {
+        Entity entity{id, registry};
+        return entity.has_component<TransformComponent>() ? entity.read_component<TransformComponent>().rotation : 0.0; });
+
+    auto queue = [self](CommandType type, int id, double x, double y)
+    {
+        if (id != self->current)
+        {
+            throw std::runtime_error("the script of entity " + std::to_string(self->current) +
+                                     " wrote to entity " + std::to_string(id) + ", sandboxed scripts only write their own");
+        }
+        self->commands.push_back(Command{type, id, x, y});
+    };
+    lua.set_function("set_position", [queue](int id, double x, double y)
+                     { queue(CommandType::position, id, x, y); });
+    lua.set_function("set_velocity", [queue](int id, double x, double y)
+                     { queue(CommandType::velocity, id, x, y); });
+    lua.set_function("set_rotation", [queue](int id, double angle)
+                     { queue(CommandType::rotation, id, angle, 0); });
+    lua.set_function("set_animation_frame", [queue](int id, int frame)
+                     { queue(CommandType::animation_frame, id, frame, 0); });
+    lua.set_function("set_projectile_velocity", [queue](int id, double x, double y)
+                     { queue(CommandType::projectile_velocity, id, x, y); });
+
+    lua.set_function("send", [self](int to, const std::string &name, double value)
+                     { self->outbox.push_back(Message{self->current, to, name, value}); });
+    lua.set_function("receive", [this, self](int id)
+                     {
+        if (id != self->current)
+        {
+            throw std::runtime_error("the script of entity " + std::to_string(self->current) +
+                                     " read the messages of entity " + std::to_string(id));
+        }
+        sol::table messages = self->lua.create_table();
+        auto it = inbox.find(id);
+        if (it != inbox.end())
+        {
+            for (std::size_t i = 0; i < it->second.size(); i++)
+            {
+                const Message &message = it->second[i];
+                messages[i + 1] = self->lua.create_table_with("from", message.from, "name", message.name,
+                                                              "value", message.value);
+            }
+        }
+        return messages; });
+}
+
+sol::protected_function *ScriptWorkers::load(Worker &worker, const sol::function &fun)
+{
+    const void *id = ScriptSystem::function_id(fun);
+    auto loaded = worker.functions.find(id);
+    if (loaded != worker.functions.end())
+    {
+        return &loaded->second;
+    }
+
+    auto code = bytecode.find(id);
+    if (code == bytecode.end())
+    {
+        // an empty string marks a function that stays in the main state, it is only looked at once
+        std::string dump_result;
+        if (is_movable(fun))
+        {
+            sol::state_view main_lua(main_state);
+            sol::protected_function dump = main_lua["string"]["dump"];
+            sol::protected_function_result result = dump(fun);
+            if (result.valid())
+            {
+                dump_result = result.get<std::string>();
+            }
+        }
+        code = bytecode.emplace(id, std::move(dump_result)).first;
+        dumped.push_back(fun);
+    }
+    if (code->second.empty())
+    {
+        return nullptr;
+    }
+    sol::load_result chunk = worker.lua.load(code->second);
+    if (!chunk.valid())
+    {
+        return nullptr;
+    }
+
+    sol::protected_function loaded_fun = chunk;
+    return &worker.functions.emplace(id, loaded_fun).first->second;
+}
+
+bool ScriptWorkers::add(int entity_id, const sol::function &fun)
+{
+    Worker &worker = *workers[entity_id % workers.size()];
+    sol::protected_function *loaded = load(worker, fun);
+    if (!loaded)
+    {
+        return false;
+    }
+    worker.jobs.push_back(Job{entity_id, loaded});
+    return true;
+}
+
+void ScriptWorkers::run_jobs(Worker &worker)
+{
+    for (const Job &job : worker.jobs)
+    {
+        worker.current = job.entity_id;
+        sol::protected_function_result result = (*job.fun)(job.entity_id, delta_time, elapsed_time);
+        if (!result.valid())
+        {
+            sol::error err = result;
+            worker.errors.push_back(err.what());
+        }
+    }
+    worker.current = -1;
+    worker.jobs.clear();
+}
+
+void ScriptWorkers::work(Worker &worker)
+{
+    std::uint64_t done = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frame_started.wait(lock, [&]
+                               { return stopping || frame != done; });
+            if (stopping)
+            {
+                return;
+            }
+            done = frame;
+        }
+        run_jobs(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        frame_finished.notify_one();
+    }
+}
+
+void ScriptWorkers::run(double delta_time, int elapsed_time)
+{
+    this->delta_time = delta_time;
+    this->elapsed_time = elapsed_time;
+    for (auto &message : main_outbox)
+    {
+        inbox[message.to].push_back(std::move(message));
+    }
+    main_outbox.clear();
+
+    bool has_jobs = false;
+    for (auto &worker : workers)
+    {
+        has_jobs = has_jobs || !worker->jobs.empty();
+    }
+    if (has_jobs && workers.size() == 1)
+    {
+        run_jobs(*workers[0]);
+    }
+    else if (has_jobs)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = workers.size();
+            frame++;
+        }
+        frame_started.notify_all();
+        std::unique_lock<std::mutex> lock(mutex);
+        frame_finished.wait(lock, [this]
+                            { return running == 0; });
+    }
+
+    inbox.clear();
+    for (auto &worker : workers)
+    {
+        for (const Command &command : worker->commands)
+        {
+            apply(command);
+        }
+        for (auto &message : worker->outbox)
+        {
+            inbox[message.to].push_back(std::move(message));
+        }
+        for (const std::string &error : worker->errors)
+        {
+            if (reported.insert(error).second)
+            {
+                Logger::error("Sandboxed script failed: " + error);
+            }
+        }
+        worker->commands.clear();
+        worker->outbox.clear();
+        worker->errors.clear();
+    }
+    // the same order whichever state a sender's entity fell to
+    for (auto &[to, messages] : inbox)
+    {
+        std::stable_sort(messages.begin(), messages.end(), [](const Message &a, const Message &b)
+                         { return a.from < b.from; });
+    }
+}
+
+void ScriptWorkers::apply(const Command &command)
+{
+    Entity entity{command.entity_id, registry};
+    switch (command.type)
+    {
+    case CommandType::position:
+        if (entity.has_component<TransformComponent>())
+        {
+            entity.get_component<TransformComponent>().position = vec2(command.x, command.y);
+        }
+        break;
+    case CommandType::velocity:
+        if (entity.has_component<RigidBodyComponent>())
+        {
+            entity.get_component<RigidBodyComponent>().velocity = vec2(command.x, command.y);
+        }
+        break;
+    case CommandType::rotation:
+        if (entity.has_component<TransformComponent>())
+        {
+            entity.get_component<TransformComponent>().rotation = command.x;
+        }
+        break;
+    case CommandType::animation_frame:
+        if (entity.has_component<AnimationComponent>())
+        {
+            entity.get_component<AnimationComponent>().current_frame = static_cast<int>(command.x);
+        }
+        break;
+    case CommandType::projectile_velocity:
+        if (entity.has_component<ProjectileEmitterComponent>())
+        {
+            entity.get_component<ProjectileEmitterComponent>().velocity = vec2(command.x, command.y);
+        }
+        break;
+    }
+}
+
+void ScriptWorkers::seed(std::uint32_t seed)
+{
+    for (std::size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->lua["math"]["randomseed"](seed + i);
+    }
+}
+
+void ScriptWorkers::copy_globals()
+{
+    sol::state_view main_lua(main_state);
+    main_lua.globals().for_each([&](const sol::object &key, const sol::object &value)
+                                {
+        if (key.get_type() != sol::type::string)
+        {
+            return;
+        }
+        // objects belong to the main state, the values are copied across
+        std::string name = key.as<std::string>();
+        for (auto &worker : workers)
+        {
+            switch (value.get_type())
+            {
+            case sol::type::number:
+                worker->lua[name] = value.as<double>();
+                break;
+            case sol::type::string:
+                worker->lua[name] = value.as<std::string>();
+                break;
+            case sol::type::boolean:
+                worker->lua[name] = value.as<bool>();
+                break;
+            default:
+                break;
+            }
+        } });
+}
+
+void ScriptWorkers::send(int to, const std::string &name, double value)
+{
+    main_outbox.push_back(Message{-1, to, name, value});
+}
+
+void ScriptWorkers::clear_messages()
+{
+    inbox.clear();
+    main_outbox.clear();
+}
+
+int ScriptWorkers::get_state_count() const
+{
+    return workers.size();
+}
@@ -0,0 +1,927 @@
+#include "Snapshot.hpp"
+#include "MappedFile.hpp"
+#include <Logger.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t function_count;
+        std::uint32_t delta; // 1 for a delta snapshot
+        std::uint64_t byte_count;
+    };
+}
+
+// ============================================================
+// writer and reader
+// ============================================================
+SnapshotWriter::SnapshotWriter(std::vector<char> &bytes, std::vector<sol::function> &functions)
+    : bytes(bytes), functions(functions)
+{
+}
+
+void SnapshotWriter::write_bytes(const void *data, std::size_t size)
+{
+    const char *begin = static_cast<const char *>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+}
+
+void SnapshotWriter::write_string(const std::string &value)
+{
+    write<std::uint32_t>(value.size());
+    write_bytes(value.data(), value.size());
+}
+
+void SnapshotWriter::write_function(const sol::function &fun)
+{
+    if (!fun.valid())
+    {
+        write<std::int32_t>(-1);
+        return;
+    }
+    write<std::int32_t>(functions.size());
+    functions.push_back(fun);
+}
+
+SnapshotReader::SnapshotReader(const std::vector<char> &bytes, const std::vector<sol::function> &functions)
+    : bytes(bytes), functions(functions)
+{
+}
+
+bool SnapshotReader::is_valid() const
+{
+    return valid;
+}
+
+std::size_t SnapshotReader::remaining() const
+{
+    return bytes.size() - position;
+}
+
+void SnapshotReader::read_bytes(void *data, std::size_t size)
+{
+    if (!valid || size > remaining())
+    {
+        valid = false;
+        std::memset(data, 0, size);
+        return;
+    }
+    std::memcpy(data, bytes.data() + position, size);
+    position += size;
+}
+
+std::string SnapshotReader::read_string()
+{
+    std::uint32_t length = read<std::uint32_t>();
+    if (length > remaining())
+    {
+        valid = false;
+        return "";
+    }
+    std::string value(bytes.data() + position, length);
+    position += length;
+    return value;
+}
+
+sol::function SnapshotReader::read_function()
+{
+    std::int32_t index = read<std::int32_t>();
+    if (index < 0)
+    {
+        return sol::lua_nil;
+    }
+    if (index >= functions.size())
+    {
+        valid = false;
+        return sol::lua_nil;
+    }
+    return functions[index];
+}
+
+// ============================================================
+// component codecs
+// ============================================================
+void encode_component(SnapshotWriter &writer, const SpriteComponent &sprite)
+{
+    writer.write_string(sprite.asset_name);
+    writer.write<std::int32_t>(sprite.width);
+    writer.write<std::int32_t>(sprite.height);
+    writer.write<std::int32_t>(sprite.z_index);
+    writer.write<bool>(sprite.is_fixed);
+    writer.write(sprite.flip);
+    writer.write(sprite.src_rect);
+}
+
+void decode_component(SnapshotReader &reader, SpriteComponent &sprite)
+{
+    sprite.asset_name = reader.read_string();
+    sprite.width = reader.read<std::int32_t>();
+    sprite.height = reader.read<std::int32_t>();
+    sprite.z_index = reader.read<std::int32_t>();
+    sprite.is_fixed = reader.read<bool>();
+    sprite.flip = reader.read<SDL_RendererFlip>();
+    sprite.src_rect = reader.read<SDL_Rect>();
+    // texture ids only mean something to the asset store that handed them out
+    sprite.texture_id = -1;
+}
+
+void encode_component(SnapshotWriter &writer, const TextComponent &text)
+{
+    writer.write(text.position);
+    writer.write_string(text.text);
+    writer.write_string(text.font_name);
+    writer.write(text.color);
+    writer.write<bool>(text.is_fixed);
+}
+
+void decode_component(SnapshotReader &reader, TextComponent &text)
+{
+    text.position = reader.read<vec2>();
+    text.text = reader.read_string();
+    text.font_name = reader.read_string();
+    text.color = reader.read<SDL_Color>();
+    text.is_fixed = reader.read<bool>();
+}
+
+void encode_component(SnapshotWriter &writer, const ScriptComponent &script)
+{
+    writer.write_function(script.fun);
+    writer.write<bool>(script.is_coroutine);
+    writer.write<bool>(script.is_sandboxed);
+}
+
+void decode_component(SnapshotReader &reader, ScriptComponent &script)
+{
+    script.fun = reader.read_function();
+    // a coroutine starts over from the top, where it was suspended isn't saved
+    script.is_coroutine = reader.read<bool>();
+    script.is_sandboxed = reader.read<bool>();
+}
+
+// ============================================================
+// pools
+// ============================================================
+template <typename TComponent>
+Snapshot::PoolCodec Snapshot::make_codec(const std::string &name)
+{
+    return PoolCodec{name, Component<TComponent>::id(), &Snapshot::write_pool<TComponent>,
+                     &Snapshot::read_pool<TComponent>, &Snapshot::merge_pool<TComponent>};
+}
+
+const std::vector<Snapshot::PoolCodec> &Snapshot::codecs()
+{
+    // names are what ties a pool in a saved snapshot to a component type, don't rename them
+    static const std::vector<PoolCodec> all = {
+        make_codec<TransformComponent>("transform"),
+        make_codec<RigidBodyComponent>("rigid_body"),
+        make_codec<SprintComponent>("sprint"),
+        make_codec<SpriteComponent>("sprite"),
+        make_codec<AnimationComponent>("animation"),
+        make_codec<BoxColliderComponent>("box_collider"),
+        make_codec<KeyboardControlComponent>("keyboard_control"),
+        make_codec<MouseControlComponent>("mouse_control"),
+        make_codec<CameraFollowComponent>("camera_follow"),
+        make_codec<ProjectileEmitterComponent>("projectile_emitter"),
+        make_codec<ProjectileComponent>("projectile"),
+        make_codec<HealthComponent>("health"),
+        make_codec<TextComponent>("text"),
+        make_codec<ScriptComponent>("script"),
+    };
+    return all;
+}
+
+template <typename TComponent>
+void Snapshot::write_pool(const IPool &pool, std::uint32_t since, SnapshotWriter &writer)
+{
+    const auto &typed = static_cast<const Pool<TComponent> &>(pool);
+    std::vector<int> indices;
+    indices.reserve(typed.n_entities);
+    for (int i = 0; i < typed.n_entities; i++)
+    {
+        if (since == 0 || typed.versions[i] > since)
+        {
+            indices.push_back(i);
+        }
+    }
+
+    const std::uint32_t count = indices.size();
+    writer.write<std::uint32_t>(count);
+    // 0 marks a pool written component by component
+    writer.write<std::uint32_t>(std::is_trivially_copyable_v<TComponent> ? sizeof(TComponent) : 0);
+    for (int index : indices)
+    {
+        writer.write<std::int32_t>(typed.index_to_entity.at(index));
+    }
+
+    if constexpr (std::is_trivially_copyable_v<TComponent>)
+    {
+        if (count == typed.n_entities)
+        {
+            writer.write_bytes(typed.data.data(), count * sizeof(TComponent));
+            return;
+        }
+        for (int index : indices)
+        {
+            writer.write_bytes(&typed.data[index], sizeof(TComponent));
+        }
+    }
+    else
+    {
+        for (int index : indices)
+        {
+            encode_component(writer, typed.data[index]);
+        }
+    }
+}
+
+template <typename TComponent>
+std::shared_ptr<IPool> Snapshot::read_pool(SnapshotReader &reader, int num_entities, std::vector<int> &entity_ids)
+{
+    const std::uint32_t count = reader.read<std::uint32_t>();
+    const std::uint32_t element_size = reader.read<std::uint32_t>();
+    if (element_size != (std::is_trivially_copyable_v<TComponent> ? sizeof(TComponent) : 0) ||
+        count > reader.remaining() / sizeof(std::int32_t))
+    {
+        return nullptr;
+    }
+
+    auto pool = std::make_shared<Pool<TComponent>>(count);
+    entity_ids.resize(count);
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        entity_ids[i] = reader.read<std::int32_t>();
+        if (entity_ids[i] < 0 || entity_ids[i] >= num_entities)
+        {
+            return nullptr;
+        }
+        if (entity_ids[i] >= pool->entity_to_index.size())
+        {
+            pool->entity_to_index.resize(num_entities, -1);
+        }
+        pool->entity_to_index[entity_ids[i]] = i;
+        pool->index_to_entity[i] = entity_ids[i];
+    }
+    pool->n_entities = count;
+
+    if constexpr (std::is_trivially_copyable_v<TComponent>)
+    {
+        reader.read_bytes(pool->data.data(), count * sizeof(TComponent));
+    }
+    else
+    {
+        for (std::uint32_t i = 0; i < count; i++)
+        {
+            decode_component(reader, pool->data[i]);
+        }
+    }
+    return reader.is_valid() ? pool : nullptr;
+}
+
+template <typename TComponent>
+void Snapshot::merge_pool(Registry &registry, const IPool &changes, const std::vector<int> &entity_ids)
+{
+    const auto &typed = static_cast<const Pool<TComponent> &>(changes);
+    auto pool = registry.get_pool<TComponent>();
+    const int component_id = Component<TComponent>::id();
+    for (std::size_t i = 0; i < entity_ids.size(); i++)
+    {
+        pool->set(entity_ids[i], typed.data[i]);
+        registry.note_write(*pool, entity_ids[i]);
+        pool->touch(entity_ids[i], registry.change_version);
+        registry.entity_component_signatures[entity_ids[i]].set(component_id);
+    }
+}
+
+// ============================================================
+// capture and restore
+// ============================================================
+namespace
+{
+    // num_entities and the free ids, shared by full and delta snapshots
+    bool read_entity_ids(SnapshotReader &reader, int &num_entities, std::deque<int> &free_ids, std::vector<bool> &is_free)
+    {
+        num_entities = reader.read<std::int32_t>();
+        const std::uint32_t free_count = reader.read<std::uint32_t>();
+        if (!reader.is_valid() || num_entities < 0 || free_count > reader.remaining() / sizeof(std::int32_t))
+        {
+            return false;
+        }
+        is_free.assign(num_entities, false);
+        for (std::uint32_t i = 0; i < free_count; i++)
+        {
+            int id = reader.read<std::int32_t>();
+            if (id < 0 || id >= num_entities)
+            {
+                return false;
+            }
+            free_ids.push_back(id);
+            is_free[id] = true;
+        }
+        return true;
+    }
+
+    bool invalid()
+    {
+        Logger::error("Snapshot is truncated or was written by another build, not restored");
+        return false;
+    }
+}
+
+void Snapshot::begin_capture(Registry &registry)
+{
+    clear();
+    source = &registry;
+    // writes from here on get a newer version than this snapshot
+    change_version = registry.change_version++;
+
+    SnapshotWriter writer(bytes, functions);
+    writer.write<std::int32_t>(registry.num_entities);
+    writer.write<std::uint32_t>(registry.free_ids.size());
+    for (int id : registry.free_ids)
+    {
+        writer.write<std::int32_t>(id);
+    }
+}
+
+void Snapshot::capture(Registry &registry)
+{
+    begin_capture(registry);
+    SnapshotWriter writer(bytes, functions);
+
+    writer.write<std::uint32_t>(registry.tag_per_entity.size());
+    for (const auto &[id, tag] : registry.tag_per_entity)
+    {
+        writer.write<std::int32_t>(id);
+        writer.write_string(tag);
+    }
+    writer.write<std::uint32_t>(registry.group_per_entity.size());
+    for (const auto &[id, group] : registry.group_per_entity)
+    {
+        writer.write<std::int32_t>(id);
+        writer.write_string(group);
+    }
+
+    std::vector<const PoolCodec *> present;
+    for (const auto &codec : codecs())
+    {
+        if (codec.component_id < registry.component_pools.size() && registry.component_pools[codec.component_id])
+        {
+            present.push_back(&codec);
+        }
+    }
+    writer.write<std::uint32_t>(present.size());
+    for (const auto *codec : present)
+    {
+        writer.write_string(codec->name);
+        codec->write(*registry.component_pools[codec->component_id], 0, writer);
+    }
+}
+
+void Snapshot::capture_delta(Registry &registry, const Snapshot &baseline)
+{
+    if (baseline.source != &registry)
+    {
+        Logger::error("Delta baseline was captured from another registry, taking a full snapshot");
+        capture(registry);
+        return;
+    }
+    const std::uint32_t since = baseline.change_version;
+    begin_capture(registry);
+    delta = true;
+    SnapshotWriter writer(bytes, functions);
+
+    // the codec table the entity pool bits refer to
+    writer.write<std::uint32_t>(codecs().size());
+    for (const auto &codec : codecs())
+    {
+        writer.write_string(codec.name);
+    }
+
+    std::vector<bool> is_free(registry.num_entities, false);
+    for (int id : registry.free_ids)
+    {
+        is_free[id] = true;
+    }
+    std::vector<int> changed;
+    for (int id = 0; id < registry.num_entities; id++)
+    {
+        if (registry.entity_versions[id] > since)
+        {
+            changed.push_back(id);
+        }
+    }
+    writer.write<std::uint32_t>(changed.size());
+    for (int id : changed)
+    {
+        std::uint64_t pools = 0;
+        for (std::size_t i = 0; i < codecs().size(); i++)
+        {
+            if (registry.entity_component_signatures[id].test(codecs()[i].component_id))
+            {
+                pools |= std::uint64_t{1} << i;
+            }
+        }
+        auto tag = registry.tag_per_entity.find(id);
+        auto group = registry.group_per_entity.find(id);
+        writer.write<std::int32_t>(id);
+        writer.write<bool>(!is_free[id]);
+        writer.write_string(tag != registry.tag_per_entity.end() ? tag->second : "");
+        writer.write_string(group != registry.group_per_entity.end() ? group->second : "");
+        writer.write(pools);
+    }
+
+    std::vector<std::uint32_t> present;
+    for (std::size_t i = 0; i < codecs().size(); i++)
+    {
+        const int component_id = codecs()[i].component_id;
+        if (component_id < registry.component_pools.size() && registry.component_pools[component_id])
+        {
+            present.push_back(i);
+        }
+    }
+    writer.write<std::uint32_t>(present.size());
+    for (std::uint32_t index : present)
+    {
+        writer.write(index);
+        codecs()[index].write(*registry.component_pools[codecs()[index].component_id], since, writer);
+    }
+}
+
+bool Snapshot::restore(Registry &registry) const
+{
+    return delta ? apply_delta(registry) : restore_full(registry);
+}
+
+bool Snapshot::restore_full(Registry &registry) const
+{
+    // decode everything first so a bad snapshot leaves the registry as it was
+    SnapshotReader reader(bytes, functions);
+    int num_entities;
+    std::deque<int> free_ids;
+    std::vector<bool> is_free;
+    if (!read_entity_ids(reader, num_entities, free_ids, is_free))
+    {
+        return invalid();
+    }
+    auto is_alive = [&](int id)
+    {
+        return id >= 0 && id < num_entities && !is_free[id];
+    };
+
+    // every entry takes at least an id and a string length
+    const std::uint32_t tag_count = reader.read<std::uint32_t>();
+    if (tag_count > reader.remaining() / (2 * sizeof(std::uint32_t)))
+    {
+        return invalid();
+    }
+    std::vector<std::pair<int, std::string>> tags(tag_count);
+    for (auto &[id, tag] : tags)
+    {
+        id = reader.read<std::int32_t>();
+        tag = reader.read_string();
+        if (!reader.is_valid() || !is_alive(id))
+        {
+            return invalid();
+        }
+    }
+    const std::uint32_t group_count = reader.read<std::uint32_t>();
+    if (group_count > reader.remaining() / (2 * sizeof(std::uint32_t)))
+    {
+        return invalid();
+    }
+    std::vector<std::pair<int, std::string>> groups(group_count);
+    for (auto &[id, group] : groups)
+    {
+        id = reader.read<std::int32_t>();
+        group = reader.read_string();
+        if (!reader.is_valid() || !is_alive(id))
+        {
+            return invalid();
+        }
+    }
+
+    const std::uint32_t pool_count = reader.read<std::uint32_t>();
+    std::vector<std::pair<const PoolCodec *, std::shared_ptr<IPool>>> pools;
+    std::vector<std::vector<int>> pool_entities(std::min<std::uint32_t>(pool_count, codecs().size()));
+    for (std::uint32_t i = 0; i < pool_count && reader.is_valid(); i++)
+    {
+        const std::string name = reader.read_string();
+        auto codec = std::find_if(codecs().begin(), codecs().end(), [&name](const PoolCodec &codec)
+                                  { return codec.name == name; });
+        if (codec == codecs().end() || i >= pool_entities.size())
+        {
+            Logger::error("Snapshot holds unknown component pool " + name);
+            return invalid();
+        }
+        auto pool = codec->read(reader, num_entities, pool_entities[i]);
+        if (!pool || !std::all_of(pool_entities[i].begin(), pool_entities[i].end(), is_alive))
+        {
+            return invalid();
+        }
+        pools.emplace_back(&*codec, pool);
+    }
+    if (!reader.is_valid())
+    {
+        return invalid();
+    }
+
+    // systems are emptied and refilled from the restored signatures
+    for (auto &system_pair : registry.systems)
+    {
+        system_pair.second->remove_all_entities();
+    }
+    registry.entities_to_add.clear();
+    registry.entities_to_kill.clear();
+    registry.batches_to_add.clear();
+
+    registry.num_entities = num_entities;
+    registry.free_ids = std::move(free_ids);
+    registry.entity_component_signatures.assign(
+        std::max<std::size_t>(registry.entity_component_signatures.size(), num_entities), Signature());
+    for (auto &pool : registry.component_pools)
+    {
+        pool.reset();
+    }
+    for (std::size_t i = 0; i < pools.size(); i++)
+    {
+        const int component_id = pools[i].first->component_id;
+        if (component_id >= registry.component_pools.size())
+        {
+            registry.component_pools.resize(component_id + 1, nullptr);
+        }
+        registry.component_pools[component_id] = pools[i].second;
+        for (int id : pool_entities[i])
+        {
+            registry.entity_component_signatures[id].set(component_id);
+        }
+        // everything counts as changed, a delta against an older baseline has to carry all of it
+        pools[i].second->touch_all(registry.change_version);
+    }
+    registry.entity_versions.assign(
+        std::max<std::size_t>(registry.entity_versions.size(), num_entities), registry.change_version);
+    // writes after the restore get a newer stamp, so the registry collects them as changes again
+    registry.change_version++;
+
+    registry.tag_per_entity.clear();
+    registry.entity_per_tag.clear();
+    registry.label_revision++;
+    for (const auto &[id, tag] : tags)
+    {
+        registry.tag(Entity{id, &registry}, tag);
+    }
+    registry.entities_per_group.clear();
+    registry.group_per_entity.clear();
+    for (const auto &[id, group] : groups)
+    {
+        registry.group(Entity{id, &registry}, group);
+    }
+
+    std::vector<Entity> alive;
+    alive.reserve(num_entities - registry.free_ids.size());
+    for (int id = 0; id < num_entities; id++)
+    {
+        if (!is_free[id])
+        {
+            alive.push_back(Entity{id, &registry});
+        }
+    }
+    registry.add_batch_to_systems(alive);
+    return true;
+}
+
+bool Snapshot::apply_delta(Registry &registry) const
+{
+    SnapshotReader reader(bytes, functions);
+    int num_entities;
+    std::deque<int> free_ids;
+    std::vector<bool> is_free;
+    if (!read_entity_ids(reader, num_entities, free_ids, is_free))
+    {
+        return invalid();
+    }
+
+    // codecs of the writer, by bit
+    const std::uint32_t codec_count = reader.read<std::uint32_t>();
+    if (codec_count > 64)
+    {
+        return invalid();
+    }
+    std::vector<const PoolCodec *> table;
+    for (std::uint32_t i = 0; i < codec_count; i++)
+    {
+        const std::string name = reader.read_string();
+        auto codec = std::find_if(codecs().begin(), codecs().end(), [&name](const PoolCodec &codec)
+                                  { return codec.name == name; });
+        if (codec == codecs().end())
+        {
+            Logger::error("Snapshot holds unknown component pool " + name);
+            return invalid();
+        }
+        table.push_back(&*codec);
+    }
+
+    // id, alive flag, two string lengths and the pool bits at least
+    const std::uint32_t change_count = reader.read<std::uint32_t>();
+    if (change_count > reader.remaining() / (3 * sizeof(std::uint32_t) + 1 + sizeof(std::uint64_t)))
+    {
+        return invalid();
+    }
+    std::vector<EntityChange> changes(change_count);
+    for (auto &change : changes)
+    {
+        change.id = reader.read<std::int32_t>();
+        change.alive = reader.read<bool>();
+        change.tag = reader.read_string();
+        change.group = reader.read_string();
+        change.pools = reader.read<std::uint64_t>();
+        if (!reader.is_valid() || change.id < 0 || change.id >= num_entities || change.alive == is_free[change.id])
+        {
+            return invalid();
+        }
+    }
+
+    const std::uint32_t pool_count = reader.read<std::uint32_t>();
+    std::vector<std::pair<const PoolCodec *, std::shared_ptr<IPool>>> pools;
+    std::vector<std::vector<int>> pool_entities(std::min<std::uint32_t>(pool_count, table.size()));
+    for (std::uint32_t i = 0; i < pool_count && reader.is_valid(); i++)
+    {
+        const std::uint32_t index = reader.read<std::uint32_t>();
+        if (index >= table.size() || i >= pool_entities.size())
+        {
+            return invalid();
+        }
+        auto pool = table[index]->read(reader, num_entities, pool_entities[i]);
+        if (!pool || !std::all_of(pool_entities[i].begin(), pool_entities[i].end(), [&](int id)
+                                  { return id >= 0 && id < num_entities && !is_free[id]; }))
+        {
+            return invalid();
+        }
+        pools.emplace_back(table[index], pool);
+    }
+    if (!reader.is_valid())
+    {
+        return invalid();
+    }
+
+    registry.entities_to_add.clear();
+    registry.entities_to_kill.clear();
+    registry.batches_to_add.clear();
+    if (num_entities > registry.entity_component_signatures.size())
+    {
+        registry.entity_component_signatures.resize(num_entities);
+    }
+
+    // changed entities leave their systems, drop the components they no longer have and get their tag and group back
+    std::vector<Entity> alive;
+    for (const auto &change : changes)
+    {
+        Entity entity{change.id, &registry};
+        registry.remove_entity_from_systems(entity);
+        registry.remove_entity_tag(entity);
+        registry.remove_entity_group(entity);
+
+        Signature kept;
+        for (std::size_t i = 0; i < table.size() && change.alive; i++)
+        {
+            if (change.pools & (std::uint64_t{1} << i))
+            {
+                kept.set(table[i]->component_id);
+            }
+        }
+        auto &signature = registry.entity_component_signatures[change.id];
+        for (const auto &codec : codecs())
+        {
+            if (signature.test(codec.component_id) && !kept.test(codec.component_id))
+            {
+                registry.component_pools[codec.component_id]->remove(change.id);
+            }
+        }
+        signature &= kept;
+
+        if (change.alive)
+        {
+            if (!change.tag.empty())
+            {
+                registry.tag(entity, change.tag);
+            }
+            if (!change.group.empty())
+            {
+                registry.group(entity, change.group);
+            }
+            alive.push_back(entity);
+        }
+        registry.touch_entity(change.id);
+    }
+    registry.num_entities = num_entities;
+    registry.free_ids = std::move(free_ids);
+
+    for (std::size_t i = 0; i < pools.size(); i++)
+    {
+        pools[i].first->merge(registry, *pools[i].second, pool_entities[i]);
+    }
+    registry.add_batch_to_systems(alive);
+    return true;
+}
+
+std::uint64_t Snapshot::hash(const Registry &registry)
+{
+    // FNV-1a over single fields, whole components would mix in their padding bytes
+    std::uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const auto &value)
+    {
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(&value);
+        for (std::size_t i = 0; i < sizeof(value); i++)
+        {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+    };
+
+    std::vector<bool> is_free(registry.num_entities, false);
+    for (int id : registry.free_ids)
+    {
+        is_free[id] = true;
+    }
+    mix(registry.num_entities);
+    for (int id = 0; id < registry.num_entities; id++)
+    {
+        if (is_free[id])
+        {
+            continue;
+        }
+        // pools by codec order, component ids may differ between runs
+        const Signature &signature = registry.entity_component_signatures[id];
+        std::uint64_t pools = 0;
+        for (std::size_t i = 0; i < codecs().size(); i++)
+        {
+            if (signature.test(codecs()[i].component_id))
+            {
+                pools |= std::uint64_t{1} << i;
+            }
+        }
+        mix(id);
+        mix(pools);
+
+        Entity entity{id, const_cast<Registry *>(&registry)};
+        if (signature.test(Component<TransformComponent>::id()))
+        {
+            const auto &transform = entity.read_component<TransformComponent>();
+            mix(transform.position.x);
+            mix(transform.position.y);
+            mix(transform.rotation);
+        }
+        if (signature.test(Component<RigidBodyComponent>::id()))
+        {
+            const auto &rigid_body = entity.read_component<RigidBodyComponent>();
+            mix(rigid_body.velocity.x);
+            mix(rigid_body.velocity.y);
+        }
+        if (signature.test(Component<HealthComponent>::id()))
+        {
+            mix(entity.read_component<HealthComponent>().health);
+        }
+    }
+    return hash;
+}
+
+// ============================================================
+// files
+// ============================================================
+bool Snapshot::save(const std::string &path, sol::state &lua) const
+{
+    // bytecode keeps the function body only, upvalues come back as nil
+    sol::protected_function dump = lua["string"]["dump"];
+    std::vector<std::string> bytecode;
+    bytecode.reserve(functions.size());
+    for (const auto &fun : functions)
+    {
+        sol::protected_function_result result = dump(fun);
+        if (!result.valid())
+        {
+            Logger::error("Failed to dump a script, snapshot " + path + " was not written");
+            return false;
+        }
+        bytecode.push_back(result.get<std::string>());
+    }
+
+    // write next to the target and rename so a crash while saving never leaves half a snapshot
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        Logger::error("Failed to write snapshot " + path);
+        return false;
+    }
+    FileHeader header{magic, version, static_cast<std::uint32_t>(bytecode.size()), delta, bytes.size()};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(bytes.data(), bytes.size());
+    for (const auto &code : bytecode)
+    {
+        std::uint32_t length = code.size();
+        file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        file.write(code.data(), code.size());
+    }
+    file.close();
+
+    std::error_code error;
+    if (file)
+    {
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!file || error)
+    {
+        Logger::error("Failed to write snapshot " + path);
+        return false;
+    }
+    return true;
+}
+
+bool Snapshot::load(const std::string &path, sol::state &lua)
+{
+    clear();
+    MappedFile file(path);
+    FileHeader header;
+    if (!file.get_data() || file.get_size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, file.get_data(), sizeof(header));
+    if (header.magic != magic || header.version != version || header.byte_count > file.get_size() - sizeof(header))
+    {
+        Logger::error("Snapshot " + path + " is not a snapshot of this version");
+        return false;
+    }
+
+    delta = header.delta;
+    const char *position = file.get_data() + sizeof(header);
+    const char *end = file.get_data() + file.get_size();
+    bytes.assign(position, position + header.byte_count);
+    position += header.byte_count;
+    for (std::uint32_t i = 0; i < header.function_count; i++)
+    {
+        std::uint32_t length;
+        if (end - position < sizeof(length))
+        {
+            clear();
+            return false;
+        }
+        std::memcpy(&length, position, sizeof(length));
+        position += sizeof(length);
+        if (end - position < length)
+        {
+            clear();
+            return false;
+        }
+        sol::load_result chunk = lua.load(std::string(position, length));
+        position += length;
+        if (!chunk.valid())
+        {
+            Logger::error("Failed to load a script from snapshot " + path);
+            clear();
+            return false;
+        }
+        sol::function fun = chunk;
+        functions.push_back(fun);
+    }
+    return true;
+}
+
+void Snapshot::rebind(const ScriptSystem::Rebinding &rebinding)
+{
+    for (auto &fun : functions)
+    {
+        auto it = rebinding.find(ScriptSystem::function_id(fun));
+        if (it != rebinding.end())
+        {
+            fun = it->second;
+        }
+    }
+}
+
+bool Snapshot::is_delta() const
+{
+    return delta;
+}
+
+bool Snapshot::is_empty() const
+{
+    return bytes.empty();
+}
+
+std::size_t Snapshot::get_size() const
+{
+    return bytes.size();
+}
+
+void Snapshot::clear()
+{
+    bytes.clear();
+    functions.clear();
+    delta = false;
+    change_version = 0;
+    source = nullptr;
+}
@@ -7,6 +7,11 @@ void System::add_entity(Entity entity)
     _entities.push_back(entity);
 }
 
+void System::add_entities(const std::vector<Entity> &entities)
+{
+    _entities.insert(_entities.end(), entities.begin(), entities.end());
+}
+
 void System::remove_entity(Entity entity)
 {
     auto it = std::remove_if(_entities.begin(), _entities.end(),
@@ -15,6 +20,12 @@ void System::remove_entity(Entity entity)
 
     _entities.erase(it, _entities.end());
 }
+
+void System::remove_all_entities()
+{
+    _entities.clear();
+}
+
 std::vector<Entity> System::entities() const
 {
     return _entities;
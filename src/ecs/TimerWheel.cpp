@@ -0,0 +1,56 @@
+#include "TimerWheel.hpp"
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::uint32_t slot_ms, std::size_t slot_count)
+    : slot_ms(std::max<std::uint32_t>(1, slot_ms)), slots(std::max<std::size_t>(1, slot_count))
+{
+}
+
+std::size_t TimerWheel::slot_of(std::uint32_t time) const
+{
+    return (time / slot_ms) % slots.size();
+}
+
+void TimerWheel::schedule(std::uint32_t due, int id, std::uint32_t generation)
+{
+    // overdue timers go where the next advance starts looking
+    std::uint32_t slot_time = started ? std::max(due, now) : due;
+    slots[slot_of(slot_time)].push_back(Timer{due, id, generation});
+    count++;
+}
+
+void TimerWheel::advance(std::uint32_t time, std::vector<Timer> &expired)
+{
+    // the first advance looks at every slot, timers may have been scheduled before time was known.
+    // time going backwards (a rewind or a restored snapshot) only looks at the current slot
+    const std::uint32_t from = std::min(now, time);
+    const std::size_t steps = started ? std::min<std::size_t>(time / slot_ms - from / slot_ms + 1, slots.size())
+                                      : slots.size();
+    const std::size_t first = slot_of(from);
+    started = true;
+    for (std::size_t i = 0; i < steps; i++)
+    {
+        auto &slot = slots[(first + i) % slots.size()];
+        auto kept = std::stable_partition(slot.begin(), slot.end(), [time](const Timer &timer)
+                                          { return timer.due > time; });
+        expired.insert(expired.end(), kept, slot.end());
+        count -= slot.end() - kept;
+        slot.erase(kept, slot.end());
+    }
+    now = time;
+}
+
+void TimerWheel::clear()
+{
+    for (auto &slot : slots)
+    {
+        slot.clear();
+    }
+    count = 0;
+    started = false;
+}
+
+std::size_t TimerWheel::size() const
+{
+    return count;
+}
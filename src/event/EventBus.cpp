@@ -0,0 +1,23 @@
+#include "ECS.hpp"
+
+std::atomic<int> IEventType::_id{0};
+
+void EventBus::set_queued(bool queued)
+{
+    this->queued = queued;
+    for (auto &channel : owned_channels)
+    {
+        channel->set_queued(queued);
+    }
+}
+
+void EventBus::dispatch_queued()
+{
+    for (auto &channel : channels)
+    {
+        if (IEventChannel *found = channel.load(std::memory_order_relaxed))
+        {
+            found->dispatch_queued();
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #include "ECS.hpp"
 
-KeyPressedEvent::KeyPressedEvent(SDL_Keycode key)
+KeyPressedEvent::KeyPressedEvent(SDL_Keycode key, int entity_id)
 {
     this->key = key;
+    this->entity_id = entity_id;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "ECS.hpp"
 
-MouseClickedEvent::MouseClickedEvent(int button)
+MouseClickedEvent::MouseClickedEvent(int button, int entity_id)
 {
     this->button = button;
+    this->entity_id = entity_id;
 }
\ No newline at end of file
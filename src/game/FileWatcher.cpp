@@ -0,0 +1,69 @@
+#include "FileWatcher.hpp"
+#include <algorithm>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher() : buffer(64 * 1024)
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool FileWatcher::watch(const std::string &path)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    std::size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    // adding a directory twice hands back the descriptor it already has
+    int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+    {
+        return false;
+    }
+    directories[wd] = directory;
+    files.insert(path);
+    return true;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+    if (fd < 0)
+    {
+        return changed;
+    }
+    while (true)
+    {
+        ssize_t length = read(fd, buffer.data(), buffer.size());
+        if (length <= 0)
+        {
+            break;
+        }
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + offset);
+            offset += sizeof(inotify_event) + event->len;
+            auto directory = directories.find(event->wd);
+            if (event->len == 0 || directory == directories.end())
+            {
+                continue;
+            }
+            std::string path = directory->second + "/" + event->name;
+            if (files.count(path) && std::find(changed.begin(), changed.end(), path) == changed.end())
+            {
+                changed.push_back(path);
+            }
+        }
+    }
+    return changed;
+}
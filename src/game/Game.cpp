@@ -3,34 +3,67 @@
 #include <SDL2/SDL_image.h>
 #include <imgui.h>
 #include <Logger.hpp>
+#include <chrono>
+#include <cmath>
 #include <exception>
+#include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <memory>
+#include <random>
 #include <stdexcept>
 #include "ECS.hpp"
 #include "imgui_impl_sdl.h"
 #include "imgui_impl_sdlrenderer.h"
 #include "LevelLoader.hpp"
+#include "Prefab.hpp"
 using namespace std::string_literals;
 using glm::vec2;
 
 using namespace constants;
 
+// watched under these names with hot_reload
+static const std::string config_script = "./scripts/config.lua";
+static const std::string prefabs_script = "./scripts/prefabs.lua";
+
 Game::Game()
 {
     registry = std::make_shared<Registry>();
     asset_store = std::make_shared<AssetStore>();
+    asset_loader = std::make_shared<AssetLoader>();
     event_bus = std::make_shared<EventBus>();
+    prefabs = std::make_shared<PrefabRegistry>();
+}
+
+#ifndef USE_LUAJIT
+// the allocator is fixed once a state exists, so a throwaway state reads lua_gc.arena first
+static bool wants_lua_arena()
+{
+    sol::state probe;
+    probe.open_libraries(sol::lib::base);
+    probe.script_file(config_script);
+    sol::optional<bool> arena = probe["config"]["lua_gc"]["arena"];
+    return arena.value_or(false);
 }
+#endif
 
 void Game::init()
 {
-    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::os, sol::lib::math);
-    lua.script_file("./scripts/config.lua");
+#ifdef USE_LUAJIT
+    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::os, sol::lib::math, sol::lib::string,
+                       sol::lib::jit, sol::lib::ffi);
+#else
+    if (wants_lua_arena())
+    {
+        lua = sol::state(sol::default_at_panic, &LuaArena::allocate, &lua_arena);
+    }
+    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::os, sol::lib::math, sol::lib::string);
+#endif
+    lua.script_file(config_script);
     config = lua["config"];
 
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+    // a replay only needs the timer, fonts are still decoded by the asset loader
+    if (SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING) != 0)
     {
         Logger::error("SDL initialization failed."s);
         return;
@@ -42,6 +75,173 @@ void Game::init()
         return;
     }
 
+    sol::optional<sol::table> rewind_config = config["rewind"];
+    if (rewind_config && rewind_config.value()["enabled"].get_or(false))
+    {
+        rewind_buffer = std::make_shared<RewindBuffer>(rewind_config.value()["ticks"].get_or(120));
+    }
+
+    sol::optional<sol::table> world_streaming = config["world_streaming"];
+    if (world_streaming && world_streaming.value()["enabled"].get_or(false))
+    {
+        world_streamer = std::make_shared<WorldStreamer>(registry, asset_loader,
+                                                         world_streaming.value()["chunk_size"].get_or(16),
+                                                         world_streaming.value()["residency_radius"].get_or(1));
+    }
+
+    camera.x = 0;
+    camera.y = 0;
+    if (replaying)
+    {
+        // the camera decides which chunks are streamed in, so it has the size it had while recording
+        camera.w = recording.camera_width;
+        camera.h = recording.camera_height;
+    }
+    else if (headless)
+    {
+        camera.w = window_width;
+        camera.h = window_height;
+    }
+    else if (!create_window())
+    {
+        return;
+    }
+
+    registry->add_system<MovementSystem>();
+    registry->add_system<RenderSystem>();
+    registry->add_system<AnimationSystem>();
+    registry->add_system<CollisionSystem>();
+    registry->add_system<RenderColliderSystem>();
+    registry->add_system<DamageSystem>();
+    registry->add_system<KeyboardControlSystem>();
+    registry->add_system<CameraMovementSystem>();
+    registry->add_system<ProjectileEmitSystem>(prefabs);
+    registry->add_system<ProjectileLifecycleSystem>();
+    registry->add_system<RenderTextSystem>();
+    registry->add_system<RenderHealthSystem>();
+    registry->add_system<RenderGuiSystem>(prefabs);
+    registry->add_system<MouseControlSystem>();
+    registry->add_system<ScriptSystem>();
+    registry->add_system<SpatialIndexSystem>();
+
+    registry->get_system<ScriptSystem>().create_lua_bindings(lua, registry, prefabs);
+    sol::optional<sol::table> workers_config = config["script_workers"];
+    registry->get_system<ScriptSystem>().start_workers(lua, registry, workers_config ? workers_config.value()["states"].get_or(1) : 1);
+    apply_config();
+    sol::optional<sol::table> profiler_config = config["script_profiler"];
+    if (profiler_config && profiler_config.value()["enabled"].get_or(false))
+    {
+        registry->get_system<ScriptSystem>().start_profiling(lua);
+    }
+    registry->get_system<MovementSystem>().subscribe_events(event_bus);
+    registry->get_system<DamageSystem>().subscribe_events(event_bus);
+    registry->get_system<KeyboardControlSystem>().subscribe_events(event_bus);
+    registry->get_system<ProjectileEmitSystem>().subscribe_events(event_bus);
+    sol::optional<sol::table> events_config = config["events"];
+    event_bus->set_queued(events_config && events_config.value()["queued"].get_or(false));
+
+    // prefabs shared by every level, levels can add their own in level.prefabs
+    LevelLoader prefab_loader{registry, asset_store, asset_loader, prefabs};
+    prefab_loader.load_prefabs(lua, prefabs_script);
+    prefab_scripts = prefab_loader.get_scripts();
+
+    sol::optional<sol::table> hot_reload = config["hot_reload"];
+    if (!headless && hot_reload && hot_reload.value()["enabled"].get_or(false))
+    {
+        script_watcher = std::make_shared<FileWatcher>();
+        if (!script_watcher->watch(config_script) || !script_watcher->watch(prefabs_script))
+        {
+            Logger::error("Can't watch the scripts for changes, hot reload is off");
+            script_watcher = nullptr;
+        }
+    }
+
+    running = true;
+}
+
+void Game::apply_config()
+{
+    sol::optional<sol::table> asset_budget = config["asset_budget"];
+    if (asset_budget)
+    {
+        const std::size_t megabyte = 1024 * 1024;
+        asset_store->set_memory_budget(asset_budget.value()["texture_mb"].get_or(0) * megabyte,
+                                       asset_budget.value()["font_mb"].get_or(0) * megabyte);
+    }
+    sol::optional<sol::table> gc_config = config["lua_gc"];
+    registry->get_system<ScriptSystem>().set_gc_budget(lua, gc_config ? gc_config.value()["budget_ms"].get_or(0.0) : 0.0);
+    sol::optional<sol::table> snapshots = config["snapshots"];
+    autosave_interval = snapshots ? snapshots.value()["autosave_interval"].get_or(0) : 0;
+}
+
+void Game::reload_config()
+{
+    sol::load_result script = lua.load_file(config_script);
+    if (!script.valid())
+    {
+        sol::error err = script;
+        Logger::error("Error loading the config script: "s + err.what());
+        return;
+    }
+    try
+    {
+        lua.script_file(config_script);
+    }
+    catch (const sol::error &e)
+    {
+        Logger::error("Error running the config script: "s + e.what());
+        return;
+    }
+    // the level, window and systems were set up from the old table, they change with the next start
+    config = lua["config"];
+    apply_config();
+    Logger::info("Reloaded "s + config_script);
+}
+
+void Game::reload_changed_scripts()
+{
+    ScriptSystem::Rebinding rebinding;
+    bool reloaded = false;
+    for (auto &path : script_watcher->poll())
+    {
+        LevelLoader loader{registry, asset_store, asset_loader, prefabs, world_streamer};
+        if (path == config_script)
+        {
+            reload_config();
+        }
+        else if (path == prefabs_script && loader.reload_prefabs(lua, path, prefab_scripts, rebinding))
+        {
+            Logger::info("Reloaded " + path);
+            reloaded = true;
+        }
+        else if (path == LevelLoader::script_path(level) && loader.reload_scripts(lua, level, level_scripts, rebinding))
+        {
+            Logger::info("Reloaded " + path);
+            reloaded = true;
+            if (auto *workers = registry->get_system<ScriptSystem>().get_workers())
+            {
+                workers->copy_globals();
+            }
+        }
+    }
+    if (!reloaded)
+    {
+        return;
+    }
+    // restarting the level or loading an autosave brings back the new functions, the rewound ticks
+    // would bring back the old ones and are dropped
+    level_start.rebind(rebinding);
+    autosave_base.rebind(rebinding);
+    if (rewind_buffer)
+    {
+        rewind_buffer->clear();
+        recent_inputs.clear();
+    }
+    stop_recording("Scripts reloaded");
+}
+
+bool Game::create_window()
+{
     SDL_DisplayMode displayMode;
     SDL_GetCurrentDisplayMode(0, &displayMode);
 
@@ -52,7 +252,7 @@ void Game::init()
     if (!window)
     {
         Logger::error("Creating SDL window failed."s);
-        return;
+        return false;
     }
 
     std::string window_title = config["title"];
@@ -65,7 +265,7 @@ void Game::init()
     if (!renderer)
     {
         Logger::error("Creating renderer failed."s);
-        return;
+        return false;
     }
 
     // init imgui
@@ -77,8 +277,6 @@ void Game::init()
     ImGui_ImplSDLRenderer_Init(renderer);
 
     // init camera
-    camera.x = 0;
-    camera.y = 0;
     camera.w = displayMode.w;
     camera.h = displayMode.h;
 
@@ -87,61 +285,220 @@ void Game::init()
 
         SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
     }
+    return true;
+}
 
-    registry->add_system<MovementSystem>();
-    registry->add_system<RenderSystem>();
-    registry->add_system<AnimationSystem>();
-    registry->add_system<CollisionSystem>();
-    registry->add_system<RenderColliderSystem>();
-    registry->add_system<DamageSystem>();
-    registry->add_system<KeyboardControlSystem>();
-    registry->add_system<CameraMovementSystem>();
-    registry->add_system<ProjectileEmitSystem>();
-    registry->add_system<ProjectileLifecycleSystem>();
-    registry->add_system<RenderTextSystem>();
-    registry->add_system<RenderHealthSystem>();
-    registry->add_system<RenderGuiSystem>();
-    registry->add_system<MouseControlSystem>();
-    registry->add_system<ScriptSystem>();
+void Game::load_level(int level, bool with_entities)
+{
 
-    registry->get_system<ScriptSystem>().create_lua_bindings(lua);
-    registry->get_system<MovementSystem>().subscribe_events(event_bus);
-    registry->get_system<DamageSystem>().subscribe_events(event_bus);
-    registry->get_system<KeyboardControlSystem>().subscribe_events(event_bus);
-    registry->get_system<ProjectileEmitSystem>().subscribe_events(event_bus);
+    // the previous level's assets stay referenced until the new level holds its own,
+    // so textures shared by both levels are not unloaded and loaded again
+    AssetScope previous_level_assets = std::move(level_assets);
+    level_assets = AssetScope{};
 
-    running = true;
-}
+    LevelLoader level_loader{registry, asset_store, asset_loader, prefabs, world_streamer};
+    level_loader.load(lua, level, level_assets, with_entities);
+    map_size = level_loader.get_map_size();
+    this->level = level;
+    level_scripts = level_loader.get_scripts();
+    if (script_watcher)
+    {
+        script_watcher->watch(LevelLoader::script_path(level));
+    }
 
-void Game::load_level(int level)
-{
+    previous_level_assets.clear();
+    asset_store->collect_unreferenced();
 
-    LevelLoader level_loader{registry, asset_store, renderer};
-    level_loader.load(lua, level);
+    // with async_loading the first frames run while assets stream in, otherwise block here
+    if (!config["async_loading"].get_or(true) && !headless)
+    {
+        asset_loader->wait(renderer, *asset_store);
+    }
 }
 
 void Game::setup()
 {
-    int level = config["level"];
+    // a replay starts from what the recording started from, otherwise the seed is fresh every run
+    int level = replaying ? recording.level : config["level"].get<int>();
+    std::uint32_t seed = replaying ? recording.seed : std::random_device{}();
+    Clock::set(replaying ? recording.start_time : SDL_GetTicks());
+    lua["math"]["randomseed"](seed);
+
+    sol::optional<sol::table> replay_config = config["replay"];
+    if (!replaying && replay_config && replay_config.value()["record"].get_or(false))
+    {
+        record_input = true;
+        recording.clear();
+        recording.level = level;
+        recording.seed = seed;
+        recording.start_time = Clock::now();
+        recording.camera_width = camera.w;
+        recording.camera_height = camera.h;
+    }
+    // chunks finishing on a worker would land on a different tick every run
+    if (world_streamer && (record_input || replaying))
+    {
+        world_streamer->set_synchronous(true);
+    }
+
     load_level(level);
+    if (auto *workers = registry->get_system<ScriptSystem>().get_workers())
+    {
+        workers->seed(seed);
+        workers->copy_globals();
+    }
     Entity label = registry->create_entity();
     SDL_Color color = {0, 255, 0};
     label.add_component<TextComponent>(vec2(window_width / 2 - 40, 10),
                                        "Chopper 1.0", "main-font", color);
+    level_start.capture(*registry);
+
+    // e.g. a crash dump to debug, it has to come from the same level
+    sol::optional<sol::table> snapshots = config["snapshots"];
+    if (snapshots)
+    {
+        sol::optional<std::string> restore_on_start = snapshots.value()["restore_on_start"];
+        if (restore_on_start && !replaying)
+        {
+            load_snapshot(restore_on_start.value());
+        }
+    }
+}
+
+void Game::restart_level()
+{
+    // only the registry goes back, lua globals and script upvalues keep their current values
+    restore_snapshot(level_start);
+}
+
+std::string Game::snapshot_path(const std::string &name) const
+{
+    sol::optional<sol::table> snapshots = config["snapshots"];
+    std::string dir = snapshots ? snapshots.value()["dir"].get_or("./saves"s) : "./saves"s;
+    std::filesystem::create_directories(dir);
+    return dir + "/" + name + ".snap";
+}
+
+void Game::save_snapshot(const std::string &name)
+{
+    Snapshot snapshot;
+    snapshot.capture(*registry);
+    if (snapshot.save(snapshot_path(name), lua))
+    {
+        Logger::info("Saved " + snapshot_path(name));
+    }
+}
+
+void Game::load_snapshot(const std::string &name)
+{
+    Snapshot snapshot;
+    if (!snapshot.load(snapshot_path(name), lua))
+    {
+        Logger::error("Snapshot " + name + " could not be loaded");
+        return;
+    }
+    restore_snapshot(snapshot);
+
+    // autosaves come as a full snapshot plus the changes since it
+    Snapshot changes;
+    if (changes.load(snapshot_path(name + "-delta"), lua) && changes.is_delta())
+    {
+        restore_snapshot(changes);
+    }
+}
+
+void Game::autosave()
+{
+    if (autosave_interval <= 0 || SDL_GetTicks() - last_autosave < autosave_interval)
+    {
+        return;
+    }
+    last_autosave = SDL_GetTicks();
+
+    Snapshot changes;
+    if (!autosave_base.is_empty())
+    {
+        changes.capture_delta(*registry, autosave_base);
+    }
+    // start over from a full snapshot once the changes outgrow half of it
+    if (autosave_base.is_empty() || changes.get_size() > autosave_base.get_size() / 2)
+    {
+        // the old delta goes first, it must never be applied on top of the new base
+        std::error_code error;
+        std::filesystem::remove(snapshot_path("autosave-delta"), error);
+        autosave_base.capture(*registry);
+        autosave_base.save(snapshot_path("autosave"), lua);
+        return;
+    }
+    changes.save(snapshot_path("autosave-delta"), lua);
+}
+
+void Game::restore_snapshot(const Snapshot &snapshot)
+{
+    stop_recording("Snapshot restored");
+    if (rewind_buffer)
+    {
+        rewind_buffer->clear();
+        recent_inputs.clear();
+    }
+    if (snapshot.restore(*registry) && world_streamer)
+    {
+        world_streamer->resync();
+    }
 }
 
 void Game::run()
 {
-    while (running)
+    try
+    {
+        while (running)
+        {
+            process_input();
+            update();
+            render();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        // leave the world behind for debugging, restore_on_start = "crash" loads it back
+        Logger::error("Crashed: "s + e.what());
+        save_snapshot("crash");
+        save_recording();
+        throw;
+    }
+}
+
+void Game::toggle_script_profiling()
+{
+    auto &scripts = registry->get_system<ScriptSystem>();
+    if (!scripts.get_profiler())
     {
-        process_input();
-        update();
-        render();
+        scripts.start_profiling(lua);
+        Logger::info("Script profiling started");
+        return;
+    }
+    sol::optional<sol::table> profiler_config = config["script_profiler"];
+    std::string path = profiler_config ? profiler_config.value()["file"].get_or("./saves/scripts.profile"s)
+                                       : "./saves/scripts.profile"s;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+    if (scripts.get_profiler()->dump(path))
+    {
+        Logger::info("Script profile written to " + path);
     }
+    else
+    {
+        Logger::error("Failed to write script profile " + path);
+    }
+    scripts.stop_profiling();
 }
 
 void Game::destroy()
 {
+    if (registry->get_system<ScriptSystem>().get_profiler())
+    {
+        toggle_script_profiling();
+    }
+    save_recording();
     SDL_DestroyWindow(window);
     SDL_DestroyRenderer(renderer);
     SDL_Quit();
@@ -168,7 +525,7 @@ void Game::process_input()
             running = false;
             break;
         case SDL_KEYDOWN:
-            event_bus->emit<KeyPressedEvent>(sdlEvent.key.keysym.sym);
+            emit_input(InputRecording::InputType::key_pressed, sdlEvent.key.keysym.sym);
             if (sdlEvent.key.keysym.sym == SDLK_SLASH)
             {
                 debug = !debug;
@@ -181,11 +538,42 @@ void Game::process_input()
             {
                 show_gui = !show_gui;
             }
+            if (sdlEvent.key.keysym.sym == SDLK_F6)
+            {
+                toggle_script_profiling();
+            }
+            if (client)
+            {
+                // the server owns the world, restarts, snapshots and rewinds are up to it
+                break;
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_F3 && rewind_buffer && rewind_buffer->size() > 0)
+            {
+                // about a second back, or as far as the buffer goes
+                const std::uint32_t second_ago = current_tick > 61 ? current_tick - 61 : 0;
+                rewind(std::max(rewind_buffer->get_oldest_tick(), second_ago));
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_F4 && rewind_buffer)
+            {
+                rollback_check_requested = true;
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_F2)
+            {
+                restart_level();
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_F5)
+            {
+                save_snapshot("quicksave");
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_F9)
+            {
+                load_snapshot("quicksave");
+            }
             break;
         case SDL_MOUSEBUTTONDOWN:
             if (sdlEvent.button.button == SDL_BUTTON_LEFT)
             {
-                event_bus->emit<MouseClickedEvent>(sdlEvent.button.button);
+                emit_input(InputRecording::InputType::mouse_clicked, sdlEvent.button.button);
             }
         }
     }
@@ -197,36 +585,326 @@ void Game::update()
     auto time_to_wait = constants::TICKS_PER_FRAME - (current_ticks - cum_ticks);
     // delta time
     float dt = (current_ticks - cum_ticks) / 1000.0f;
+
+    if (script_watcher)
+    {
+        reload_changed_scripts();
+    }
+
+    // upload whatever the loader finished, a few textures per frame to keep frames short
+    if (!asset_loader->is_done())
+    {
+        asset_loader->poll(renderer, *asset_store, 4);
+    }
+
+    tick(current_ticks, dt);
+    if (record_input)
+    {
+        recording.ticks.push_back({current_ticks, dt, Snapshot::hash(*registry)});
+    }
+    if (rollback_check_requested)
+    {
+        // after the tick, so the key press is part of the inputs that get replayed
+        rollback_check_requested = false;
+        check_rollback();
+    }
+    autosave();
+
+    if (time_to_wait > 0 && time_to_wait < constants::TICKS_PER_FRAME)
+    {
+        SDL_Delay(time_to_wait);
+    }
+
+    cum_ticks = SDL_GetTicks();
+}
+
+void Game::tick(std::uint32_t time, float dt)
+{
+    Clock::set(time);
     registry->update();
+    // events are handled at these sync points when they are queued: input, collisions and scripts
+    event_bus->dispatch_queued();
 
-    registry->get_system<MovementSystem>().update(dt);
+    registry->get_system<MovementSystem>().update(dt, map_size);
     registry->get_system<AnimationSystem>().update();
     registry->get_system<CollisionSystem>().update(event_bus);
+    event_bus->dispatch_queued();
     registry->get_system<DamageSystem>().update();
-    registry->get_system<CameraMovementSystem>().update(camera);
+    registry->get_system<CameraMovementSystem>().update(camera, map_size);
+    if (world_streamer)
+    {
+        world_streamer->update(camera);
+    }
     registry->get_system<ProjectileEmitSystem>().update(registry);
     registry->get_system<ProjectileLifecycleSystem>().update();
-    registry->get_system<ScriptSystem>().update(dt, SDL_GetTicks());
+    registry->get_system<ScriptSystem>().update(registry, dt, Clock::now());
+    event_bus->dispatch_queued();
+    registry->get_system<SpatialIndexSystem>().update(*registry);
+    registry->get_system<ScriptSystem>().collect_garbage();
+    if (rewind_buffer)
+    {
+        rewind_buffer->record(*registry, current_tick, time, dt);
+        const std::uint32_t oldest = rewind_buffer->get_oldest_tick();
+        std::erase_if(recent_inputs, [oldest](const InputRecording::Input &input)
+                      { return input.tick < oldest; });
+    }
+    current_tick++;
+}
 
-    if (time_to_wait > 0 && time_to_wait < constants::TICKS_PER_FRAME)
+bool Game::rewind(std::uint32_t tick)
+{
+    if (!rewind_buffer || !rewind_buffer->rewind(*registry, tick))
     {
-        SDL_Delay(time_to_wait);
+        return false;
+    }
+    stop_recording("Rewound");
+    if (world_streamer)
+    {
+        world_streamer->resync();
     }
+    current_tick = tick + 1;
+    std::erase_if(recent_inputs, [tick](const InputRecording::Input &input)
+                  { return input.tick > tick; });
+    return true;
+}
 
-    cum_ticks = SDL_GetTicks();
+bool Game::rollback(std::uint32_t tick)
+{
+    if (!rewind_buffer || !rewind_buffer->contains(tick))
+    {
+        return false;
+    }
+    const auto timings = rewind_buffer->get_timings_after(tick);
+    const auto inputs = recent_inputs;
+    rewind(tick);
+
+    auto next_input = inputs.begin();
+    for (const auto &timing : timings)
+    {
+        for (; next_input != inputs.end() && next_input->tick <= timing.tick; ++next_input)
+        {
+            if (next_input->tick == timing.tick)
+            {
+                emit_input(next_input->type, next_input->code, next_input->entity_id);
+            }
+        }
+        this->tick(timing.time, timing.dt);
+    }
+    return true;
+}
+
+void Game::check_rollback()
+{
+    if (!rewind_buffer || rewind_buffer->size() == 0)
+    {
+        return;
+    }
+    const std::uint64_t expected = Snapshot::hash(*registry);
+    const std::uint32_t second_ago = current_tick > 61 ? current_tick - 61 : 0;
+    const std::uint32_t tick = std::max(rewind_buffer->get_oldest_tick(), second_ago);
+    if (!rollback(tick))
+    {
+        return;
+    }
+    if (Snapshot::hash(*registry) == expected)
+    {
+        Logger::info("Rollback to tick " + std::to_string(tick) + " re-simulated to the same state");
+    }
+    else
+    {
+        Logger::error("Rollback to tick " + std::to_string(tick) + " diverged, the simulation isn't deterministic");
+    }
+}
+
+void Game::emit_input(InputRecording::InputType type, std::int32_t code, std::int32_t entity_id)
+{
+    if (client)
+    {
+        client->queue_input(type, code);
+        return;
+    }
+    if (record_input)
+    {
+        recording.inputs.push_back({current_tick, type, code, entity_id});
+    }
+    if (rewind_buffer)
+    {
+        recent_inputs.push_back({current_tick, type, code, entity_id});
+    }
+    switch (type)
+    {
+    case InputRecording::InputType::key_pressed:
+        event_bus->emit<KeyPressedEvent>(code, entity_id);
+        break;
+    case InputRecording::InputType::mouse_clicked:
+        event_bus->emit<MouseClickedEvent>(code, entity_id);
+        break;
+    }
+}
+
+void Game::stop_recording(const std::string &reason)
+{
+    if (record_input)
+    {
+        // the input so far no longer leads to the current state
+        Logger::info(reason + ", input recording stopped at tick " + std::to_string(current_tick));
+        record_input = false;
+    }
+}
+
+void Game::save_recording()
+{
+    sol::optional<sol::table> replay_config = config["replay"];
+    if (recording.ticks.empty() || replaying || !replay_config)
+    {
+        return;
+    }
+    std::string path = replay_config.value()["file"].get_or("./saves/last.replay"s);
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    if (recording.save(path))
+    {
+        Logger::info("Saved " + std::to_string(recording.ticks.size()) + " ticks of input to " + path);
+    }
+    else
+    {
+        Logger::error("Failed to save input recording " + path);
+    }
+}
+
+bool Game::replay(const std::string &path)
+{
+    if (!recording.load(path))
+    {
+        Logger::error("Failed to load input recording " + path);
+        return false;
+    }
+    headless = true;
+    replaying = true;
+    init();
+    if (!running)
+    {
+        return false;
+    }
+    setup();
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t next_input = 0;
+    for (std::uint32_t i = 0; i < recording.ticks.size(); i++)
+    {
+        while (next_input < recording.inputs.size() && recording.inputs[next_input].tick <= i)
+        {
+            const auto &input = recording.inputs[next_input];
+            emit_input(input.type, input.code, input.entity_id);
+            next_input++;
+        }
+        const auto &recorded = recording.ticks[i];
+        tick(recorded.time, recorded.dt);
+        if (Snapshot::hash(*registry) != recorded.state_hash)
+        {
+            Logger::error("Replay diverged at tick " + std::to_string(i) + " of " + std::to_string(recording.ticks.size()));
+            return false;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    Logger::info("Replay matched " + std::to_string(recording.ticks.size()) + " ticks in " +
+                 std::to_string(elapsed.count()) + " ms");
+    return true;
+}
+
+bool Game::bench_scripts(int count)
+{
+    headless = true;
+    init();
+    if (!running)
+    {
+        return false;
+    }
+    lua.script_file("./scripts/script_bench.lua");
+    sol::table bench = lua["script_bench"];
+    const int frames = 600;
+
+    // ms per frame for count entities running the variant's script
+    auto run_variant = [&](const std::string &variant, bool sandboxed)
+    {
+        sol::function fun = bench[variant];
+        registry->create_many<TransformComponent, RigidBodyComponent, ProjectileEmitterComponent, ScriptComponent>(
+            count,
+            [&](int i, Entity entity, TransformComponent &transform, RigidBodyComponent &rigid_body,
+                ProjectileEmitterComponent &emitter, ScriptComponent &script)
+            {
+                transform.position = vec2(i * 40 % 4000, 10 + i % 1980);
+                rigid_body.velocity = vec2(0, i % 2 ? 50 : -50);
+                script = ScriptComponent(fun, false, sandboxed);
+            });
+        registry->update();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            registry->get_system<ScriptSystem>().update(registry, 1.0 / 60, frame * 16);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        for (auto entity : registry->get_system<ScriptSystem>().entities())
+        {
+            entity.kill();
+        }
+        registry->update();
+        return elapsed.count() / frames;
+    };
+
+    const std::string states = std::to_string(registry->get_system<ScriptSystem>().get_workers()->get_state_count());
+    std::string result = "Script bench, " + std::to_string(count) + " entities: sol2 bindings " +
+                         std::to_string(run_variant("bindings", false)) + " ms per frame, components by reference " +
+                         std::to_string(run_variant("components", false)) + " ms per frame, sandboxed in " + states +
+                         " states " + std::to_string(run_variant("bindings", true)) + " ms per frame; crowd steering " +
+                         std::to_string(run_variant("crowd", false)) + " ms per frame, sandboxed " +
+                         std::to_string(run_variant("crowd", true)) + " ms per frame";
+#ifdef USE_LUAJIT
+    result += ", ffi " + std::to_string(run_variant("ffi", false)) + " ms per frame";
+#else
+    result += ", ffi needs a luajit build (cmake -DUSE_LUAJIT=ON)";
+#endif
+    Logger::info(result);
+    return true;
+}
+
+void Game::render_loading_screen()
+{
+    const int bar_width = window_width / 3;
+    const int bar_height = 12;
+    SDL_Rect outline = {(window_width - bar_width) / 2, (window_height - bar_height) / 2, bar_width, bar_height};
+    SDL_Rect bar = {outline.x, outline.y, static_cast<int>(bar_width * asset_loader->progress()), bar_height};
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
+    SDL_RenderFillRect(renderer, &bar);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderDrawRect(renderer, &outline);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderPresent(renderer);
 }
 
 void Game::render()
 {
+    if (!asset_loader->is_done())
+    {
+        render_loading_screen();
+        return;
+    }
+
     SDL_RenderClear(renderer);
-    registry->get_system<RenderSystem>().update(renderer, asset_store, camera);
+    const auto &spatial_index = registry->get_system<SpatialIndexSystem>();
+    registry->get_system<RenderSystem>().update(renderer, asset_store, camera, spatial_index);
     registry->get_system<RenderTextSystem>().update(renderer, asset_store,
                                                     camera);
     registry->get_system<RenderHealthSystem>().update(renderer, asset_store,
-                                                      camera);
+                                                      camera, spatial_index);
     if (debug)
     {
-        registry->get_system<RenderColliderSystem>().update(renderer, camera);
+        registry->get_system<RenderColliderSystem>().update(renderer, camera, spatial_index);
     }
     if (show_gui)
     {
@@ -234,3 +912,191 @@ void Game::render()
     }
     SDL_RenderPresent(renderer);
 }
+
+template <typename... TComponents>
+static void copy_components(const Entity &entity, Prefab &prefab)
+{
+    ((entity.has_component<TComponents>() ? prefab.add(entity.read_component<TComponents>()) : void()), ...);
+}
+
+// the level's player as a bundle to stamp out for clients, without the camera following it
+static Prefab player_prefab(const Entity &player)
+{
+    Prefab prefab;
+    copy_components<TransformComponent, RigidBodyComponent, SprintComponent, SpriteComponent, AnimationComponent,
+                    BoxColliderComponent, HealthComponent, ProjectileEmitterComponent, KeyboardControlComponent,
+                    MouseControlComponent>(player, prefab);
+    return prefab;
+}
+
+bool Game::serve(int seconds)
+{
+    headless = true;
+    init();
+    if (!running)
+    {
+        return false;
+    }
+    // every client looks at another part of the map, so the whole level stays resident
+    world_streamer.reset();
+
+    sol::optional<sol::table> network = config["network"];
+    const int port = network ? network.value()["port"].get_or(7777) : 7777;
+    server = std::make_shared<ReplicationServer>(registry, network ? network.value()["timeout"].get_or(2000) : 2000);
+    if (!server->open(port))
+    {
+        Logger::error("Can't listen on port " + std::to_string(port));
+        return false;
+    }
+    setup();
+    // every client drives a copy of the level's player, the original stays where the level put it
+    if (registry->has_entity_with_tag("player"))
+    {
+        server->set_player(player_prefab(registry->get_entity_by_tag("player")));
+    }
+    Logger::info("Serving on port " + std::to_string(port));
+
+    std::vector<InputRecording::Input> inputs;
+    const std::uint32_t start = SDL_GetTicks();
+    cum_ticks = start;
+    // reported every few seconds: average cost of a server tick and bytes per second per client
+    std::uint32_t report_start = start;
+    std::uint32_t report_ticks = 0;
+    std::uint64_t report_client_ticks = 0;
+    std::uint64_t report_bytes = 0;
+    double report_tick_ms = 0;
+    while (seconds == 0 || SDL_GetTicks() - start < seconds * 1000u)
+    {
+        auto current_ticks = SDL_GetTicks();
+        float dt = (current_ticks - cum_ticks) / 1000.0f;
+        cum_ticks = current_ticks;
+
+        auto tick_start = std::chrono::steady_clock::now();
+        inputs.clear();
+        server->receive(current_ticks, inputs);
+        for (const auto &input : inputs)
+        {
+            emit_input(input.type, input.code, input.entity_id);
+        }
+        tick(current_ticks, dt);
+        server->send(current_tick);
+        report_tick_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick_start).count();
+        report_ticks++;
+        report_client_ticks += server->get_client_count();
+
+        if (current_ticks - report_start >= 5000)
+        {
+            const double elapsed = (current_ticks - report_start) / 1000.0;
+            const double clients = static_cast<double>(report_client_ticks) / report_ticks;
+            const std::uint64_t bytes = server->get_bytes_sent() - report_bytes;
+            const int per_client = clients > 0 ? static_cast<int>(bytes / clients / elapsed) : 0;
+            Logger::info("Serving " + std::to_string(server->get_client_count()) + " clients, " +
+                         std::to_string(static_cast<int>(report_tick_ms * 1000 / report_ticks)) + " us per tick, " +
+                         std::to_string(per_client) + " bytes/s per client");
+            report_start = current_ticks;
+            report_ticks = 0;
+            report_client_ticks = 0;
+            report_bytes = server->get_bytes_sent();
+            report_tick_ms = 0;
+        }
+
+        auto time_to_wait = constants::TICKS_PER_FRAME - static_cast<int>(SDL_GetTicks() - current_ticks);
+        if (time_to_wait > 0)
+        {
+            SDL_Delay(time_to_wait);
+        }
+    }
+    return true;
+}
+
+bool Game::join(bool headless_client)
+{
+    headless = headless_client;
+    init();
+    if (!running)
+    {
+        return false;
+    }
+    world_streamer.reset();
+
+    sol::optional<sol::table> network = config["network"];
+    const int port = network ? network.value()["port"].get_or(7777) : 7777;
+    const int timeout = network ? network.value()["timeout"].get_or(2000) : 2000;
+    client = std::make_shared<ReplicationClient>(registry);
+    if (!client->connect(port))
+    {
+        Logger::error("Can't open a socket to join port " + std::to_string(port));
+        return false;
+    }
+    int level = config["level"];
+    load_level(level, false);
+    Logger::info("Joining the server on port " + std::to_string(port));
+
+    // a headless client pans its camera across the map so every client asks for a different part of it
+    std::mt19937 random(std::random_device{}());
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vec2 position(unit(random) * std::max(0.0f, map_size.x - camera.w), unit(random) * std::max(0.0f, map_size.y - camera.h));
+    const float angle = unit(random) * 6.2831853f;
+    vec2 velocity(std::cos(angle) * 150, std::sin(angle) * 150);
+
+    const std::uint32_t start = SDL_GetTicks();
+    cum_ticks = start;
+    while (running)
+    {
+        auto current_ticks = SDL_GetTicks();
+        float dt = (current_ticks - cum_ticks) / 1000.0f;
+        cum_ticks = current_ticks;
+
+        if (!headless)
+        {
+            process_input();
+        }
+        if (!client->receive(current_ticks, timeout))
+        {
+            Logger::error("The server stopped answering");
+            break;
+        }
+        registry->update();
+        if (headless)
+        {
+            position += velocity * dt;
+            const vec2 limit(std::max(0.0f, map_size.x - camera.w), std::max(0.0f, map_size.y - camera.h));
+            for (int axis = 0; axis < 2; axis++)
+            {
+                if (position[axis] < 0 || position[axis] > limit[axis])
+                {
+                    position[axis] = std::clamp(position[axis], 0.0f, limit[axis]);
+                    velocity[axis] = -velocity[axis];
+                }
+            }
+            camera.x = position.x;
+            camera.y = position.y;
+        }
+        else
+        {
+            if (!asset_loader->is_done())
+            {
+                asset_loader->poll(renderer, *asset_store, 4);
+            }
+            registry->get_system<CameraMovementSystem>().update(camera, map_size);
+        }
+        registry->get_system<SpatialIndexSystem>().update(*registry);
+        client->send(camera);
+        if (!headless)
+        {
+            render();
+        }
+
+        auto time_to_wait = constants::TICKS_PER_FRAME - static_cast<int>(SDL_GetTicks() - current_ticks);
+        if (time_to_wait > 0)
+        {
+            SDL_Delay(time_to_wait);
+        }
+    }
+    client->disconnect();
+
+    const double elapsed = std::max(1u, SDL_GetTicks() - start) / 1000.0;
+    Logger::info("Received " + std::to_string(client->get_bytes_received()) + " bytes, " +
+                 std::to_string(static_cast<int>(client->get_bytes_received() / elapsed)) + " bytes/s");
+    return true;
+}
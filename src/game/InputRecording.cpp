@@ -0,0 +1,87 @@
+#include "InputRecording.hpp"
+#include "MappedFile.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::int32_t level;
+        std::uint32_t seed;
+        std::uint32_t start_time;
+        std::int32_t camera_width;
+        std::int32_t camera_height;
+        std::uint32_t reserved;
+        std::uint64_t tick_count;
+        std::uint64_t input_count;
+    };
+}
+
+bool InputRecording::save(const std::string &path) const
+{
+    FileHeader header{magic, version, level, seed, start_time, camera_width, camera_height, 0, ticks.size(), inputs.size()};
+
+    // write next to the target and rename so a crash while saving keeps the previous recording
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(ticks.data()), ticks.size() * sizeof(Tick));
+    file.write(reinterpret_cast<const char *>(inputs.data()), inputs.size() * sizeof(Input));
+    file.close();
+    if (!file)
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    return !error;
+}
+
+bool InputRecording::load(const std::string &path)
+{
+    clear();
+    MappedFile file(path);
+    FileHeader header;
+    if (!file.get_data() || file.get_size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, file.get_data(), sizeof(header));
+    const std::size_t body_size = file.get_size() - sizeof(header);
+    // counts are compared against what fits before multiplying, a corrupt count can't overflow the check
+    if (header.magic != magic || header.version != version ||
+        header.tick_count > body_size / sizeof(Tick))
+    {
+        return false;
+    }
+    const std::size_t inputs_size = body_size - header.tick_count * sizeof(Tick);
+    if (header.input_count > inputs_size / sizeof(Input) || header.input_count * sizeof(Input) != inputs_size)
+    {
+        return false;
+    }
+
+    level = header.level;
+    seed = header.seed;
+    start_time = header.start_time;
+    camera_width = header.camera_width;
+    camera_height = header.camera_height;
+    ticks.resize(header.tick_count);
+    inputs.resize(header.input_count);
+    const char *data = file.get_data() + sizeof(header);
+    std::memcpy(ticks.data(), data, ticks.size() * sizeof(Tick));
+    std::memcpy(inputs.data(), data + ticks.size() * sizeof(Tick), inputs.size() * sizeof(Input));
+    return true;
+}
+
+void InputRecording::clear()
+{
+    *this = InputRecording();
+}
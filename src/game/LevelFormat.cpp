@@ -0,0 +1,614 @@
+#include "LevelFormat.hpp"
+#include "MappedFile.hpp"
+#include <Logger.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    enum class Section : std::uint32_t
+    {
+        strings,
+        sources,
+        assets,
+        globals,
+        entities,
+        prefabs,
+        tilemap,
+        tiles,
+        transforms,
+        rigid_bodies,
+        sprints,
+        sprites,
+        animations,
+        box_colliders,
+        healths,
+        projectile_emitters,
+        projectiles,
+        camera_follows,
+        keyboard_controls,
+        mouse_controls,
+        scripts,
+        group_scripts,
+        preludes,
+        count
+    };
+
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t section_count;
+        std::uint32_t reserved;
+    };
+
+    struct SectionHeader
+    {
+        std::uint32_t id;
+        std::uint32_t count;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    // validated section table of a mapped compiled level
+    class SectionReader
+    {
+    private:
+        const MappedFile &file;
+        std::vector<SectionHeader> sections;
+
+    public:
+        SectionReader(const MappedFile &file) : file(file) {}
+
+        bool read_header()
+        {
+            if (file.get_size() < sizeof(FileHeader))
+            {
+                return false;
+            }
+            FileHeader header;
+            std::memcpy(&header, file.get_data(), sizeof(header));
+            if (header.magic != CompiledLevel::magic || header.version != CompiledLevel::version)
+            {
+                return false;
+            }
+            std::size_t table_end = sizeof(FileHeader) + header.section_count * sizeof(SectionHeader);
+            if (table_end > file.get_size())
+            {
+                return false;
+            }
+            sections.resize(header.section_count);
+            std::memcpy(sections.data(), file.get_data() + sizeof(FileHeader), header.section_count * sizeof(SectionHeader));
+            for (auto &section : sections)
+            {
+                if (section.offset > file.get_size() || section.size > file.get_size() - section.offset)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const SectionHeader *find(Section id) const
+        {
+            for (auto &section : sections)
+            {
+                if (section.id == static_cast<std::uint32_t>(id))
+                {
+                    return &section;
+                }
+            }
+            return nullptr;
+        }
+
+        template <typename TRecord>
+        bool read_array(Section id, std::vector<TRecord> &out) const
+        {
+            out.clear();
+            const SectionHeader *section = find(id);
+            if (!section)
+            {
+                return true;
+            }
+            if (section->size != section->count * sizeof(TRecord))
+            {
+                return false;
+            }
+            out.resize(section->count);
+            std::memcpy(out.data(), file.get_data() + section->offset, section->size);
+            return true;
+        }
+
+        template <typename TRecord>
+        bool read_components(Section id, ComponentRecords<TRecord> &out) const
+        {
+            out.entities.clear();
+            out.records.clear();
+            const SectionHeader *section = find(id);
+            if (!section)
+            {
+                return true;
+            }
+            const std::size_t entities_size = section->count * sizeof(std::uint32_t);
+            if (section->size != entities_size + section->count * sizeof(TRecord))
+            {
+                return false;
+            }
+            out.entities.resize(section->count);
+            out.records.resize(section->count);
+            const char *data = file.get_data() + section->offset;
+            std::memcpy(out.entities.data(), data, entities_size);
+            std::memcpy(out.records.data(), data + entities_size, section->count * sizeof(TRecord));
+            return true;
+        }
+
+        bool read_strings(std::vector<std::string> &out) const
+        {
+            out.clear();
+            const SectionHeader *section = find(Section::strings);
+            if (!section)
+            {
+                return true;
+            }
+            const std::size_t lengths_size = section->count * sizeof(std::uint32_t);
+            if (section->size < lengths_size)
+            {
+                return false;
+            }
+            std::vector<std::uint32_t> lengths(section->count);
+            std::memcpy(lengths.data(), file.get_data() + section->offset, lengths_size);
+            std::size_t position = lengths_size;
+            out.reserve(section->count);
+            for (auto length : lengths)
+            {
+                if (length > section->size - position)
+                {
+                    return false;
+                }
+                out.emplace_back(file.get_data() + section->offset + position, length);
+                position += length;
+            }
+            return true;
+        }
+    };
+
+    // appends sections to an in-memory file image
+    class SectionWriter
+    {
+    private:
+        std::vector<SectionHeader> sections;
+        std::vector<char> data;
+
+        void append(const void *bytes, std::size_t size)
+        {
+            const char *begin = static_cast<const char *>(bytes);
+            data.insert(data.end(), begin, begin + size);
+        }
+
+        void begin_section(Section id, std::size_t count)
+        {
+            // keep every section 8 byte aligned inside the file
+            data.resize((data.size() + 7) & ~std::size_t{7});
+            sections.push_back({static_cast<std::uint32_t>(id), static_cast<std::uint32_t>(count), data.size(), 0});
+        }
+
+        void end_section()
+        {
+            sections.back().size = data.size() - sections.back().offset;
+        }
+
+    public:
+        template <typename TRecord>
+        void write_array(Section id, const std::vector<TRecord> &records)
+        {
+            begin_section(id, records.size());
+            append(records.data(), records.size() * sizeof(TRecord));
+            end_section();
+        }
+
+        template <typename TRecord>
+        void write_components(Section id, const ComponentRecords<TRecord> &components)
+        {
+            if (components.records.empty())
+            {
+                return;
+            }
+            begin_section(id, components.records.size());
+            append(components.entities.data(), components.entities.size() * sizeof(std::uint32_t));
+            append(components.records.data(), components.records.size() * sizeof(TRecord));
+            end_section();
+        }
+
+        void write_strings(const std::vector<std::string> &strings)
+        {
+            begin_section(Section::strings, strings.size());
+            for (auto &value : strings)
+            {
+                std::uint32_t length = value.size();
+                append(&length, sizeof(length));
+            }
+            for (auto &value : strings)
+            {
+                append(value.data(), value.size());
+            }
+            end_section();
+        }
+
+        bool save(const std::string &path) const
+        {
+            FileHeader header{CompiledLevel::magic, CompiledLevel::version, static_cast<std::uint32_t>(sections.size()), 0};
+            std::vector<SectionHeader> table = sections;
+            const std::size_t data_offset = sizeof(FileHeader) + table.size() * sizeof(SectionHeader);
+            for (auto &section : table)
+            {
+                section.offset += data_offset;
+            }
+
+            // write next to the target and rename so a running game never maps a half written file
+            std::string temp_path = path + ".tmp";
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                return false;
+            }
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(SectionHeader));
+            file.write(data.data(), data.size());
+            file.close();
+            if (!file)
+            {
+                return false;
+            }
+            std::error_code error;
+            fs::rename(temp_path, path, error);
+            return !error;
+        }
+    };
+
+    std::int64_t modified_time(const std::string &path)
+    {
+        std::error_code error;
+        auto time = fs::last_write_time(path, error);
+        return error ? -1 : static_cast<std::int64_t>(time.time_since_epoch().count());
+    }
+
+    bool sources_up_to_date(const std::vector<SourceRecord> &sources, const std::vector<std::string> &strings)
+    {
+        for (auto &source : sources)
+        {
+            if (source.path >= strings.size() || modified_time(strings[source.path]) != source.modified_time)
+            {
+                return false;
+            }
+        }
+        return !sources.empty();
+    }
+
+    // tag, group and prefab of an entity record use -1 for none
+    bool is_string(std::int64_t index, const LevelData &level, bool optional = false)
+    {
+        return (optional && index == -1) || (index >= 0 && index < static_cast<std::int64_t>(level.strings.size()));
+    }
+
+    template <typename TRecord>
+    bool entities_valid(const ComponentRecords<TRecord> &components, const LevelData &level)
+    {
+        for (auto entity : components.entities)
+        {
+            if (entity >= level.entities.size())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // every index into the string table or the entity list, the loader uses them unchecked
+    bool indices_valid(const LevelData &level)
+    {
+        for (auto &entity : level.entities)
+        {
+            if (!is_string(entity.tag, level, true) || !is_string(entity.group, level, true) ||
+                !is_string(entity.prefab, level, true))
+            {
+                return false;
+            }
+        }
+        for (auto &prefab : level.prefabs)
+        {
+            if (!is_string(prefab.name, level) || prefab.entity >= level.entities.size())
+            {
+                return false;
+            }
+        }
+        for (auto &asset : level.assets)
+        {
+            if (!is_string(asset.id, level) || !is_string(asset.file, level))
+            {
+                return false;
+            }
+        }
+        for (auto &global : level.globals)
+        {
+            if (!is_string(global.name, level) || (global.type == 1 && !is_string(global.string, level)))
+            {
+                return false;
+            }
+        }
+        for (auto &sprite : level.sprites.records)
+        {
+            if (!is_string(sprite.asset_name, level))
+            {
+                return false;
+            }
+        }
+        for (auto &script : level.scripts.records)
+        {
+            if (!is_string(script.bytecode, level))
+            {
+                return false;
+            }
+        }
+        for (auto &script : level.group_scripts)
+        {
+            if (!is_string(script.group, level) || !is_string(script.bytecode, level))
+            {
+                return false;
+            }
+        }
+        for (auto &prelude : level.preludes)
+        {
+            if (!is_string(prelude.bytecode, level))
+            {
+                return false;
+            }
+        }
+        return is_string(level.tilemap.texture, level) &&
+               entities_valid(level.transforms, level) &&
+               entities_valid(level.rigid_bodies, level) &&
+               entities_valid(level.sprints, level) &&
+               entities_valid(level.sprites, level) &&
+               entities_valid(level.animations, level) &&
+               entities_valid(level.box_colliders, level) &&
+               entities_valid(level.healths, level) &&
+               entities_valid(level.projectile_emitters, level) &&
+               entities_valid(level.projectiles, level) &&
+               entities_valid(level.camera_follows, level) &&
+               entities_valid(level.keyboard_controls, level) &&
+               entities_valid(level.mouse_controls, level) &&
+               entities_valid(level.scripts, level);
+    }
+}
+
+std::uint32_t LevelData::intern(const std::string &value)
+{
+    auto it = string_ids.find(value);
+    if (it != string_ids.end())
+    {
+        return it->second;
+    }
+    std::uint32_t id = strings.size();
+    strings.push_back(value);
+    string_ids.emplace(value, id);
+    return id;
+}
+
+std::uint32_t LevelData::add_entity(const std::string &tag, const std::string &group, const std::string &prefab)
+{
+    entities.push_back({tag.empty() ? -1 : static_cast<std::int32_t>(intern(tag)),
+                        group.empty() ? -1 : static_cast<std::int32_t>(intern(group)),
+                        prefab.empty() ? -1 : static_cast<std::int32_t>(intern(prefab))});
+    return entities.size() - 1;
+}
+
+void LevelData::add_source(const std::string &path)
+{
+    sources.push_back({intern(path), modified_time(path)});
+}
+
+void LevelData::clear()
+{
+    *this = LevelData();
+}
+
+// the name of the first upvalue string.dump would drop, null when there is none. _ENV is set again by load
+static const char *captured_upvalue(const sol::function &fun)
+{
+    lua_State *state = fun.lua_state();
+    fun.push();
+    const char *captured = nullptr;
+    for (int i = 1; const char *name = lua_getupvalue(state, -1, i); i++)
+    {
+        lua_pop(state, 1);
+        if (std::strcmp(name, "_ENV") != 0)
+        {
+            captured = name;
+            break;
+        }
+    }
+    lua_pop(state, 1);
+    return captured;
+}
+
+static bool refuse(const std::string &path, const std::string &reason)
+{
+    // an older binary would otherwise be picked up again once the sources look unchanged
+    std::error_code ec;
+    fs::remove(path, ec);
+    Logger::info(reason + ", " + path + " was not written and the level keeps loading from lua");
+    return false;
+}
+
+bool CompiledLevel::save(const std::string &path, LevelData &level, sol::state &lua)
+{
+    if (!level.not_compilable.empty())
+    {
+        return refuse(path, level.not_compilable);
+    }
+    for (const auto *functions : {&level.script_functions, &level.group_script_functions, &level.prelude_functions})
+    {
+        for (const auto &fun : *functions)
+        {
+            if (const char *name = captured_upvalue(fun))
+            {
+                return refuse(path, "A level script captures the local " + std::string(name) +
+                                        ", which its compiled bytecode would lose");
+            }
+        }
+    }
+
+    sol::protected_function dump = lua["string"]["dump"];
+    for (std::size_t i = 0; i < level.scripts.records.size(); i++)
+    {
+        sol::protected_function_result bytecode = dump(level.script_functions[i]);
+        if (!bytecode.valid())
+        {
+            Logger::error("Failed to dump a level script, " + path + " was not written");
+            return false;
+        }
+        level.scripts.records[i].bytecode = level.intern(bytecode.get<std::string>());
+    }
+    for (std::size_t i = 0; i < level.group_scripts.size(); i++)
+    {
+        sol::protected_function_result bytecode = dump(level.group_script_functions[i]);
+        if (!bytecode.valid())
+        {
+            Logger::error("Failed to dump a level group script, " + path + " was not written");
+            return false;
+        }
+        level.group_scripts[i].bytecode = level.intern(bytecode.get<std::string>());
+    }
+    for (std::size_t i = 0; i < level.preludes.size(); i++)
+    {
+        sol::protected_function_result bytecode = dump(level.prelude_functions[i]);
+        if (!bytecode.valid())
+        {
+            Logger::error("Failed to dump the level prelude, " + path + " was not written");
+            return false;
+        }
+        level.preludes[i].bytecode = level.intern(bytecode.get<std::string>());
+    }
+
+    SectionWriter writer;
+    writer.write_strings(level.strings);
+    writer.write_array(Section::sources, level.sources);
+    writer.write_array(Section::assets, level.assets);
+    writer.write_array(Section::globals, level.globals);
+    writer.write_array(Section::entities, level.entities);
+    writer.write_array(Section::prefabs, level.prefabs);
+    writer.write_array(Section::tilemap, std::vector<TilemapRecord>{level.tilemap});
+    writer.write_array(Section::tiles, level.tiles);
+    writer.write_components(Section::transforms, level.transforms);
+    writer.write_components(Section::rigid_bodies, level.rigid_bodies);
+    writer.write_components(Section::sprints, level.sprints);
+    writer.write_components(Section::sprites, level.sprites);
+    writer.write_components(Section::animations, level.animations);
+    writer.write_components(Section::box_colliders, level.box_colliders);
+    writer.write_components(Section::healths, level.healths);
+    writer.write_components(Section::projectile_emitters, level.projectile_emitters);
+    writer.write_components(Section::projectiles, level.projectiles);
+    writer.write_components(Section::camera_follows, level.camera_follows);
+    writer.write_components(Section::keyboard_controls, level.keyboard_controls);
+    writer.write_components(Section::mouse_controls, level.mouse_controls);
+    writer.write_components(Section::scripts, level.scripts);
+    writer.write_array(Section::group_scripts, level.group_scripts);
+    writer.write_array(Section::preludes, level.preludes);
+
+    if (!writer.save(path))
+    {
+        Logger::error("Failed to write compiled level " + path);
+        return false;
+    }
+    Logger::info("Compiled level written to " + path);
+    return true;
+}
+
+bool CompiledLevel::load(const std::string &path, LevelData &level, sol::state &lua)
+{
+    level.clear();
+    MappedFile file(path);
+    SectionReader reader(file);
+    if (!file.get_data() || !reader.read_header())
+    {
+        return false;
+    }
+
+    std::vector<TilemapRecord> tilemap;
+    bool valid = reader.read_strings(level.strings) &&
+                 reader.read_array(Section::sources, level.sources) &&
+                 sources_up_to_date(level.sources, level.strings) &&
+                 reader.read_array(Section::assets, level.assets) &&
+                 reader.read_array(Section::globals, level.globals) &&
+                 reader.read_array(Section::entities, level.entities) &&
+                 reader.read_array(Section::prefabs, level.prefabs) &&
+                 reader.read_array(Section::tilemap, tilemap) && tilemap.size() == 1 &&
+                 tilemap[0].rows >= 0 && tilemap[0].cols >= 0 &&
+                 reader.read_array(Section::tiles, level.tiles) &&
+                 level.tiles.size() == static_cast<std::size_t>(tilemap[0].rows) * tilemap[0].cols &&
+                 reader.read_components(Section::transforms, level.transforms) &&
+                 reader.read_components(Section::rigid_bodies, level.rigid_bodies) &&
+                 reader.read_components(Section::sprints, level.sprints) &&
+                 reader.read_components(Section::sprites, level.sprites) &&
+                 reader.read_components(Section::animations, level.animations) &&
+                 reader.read_components(Section::box_colliders, level.box_colliders) &&
+                 reader.read_components(Section::healths, level.healths) &&
+                 reader.read_components(Section::projectile_emitters, level.projectile_emitters) &&
+                 reader.read_components(Section::projectiles, level.projectiles) &&
+                 reader.read_components(Section::camera_follows, level.camera_follows) &&
+                 reader.read_components(Section::keyboard_controls, level.keyboard_controls) &&
+                 reader.read_components(Section::mouse_controls, level.mouse_controls) &&
+                 reader.read_components(Section::scripts, level.scripts) &&
+                 reader.read_array(Section::group_scripts, level.group_scripts) &&
+                 reader.read_array(Section::preludes, level.preludes) && level.preludes.size() <= 1;
+    if (valid)
+    {
+        level.tilemap = tilemap[0];
+        valid = indices_valid(level);
+    }
+    if (!valid)
+    {
+        level.clear();
+        return false;
+    }
+
+    for (auto &script : level.scripts.records)
+    {
+        sol::load_result chunk = lua.load(level.strings.at(script.bytecode));
+        if (!chunk.valid())
+        {
+            Logger::error("Failed to load a script from compiled level " + path);
+            level.clear();
+            return false;
+        }
+        sol::function fun = chunk;
+        level.script_functions.push_back(fun);
+    }
+    for (auto &script : level.group_scripts)
+    {
+        sol::load_result chunk = lua.load(level.strings.at(script.bytecode));
+        if (!chunk.valid())
+        {
+            Logger::error("Failed to load a group script from compiled level " + path);
+            level.clear();
+            return false;
+        }
+        sol::function fun = chunk;
+        level.group_script_functions.push_back(fun);
+    }
+    for (auto &prelude : level.preludes)
+    {
+        sol::load_result chunk = lua.load(level.strings.at(prelude.bytecode));
+        if (!chunk.valid())
+        {
+            Logger::error("Failed to load the prelude from compiled level " + path);
+            level.clear();
+            return false;
+        }
+        sol::function fun = chunk;
+        level.prelude_functions.push_back(fun);
+    }
+    return true;
+}
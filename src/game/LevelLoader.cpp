@@ -1,30 +1,164 @@
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include "LevelLoader.hpp"
+#include "AssetLoader.hpp"
+#include "TextureAtlas.hpp"
+#include "LevelFormat.hpp"
+#include "MappedFile.hpp"
+#include "Prefab.hpp"
+#include "WorldStreamer.hpp"
 #include "constants.hpp"
 
-LevelLoader::LevelLoader(std::shared_ptr<Registry> registry, std::shared_ptr<AssetStore> asset_store, SDL_Renderer *renderer)
+LevelLoader::LevelLoader(std::shared_ptr<Registry> registry, std::shared_ptr<AssetStore> asset_store, std::shared_ptr<AssetLoader> asset_loader, std::shared_ptr<PrefabRegistry> prefabs, std::shared_ptr<WorldStreamer> world_streamer)
 {
     this->registry = registry;
     this->asset_store = asset_store;
-    this->renderer = renderer;
+    this->asset_loader = asset_loader;
+    this->prefabs = prefabs;
+    this->world_streamer = world_streamer;
 }
 
-void LevelLoader::load(sol::state &lua, int level)
+vec2 LevelLoader::get_map_size() const
+{
+    return map_size;
+}
+
+std::string LevelLoader::script_path(int level)
+{
+    return "./scripts/level" + std::to_string(level) + ".lua";
+}
+
+const std::vector<LevelScript> &LevelLoader::get_scripts() const
+{
+    return scripts;
+}
+
+void LevelLoader::load(sol::state &lua, int level, AssetScope &level_assets, bool with_entities)
+{
+    std::string script_path = LevelLoader::script_path(level);
+
+    sol::optional<sol::table> compiled_config = lua["config"]["compiled_levels"];
+    bool use_compiled = compiled_config ? compiled_config.value()["enabled"].get_or(false) : false;
+    std::string compiled_path;
+    if (use_compiled)
+    {
+        std::string dir = compiled_config.value()["dir"].get_or("./assets/cache"s);
+        std::filesystem::create_directories(dir);
+        compiled_path = dir + "/level" + std::to_string(level) + ".bin";
+    }
+
+    LevelData data;
+    if (use_compiled && CompiledLevel::load(compiled_path, data, lua))
+    {
+        Logger::info("Loaded compiled level " + compiled_path);
+        // the level's scripts may read globals its lua file defined
+        for (auto &global : data.globals)
+        {
+            const std::string &name = data.strings[global.name];
+            if (global.type == 0)
+            {
+                lua[name] = global.number;
+            }
+            else if (global.type == 1)
+            {
+                lua[name] = data.strings[global.string];
+            }
+            else
+            {
+                lua[name] = global.number != 0;
+            }
+        }
+    }
+    else
+    {
+        if (!parse_script(lua, script_path, data))
+        {
+            return;
+        }
+        if (use_compiled)
+        {
+            CompiledLevel::save(compiled_path, data, lua);
+        }
+    }
+
+    run_prelude(data);
+    scripts = collect_scripts(data);
+    queue_assets(lua, level, data, level_assets);
+    map_size = vec2(data.tilemap.cols * constants::tile_scale * constants::tile_size,
+                    data.tilemap.rows * constants::tile_scale * constants::tile_size);
+    if (with_entities)
+    {
+        create_entities(data);
+    }
+}
+
+bool LevelLoader::parse_script(sol::state &lua, const std::string &script_path, LevelData &data)
 {
-    using namespace constants;
-    std::string script_path = "./scripts/level" + std::to_string(level) + ".lua";
     sol::load_result script = lua.load_file(script_path);
     if (!script.valid())
     {
         sol::error err = script;
         std::string errorMessage = err.what();
         Logger::error("Error loading the lua script: " + errorMessage);
-        return;
+        return false;
     }
 
+    // only what the script itself declares or changes is kept, not the libraries, bindings or earlier scripts
+    std::unordered_map<std::string, sol::object> globals_before;
+    lua.globals().for_each([&](const sol::object &key, const sol::object &value)
+                           {
+        if (key.get_type() == sol::type::string)
+        {
+            globals_before.emplace(key.as<std::string>(), value);
+        } });
+
     lua.script_file(script_path);
+    data.add_source(script_path);
+
+    // scalar globals declared by the script, e.g. map_height read by its entity scripts
+    lua.globals().for_each([&](const sol::object &key, const sol::object &value)
+                           {
+        if (key.get_type() != sol::type::string)
+        {
+            return;
+        }
+        std::string name = key.as<std::string>();
+        auto before = globals_before.find(name);
+        if (name.empty() || name[0] == '_' || name == "level" ||
+            (before != globals_before.end() && is_same_value(before->second, value)))
+        {
+            return;
+        }
+        GlobalRecord global{data.intern(name), 0, 0.0, 0};
+        switch (value.get_type())
+        {
+        case sol::type::number:
+            global.number = value.as<double>();
+            break;
+        case sol::type::string:
+            global.type = 1;
+            global.string = data.intern(value.as<std::string>());
+            break;
+        case sol::type::boolean:
+            global.type = 2;
+            global.number = value.as<bool>() ? 1.0 : 0.0;
+            break;
+        default:
+            // the compiled path doesn't run the script, so it would go missing
+            data.not_compilable = "The level script defines the global " + name + ", which a compiled level can't restore";
+            return;
+        }
+        data.globals.push_back(global); });
 
     sol::table Level = lua["level"];
+
+    sol::optional<sol::function> prelude = Level["prelude"];
+    if (prelude != sol::nullopt)
+    {
+        data.preludes.push_back({0});
+        data.prelude_functions.push_back(prelude.value());
+    }
     sol::table assets = Level["assets"];
 
     int i = 1;
@@ -38,51 +172,28 @@ void LevelLoader::load(sol::state &lua, int level)
         sol::table asset = assets[i];
         std::string asset_type = asset["type"];
         std::string asset_id = asset["id"];
+        std::string asset_file = asset["file"];
         if (asset_type == "texture")
         {
-            asset_store->add_texture(renderer, asset_id, asset["file"]);
+            data.assets.push_back({0, data.intern(asset_id), data.intern(asset_file), 0});
         }
         if (asset_type == "font")
         {
-            asset_store->add_font(renderer, asset_id, asset["file"], asset["font_size"]);
+            data.assets.push_back({1, data.intern(asset_id), data.intern(asset_file), asset["font_size"]});
         }
         i++;
     }
 
-    // load tilemap and create entities
-
     sol::table map = Level["tilemap"];
     std::string map_file_path = map["map_file"];
     std::string map_texture_asset_id = map["texture_asset_id"];
-    std::fstream map_file;
-    map_file.open(map_file_path);
-
-    if (!map_file.is_open())
-    {
-        Logger::error("Failed to open map file."s);
-    }
+    parse_tilemap(map_file_path, map_texture_asset_id, data);
 
-    for (int y = 0; y < map_rows; y++)
+    sol::optional<sol::table> level_prefabs = Level["prefabs"];
+    if (level_prefabs != sol::nullopt)
     {
-        for (int x = 0; x < map_cols; x++)
-        {
-            char ch;
-            map_file.get(ch);
-            int src_rect_y = std::atoi(&ch) * tile_size;
-            map_file.get(ch);
-            int src_rect_x = std::atoi(&ch) * tile_size;
-            map_file.ignore();
-
-            Entity tile = registry->create_entity();
-            tile.group("tiles");
-            tile.add_component<TransformComponent>(
-                vec2(x * (tile_scale * tile_size), y * (tile_scale * tile_size)),
-                vec2(tile_scale, tile_scale), 0.0);
-            tile.add_component<SpriteComponent>(map_texture_asset_id, tile_size, tile_size,
-                                                0, false, src_rect_x, src_rect_y);
-        }
+        parse_prefabs(level_prefabs.value(), data);
     }
-    map_file.close();
 
     sol::table entities = Level["entities"];
     i = 1;
@@ -96,167 +207,772 @@ void LevelLoader::load(sol::state &lua, int level)
 
         sol::table entity = entities[i];
 
-        Entity new_entity = registry->create_entity();
+        // Tag, Group and the prefab the entity's own components override
+        std::uint32_t new_entity = data.add_entity(entity["tag"].get_or(""s), entity["group"].get_or(""s), entity["prefab"].get_or(""s));
+
+        parse_components(entity, data, new_entity);
+        i++;
+    }
+
+    // group_scripts = { enemies = function(batch, delta_time, elapsed_time) ... end }
+    sol::optional<sol::table> group_scripts = Level["group_scripts"];
+    if (group_scripts != sol::nullopt)
+    {
+        group_scripts.value().for_each([&](const sol::object &key, const sol::object &value)
+                                       {
+            data.group_scripts.push_back({data.intern(key.as<std::string>()), 0});
+            data.group_script_functions.push_back(value.as<sol::function>()); });
+    }
+    return true;
+}
+
+bool LevelLoader::is_same_value(const sol::object &a, const sol::object &b)
+{
+    if (a.get_type() != b.get_type())
+    {
+        return false;
+    }
+    switch (a.get_type())
+    {
+    case sol::type::number:
+        return a.as<double>() == b.as<double>();
+    case sol::type::string:
+        return a.as<std::string>() == b.as<std::string>();
+    case sol::type::boolean:
+        return a.as<bool>() == b.as<bool>();
+    default:
+    {
+        lua_State *state = a.lua_state();
+        a.push();
+        b.push();
+        const bool same = lua_topointer(state, -1) == lua_topointer(state, -2);
+        lua_pop(state, 2);
+        return same;
+    }
+    }
+}
 
-        // Tag
-        sol::optional<std::string> tag = entity["tag"];
-        if (tag != sol::nullopt)
+void LevelLoader::run_prelude(LevelData &data)
+{
+    for (const auto &fun : data.prelude_functions)
+    {
+        sol::protected_function prelude = fun;
+        sol::protected_function_result result = prelude();
+        if (!result.valid())
         {
-            new_entity.tag(entity["tag"]);
+            sol::error err = result;
+            Logger::error("Error running the level prelude: " + std::string(err.what()));
+            continue;
         }
+        // what it returns replaces the level's own fields, for now only the tilemap image
+        sol::optional<sol::table> overrides = result.get<sol::optional<sol::table>>();
+        if (overrides == sol::nullopt)
+        {
+            continue;
+        }
+        sol::optional<std::string> tilemap_texture = overrides.value()["tilemap"]["texture_asset_id"];
+        if (tilemap_texture != sol::nullopt)
+        {
+            data.tilemap.texture = data.intern(tilemap_texture.value());
+        }
+    }
+}
 
-        // Group
-        sol::optional<std::string> group = entity["group"];
-        if (group != sol::nullopt)
+void LevelLoader::parse_prefabs(sol::table prefabs_table, LevelData &data)
+{
+    prefabs_table.for_each([&](const sol::object &key, const sol::object &value)
+                           {
+        sol::table prefab = value.as<sol::table>();
+        std::uint32_t definition = data.add_entity("", prefab["group"].get_or(""s));
+        parse_components(prefab, data, definition);
+        data.prefabs.push_back({data.intern(key.as<std::string>()), definition}); });
+}
+
+void LevelLoader::parse_components(sol::table entity, LevelData &data, std::uint32_t new_entity)
+{
+    // Components
+    sol::optional<sol::table> components = entity["components"];
+    if (components != sol::nullopt)
+    {
+        // Transform
+        sol::optional<sol::table> maybe_transform = entity["components"]["transform"];
+        if (maybe_transform != sol::nullopt)
         {
-            new_entity.group(entity["group"]);
+            sol::table transform = maybe_transform.value();
+            TransformRecord record;
+            record.position_x = transform["position"]["x"];
+            record.position_y = transform["position"]["y"];
+            record.scale_x = transform["scale"]["x"].get_or(1.0);
+            record.scale_y = transform["scale"]["y"].get_or(1.0);
+            record.rotation = transform["rotation"].get_or(0.0);
+            data.transforms.add(new_entity, record);
         }
 
-        // Components
-        sol::optional<sol::table> components = entity["components"];
-        if (components != sol::nullopt)
+        // RigidBody
+        sol::optional<sol::table> maybe_rigid_body = entity["components"]["rigid_body"];
+        if (maybe_rigid_body != sol::nullopt)
         {
-            // Transform
-            sol::optional<sol::table> maybe_transform = entity["components"]["transform"];
-            if (maybe_transform != sol::nullopt)
-            {
-                sol::table transform = maybe_transform.value();
-                new_entity.add_component<TransformComponent>(
-                    glm::vec2(
-                        transform["position"]["x"],
-                        transform["position"]["y"]),
-                    glm::vec2(
-                        transform["scale"]["x"].get_or(1.0),
-                        transform["scale"]["y"].get_or(1.0)),
-                    transform["rotation"].get_or(0.0));
-            }
+            sol::table rigid_body = maybe_rigid_body.value();
+            RigidBodyRecord record;
+            record.velocity_x = rigid_body["velocity"]["x"].get_or(0.0);
+            record.velocity_y = rigid_body["velocity"]["y"].get_or(0.0);
+            data.rigid_bodies.add(new_entity, record);
+        }
 
-            // RigidBody
-            sol::optional<sol::table> maybe_rigid_body = entity["components"]["rigid_body"];
-            if (maybe_rigid_body != sol::nullopt)
-            {
-                sol::table rigid_body = maybe_rigid_body.value();
-                new_entity.add_component<RigidBodyComponent>(
-                    glm::vec2(
-                        rigid_body["velocity"]["x"].get_or(0.0),
-                        rigid_body["velocity"]["y"].get_or(0.0)));
-            }
+        // sprint
+        sol::optional<sol::table> maybe_sprint = entity["components"]["sprint"];
+        if (maybe_sprint != sol::nullopt)
+        {
+            sol::table sprint = maybe_sprint.value();
+            SprintRecord record;
+            record.in_sprint = sprint["in_sprint"].get_or(false);
+            record.sprint_speed = sprint["sprint_speed"].get_or(2);
+            record.sprint_duration = sprint["sprint_duration"].get_or(3) * 1000;
+            record.sprint_cooldown = sprint["sprint_cooldown"].get_or(5) * 1000;
+            data.sprints.add(new_entity, record);
+        }
 
-            // sprint
-            sol::optional<sol::table> maybe_sprint = entity["components"]["sprint"];
-            if (maybe_sprint != sol::nullopt)
-            {
-                sol::table sprint = maybe_sprint.value();
-                new_entity.add_component<SprintComponent>(
-                    sprint["in_sprint"].get_or(false),
-                    sprint["sprint_speed"].get_or(2),
-                    sprint["sprint_duration"].get_or(3) * 1000,
-                    sprint["sprint_cooldown"].get_or(5) * 1000);
-            }
+        // Sprite
+        sol::optional<sol::table> maybe_sprite = entity["components"]["sprite"];
+        if (maybe_sprite != sol::nullopt)
+        {
+            sol::table sprite = maybe_sprite.value();
+            std::string texture_asset_id = sprite["texture_asset_id"];
+            SpriteRecord record;
+            record.asset_name = data.intern(texture_asset_id);
+            record.width = sprite["width"];
+            record.height = sprite["height"];
+            record.z_index = sprite["z_index"].get_or(1);
+            record.is_fixed = sprite["is_fixed"].get_or(false);
+            record.src_rect_x = sprite["src_rect_x"].get_or(0);
+            record.src_rect_y = sprite["src_rect_y"].get_or(0);
+            data.sprites.add(new_entity, record);
+        }
 
-            // Sprite
-            sol::optional<sol::table> maybe_sprite = entity["components"]["sprite"];
-            if (maybe_sprite != sol::nullopt)
-            {
-                sol::table sprite = maybe_sprite.value();
-                new_entity.add_component<SpriteComponent>(
-                    sprite["texture_asset_id"],
-                    sprite["width"],
-                    sprite["height"],
-                    sprite["z_index"].get_or(1),
-                    sprite["is_fixed"].get_or(false),
-                    sprite["src_rect_x"].get_or(0),
-                    sprite["src_rect_y"].get_or(0));
-            }
+        // Animation
+        sol::optional<sol::table> maybe_animation = entity["components"]["animation"];
+        if (maybe_animation != sol::nullopt)
+        {
+            sol::table animation = maybe_animation.value();
+            AnimationRecord record;
+            record.num_frames = animation["num_frames"].get_or(1);
+            record.frame_rate = animation["frame_rate"].get_or(1);
+            record.should_loop = true;
+            data.animations.add(new_entity, record);
+        }
 
-            // Animation
-            sol::optional<sol::table> maybe_animation = entity["components"]["animation"];
-            if (maybe_animation != sol::nullopt)
-            {
-                sol::table animation = maybe_animation.value();
-                new_entity.add_component<AnimationComponent>(
-                    animation["num_frames"].get_or(1),
-                    animation["frame_rate"].get_or(1));
-            }
+        // BoxCollider
+        sol::optional<sol::table> maybe_collider = entity["components"]["box_collider"];
+        if (maybe_collider != sol::nullopt)
+        {
+            sol::table collider = maybe_collider.value();
+            BoxColliderRecord record;
+            record.width = collider["width"];
+            record.height = collider["height"];
+            record.offset_x = collider["offset"]["x"].get_or(0);
+            record.offset_y = collider["offset"]["y"].get_or(0);
+            data.box_colliders.add(new_entity, record);
+        }
+
+        // Health
+        sol::optional<sol::table> maybe_health = entity["components"]["health"];
+        if (maybe_health != sol::nullopt)
+        {
+            sol::table health = maybe_health.value();
+            data.healths.add(new_entity, {static_cast<std::int32_t>(health["health_percentage"].get_or(100))});
+        }
 
-            // BoxCollider
-            sol::optional<sol::table> maybe_collider = entity["components"]["box_collider"];
-            if (maybe_collider != sol::nullopt)
+        // ProjectileEmitter
+        sol::optional<sol::table> maybe_projectile_emitter = entity["components"]["projectile_emitter"];
+        if (maybe_projectile_emitter != sol::nullopt)
+        {
+            sol::table projectile_emitter = maybe_projectile_emitter.value();
+            ProjectileEmitterRecord record;
+            record.velocity_x = projectile_emitter["projectile_velocity"]["x"].get_or(10) * 10;
+            record.velocity_y = projectile_emitter["projectile_velocity"]["y"].get_or(10) * 10;
+            record.freq = static_cast<int>(projectile_emitter["projectile_freq"].get_or(1)) * 500;
+            record.duration = static_cast<int>(projectile_emitter["projectile_duration"].get_or(10)) * 1000;
+            record.is_friendly = projectile_emitter["projectile_friendly"].get_or(false);
+            record.damage = static_cast<int>(projectile_emitter["projectile_damage"].get_or(10));
+            data.projectile_emitters.add(new_entity, record);
+        }
+
+        // Projectile
+        sol::optional<sol::table> maybe_projectile = entity["components"]["projectile"];
+        if (maybe_projectile != sol::nullopt)
+        {
+            sol::table projectile = maybe_projectile.value();
+            ProjectileRecord record;
+            record.duration = static_cast<int>(projectile["duration"].get_or(5)) * 1000;
+            record.is_friendly = projectile["friendly"].get_or(true);
+            record.damage = static_cast<int>(projectile["damage"].get_or(20));
+            data.projectiles.add(new_entity, record);
+        }
+
+        // CameraFollow
+        sol::optional<sol::table> maybe_camera_follow = entity["components"]["camera_follow"];
+        if (maybe_camera_follow != sol::nullopt)
+        {
+            data.camera_follows.add(new_entity, {0});
+        }
+
+        // KeyboardControll
+        sol::optional<sol::table> maybe_keyboard = entity["components"]["keyboard_control"];
+        if (maybe_keyboard != sol::nullopt)
+        {
+            sol::table keyboard = maybe_keyboard.value();
+            KeyboardControlRecord record;
+            record.up_x = keyboard["up_velocity"]["x"];
+            record.up_y = keyboard["up_velocity"]["y"];
+            record.right_x = keyboard["right_velocity"]["x"];
+            record.right_y = keyboard["right_velocity"]["y"];
+            record.down_x = keyboard["down_velocity"]["x"];
+            record.down_y = keyboard["down_velocity"]["y"];
+            record.left_x = keyboard["left_velocity"]["x"];
+            record.left_y = keyboard["left_velocity"]["y"];
+            data.keyboard_controls.add(new_entity, record);
+        }
+
+        // MouseControl
+        sol::optional<sol::table> maybe_mouse = entity["components"]["mouse_control"];
+        if (maybe_mouse != sol::nullopt)
+        {
+            data.mouse_controls.add(new_entity, {0});
+        }
+
+        // Script
+        sol::optional<sol::table> maybe_script = entity["components"]["on_update_script"];
+        if (maybe_script != sol::nullopt)
+        {
+            sol::function fun = entity["components"]["on_update_script"]["fun"];
+            bool is_coroutine = entity["components"]["on_update_script"]["coroutine"].get_or(false);
+            bool is_sandboxed = entity["components"]["on_update_script"]["sandboxed"].get_or(false);
+            data.scripts.add(new_entity, {0, is_coroutine, is_sandboxed});
+            data.script_functions.push_back(fun);
+        }
+    }
+}
+
+// decodes one comma separated row into tile codes, false when a cell isn't a number or the width differs
+static bool parse_tile_row(const char *line, const char *line_end, int cols, std::uint8_t *row)
+{
+    if (line_end - line == cols * 3 - 1)
+    {
+        // every cell is exactly two digits: a fixed stride loop without branches the compiler can vectorize
+        unsigned invalid = 0;
+        for (int x = 0; x < cols; x++)
+        {
+            unsigned tens = static_cast<unsigned char>(line[x * 3]) - '0';
+            unsigned ones = static_cast<unsigned char>(line[x * 3 + 1]) - '0';
+            invalid |= (tens > 9) | (ones > 9);
+            row[x] = static_cast<std::uint8_t>(tens * 10 + ones);
+        }
+        for (int x = 0; x < cols - 1; x++)
+        {
+            invalid |= line[x * 3 + 2] != ',';
+        }
+        if (invalid == 0)
+        {
+            return true;
+        }
+        // the length only happened to match, e.g. "1, 2,3" for three cells, the scanner below decides
+    }
+
+    // cells of other widths, e.g. hand edited maps with single digit codes
+    int x = 0;
+    unsigned value = 0;
+    for (const char *p = line; p <= line_end; p++)
+    {
+        if (p == line_end || *p == ',')
+        {
+            if (x >= cols || value > 99)
             {
-                sol::table collider = maybe_collider.value();
-                new_entity.add_component<BoxColliderComponent>(
-                    collider["width"],
-                    collider["height"],
-                    glm::vec2(
-                        collider["offset"]["x"].get_or(0),
-                        collider["offset"]["y"].get_or(0)));
+                return false;
             }
+            row[x++] = static_cast<std::uint8_t>(value);
+            value = 0;
+        }
+        else if (*p >= '0' && *p <= '9')
+        {
+            value = value * 10 + (*p - '0');
+        }
+        else if (*p != ' ')
+        {
+            return false;
+        }
+    }
+    return x == cols;
+}
+
+void LevelLoader::parse_tilemap(const std::string &map_file_path, const std::string &texture_asset_id, LevelData &data)
+{
+    MappedFile map_file(map_file_path);
+    if (!map_file.get_data())
+    {
+        Logger::error("Failed to open map file " + map_file_path);
+        return;
+    }
+    data.add_source(map_file_path);
 
-            // Health
-            sol::optional<sol::table> maybe_health = entity["components"]["health"];
-            if (maybe_health != sol::nullopt)
+    // the first row sets the width, every row after it must match
+    const char *end = map_file.get_data() + map_file.get_size();
+    const char *line = map_file.get_data();
+    int rows = 0;
+    int cols = 0;
+    while (line < end)
+    {
+        const char *newline = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        const char *line_end = newline ? newline : end;
+        const char *next = newline ? newline + 1 : end;
+        while (line_end > line && (line_end[-1] == '\r' || line_end[-1] == ' ' || line_end[-1] == ','))
+        {
+            line_end--;
+        }
+        if (line_end == line)
+        {
+            line = next;
+            continue;
+        }
+
+        if (cols == 0)
+        {
+            cols = std::count(line, line_end, ',') + 1;
+            data.tiles.reserve(static_cast<std::size_t>(cols) * (map_file.get_size() / (cols * 3)));
+        }
+        data.tiles.resize(data.tiles.size() + cols);
+        if (!parse_tile_row(line, line_end, cols, data.tiles.data() + data.tiles.size() - cols))
+        {
+            Logger::error("Invalid row " + std::to_string(rows + 1) + " in map file " + map_file_path);
+            data.tiles.clear();
+            return;
+        }
+        rows++;
+        line = next;
+    }
+
+    data.tilemap = {data.intern(texture_asset_id), rows, cols};
+}
+
+void LevelLoader::queue_assets(sol::state &lua, int level, const LevelData &data, AssetScope &level_assets)
+{
+    // textures are packed into shared atlas pages unless config.texture_atlas.enabled is false
+    sol::optional<sol::table> atlas_config = lua["config"]["texture_atlas"];
+    bool use_atlas = atlas_config ? atlas_config.value()["enabled"].get_or(true) : false;
+    auto atlas_builder = std::make_shared<TextureAtlasBuilder>(use_atlas ? atlas_config.value()["max_size"].get_or(2048) : 2048);
+
+    // assets are only queued here, decoding happens on the loader's workers
+    for (auto &asset : data.assets)
+    {
+        const std::string &asset_id = data.strings[asset.id];
+        const std::string &asset_file = data.strings[asset.file];
+        // assets still loaded from the previous level are only referenced again, not reloaded
+        if (asset.type == 0)
+        {
+            level_assets.add(asset_store->acquire(AssetType::texture, asset_id));
+            const bool is_loaded = asset_store->has_texture(asset_id);
+            if (!is_loaded && use_atlas)
             {
-                sol::table health = maybe_health.value();
-                new_entity.add_component<HealthComponent>(static_cast<int>(health["health_percentage"].get_or(100)));
+                atlas_builder->add(asset_id, asset_file);
             }
-
-            // ProjectileEmitter
-            sol::optional<sol::table> maybe_projectile_emitter = entity["components"]["projectile_emitter"];
-            if (maybe_projectile_emitter != sol::nullopt)
+            else if (!is_loaded)
             {
-                sol::table projectile_emitter = maybe_projectile_emitter.value();
-                new_entity.add_component<ProjectileEmitterComponent>(
-                    glm::vec2(
-                        projectile_emitter["projectile_velocity"]["x"].get_or(10) * 10,
-                        projectile_emitter["projectile_velocity"]["y"].get_or(10) * 10),
-                    static_cast<int>(projectile_emitter["projectile_freq"].get_or(1)) * 500,
-                    static_cast<int>(projectile_emitter["projectile_duration"].get_or(10)) * 1000,
-                    projectile_emitter["projectile_friendly"].get_or(false),
-                    static_cast<int>(projectile_emitter["projectile_damage"].get_or(10)));
+                asset_loader->queue_texture(asset_id, asset_file);
             }
-
-            // CameraFollow
-            sol::optional<sol::table> maybe_camera_follow = entity["components"]["camera_follow"];
-            if (maybe_camera_follow != sol::nullopt)
+        }
+        if (asset.type == 1)
+        {
+            level_assets.add(asset_store->acquire(AssetType::font, asset_id));
+            if (!asset_store->has_font(asset_id))
             {
-                new_entity.add_component<CameraFollowComponent>();
+                asset_loader->queue_font(asset_id, asset_file, asset.font_size);
             }
+        }
+    }
+
+    if (!atlas_builder->empty())
+    {
+        sol::optional<std::string> cache_dir = atlas_config.value()["cache_dir"];
+        std::string level_cache_dir = cache_dir ? cache_dir.value() + "/level" + std::to_string(level) : "";
+        asset_loader->queue_texture_atlas(atlas_builder, level_cache_dir);
+    }
+}
+
+// records back to the components they were parsed from
+static TransformComponent make_component(const LevelData &data, const TransformRecord &record)
+{
+    return TransformComponent(vec2(record.position_x, record.position_y), vec2(record.scale_x, record.scale_y), record.rotation);
+}
+
+static RigidBodyComponent make_component(const LevelData &data, const RigidBodyRecord &record)
+{
+    return RigidBodyComponent(vec2(record.velocity_x, record.velocity_y));
+}
+
+static SprintComponent make_component(const LevelData &data, const SprintRecord &record)
+{
+    return SprintComponent(record.in_sprint != 0, record.sprint_speed, record.sprint_duration, record.sprint_cooldown);
+}
+
+static SpriteComponent make_component(const LevelData &data, const SpriteRecord &record)
+{
+    return SpriteComponent(data.strings[record.asset_name], record.width, record.height, record.z_index,
+                           record.is_fixed != 0, record.src_rect_x, record.src_rect_y);
+}
+
+static AnimationComponent make_component(const LevelData &data, const AnimationRecord &record)
+{
+    return AnimationComponent(record.num_frames, record.frame_rate, record.should_loop != 0);
+}
+
+static BoxColliderComponent make_component(const LevelData &data, const BoxColliderRecord &record)
+{
+    return BoxColliderComponent(record.width, record.height, vec2(record.offset_x, record.offset_y));
+}
+
+static HealthComponent make_component(const LevelData &data, const HealthRecord &record)
+{
+    return HealthComponent(record.health);
+}
+
+static ProjectileEmitterComponent make_component(const LevelData &data, const ProjectileEmitterRecord &record)
+{
+    return ProjectileEmitterComponent(vec2(record.velocity_x, record.velocity_y), record.freq, record.duration,
+                                      record.is_friendly != 0, record.damage);
+}
+
+static ProjectileComponent make_component(const LevelData &data, const ProjectileRecord &record)
+{
+    return ProjectileComponent(record.duration, record.is_friendly != 0, record.damage);
+}
+
+static CameraFollowComponent make_component(const LevelData &data, const CameraFollowRecord &record)
+{
+    return CameraFollowComponent();
+}
+
+static KeyboardControlComponent make_component(const LevelData &data, const KeyboardControlRecord &record)
+{
+    return KeyboardControlComponent(vec2(record.up_x, record.up_y), vec2(record.right_x, record.right_y),
+                                    vec2(record.down_x, record.down_y), vec2(record.left_x, record.left_y));
+}
+
+static MouseControlComponent make_component(const LevelData &data, const MouseControlRecord &record)
+{
+    return MouseControlComponent();
+}
+
+template <typename TRecord, typename TAdd>
+static void convert_records(const LevelData &data, const ComponentRecords<TRecord> &components, TAdd &add)
+{
+    for (std::size_t i = 0; i < components.records.size(); i++)
+    {
+        add(components.entities[i], make_component(data, components.records[i]));
+    }
+}
+
+// calls add(entity index, component) for every component record in the level
+template <typename TAdd>
+static void convert_all_records(const LevelData &data, TAdd add)
+{
+    convert_records(data, data.transforms, add);
+    convert_records(data, data.rigid_bodies, add);
+    convert_records(data, data.sprints, add);
+    convert_records(data, data.sprites, add);
+    convert_records(data, data.animations, add);
+    convert_records(data, data.box_colliders, add);
+    convert_records(data, data.healths, add);
+    convert_records(data, data.projectile_emitters, add);
+    convert_records(data, data.projectiles, add);
+    convert_records(data, data.camera_follows, add);
+    convert_records(data, data.keyboard_controls, add);
+    convert_records(data, data.mouse_controls, add);
+    for (std::size_t i = 0; i < data.scripts.records.size(); i++)
+    {
+        add(data.scripts.entities[i], ScriptComponent(data.script_functions[i], data.scripts.records[i].is_coroutine,
+                                                                data.scripts.records[i].is_sandboxed));
+    }
+}
+
+void LevelLoader::register_prefabs(const LevelData &data)
+{
+    if (data.prefabs.empty())
+    {
+        return;
+    }
+
+    // definition entity index -> prefab being built
+    std::unordered_map<std::uint32_t, Prefab> definitions;
+    for (auto &record : data.prefabs)
+    {
+        Prefab &prefab = definitions[record.entity];
+        const EntityRecord &entity = data.entities[record.entity];
+        if (entity.group >= 0)
+        {
+            prefab.set_group(data.strings[entity.group]);
+        }
+    }
+    convert_all_records(data, [&](std::uint32_t entity, const auto &component)
+                        {
+        auto it = definitions.find(entity);
+        if (it != definitions.end())
+        {
+            it->second.add(component);
+        } });
+
+    for (auto &record : data.prefabs)
+    {
+        prefabs->add(data.strings[record.name], definitions[record.entity]);
+    }
+}
 
-            // KeyboardControll
-            sol::optional<sol::table> maybe_keyboard = entity["components"]["keyboard_control"];
-            if (maybe_keyboard != sol::nullopt)
+void LevelLoader::create_entities(const LevelData &data)
+{
+    using namespace constants;
+    const std::string &tile_texture = data.strings[data.tilemap.texture];
+    const int cols = data.tilemap.cols;
+    if (world_streamer)
+    {
+        world_streamer->set_tilemap(tile_texture, data.tilemap.rows, cols, data.tiles);
+    }
+    else
+    {
+        registry->create_many<TransformComponent, SpriteComponent>(
+            data.tilemap.rows * cols,
+            [&](int i, Entity tile, TransformComponent &transform, SpriteComponent &sprite)
             {
-                sol::table keyboard = maybe_keyboard.value();
-                new_entity.add_component<KeyboardControlComponent>(
-                    glm::vec2(
-                        keyboard["up_velocity"]["x"],
-                        keyboard["up_velocity"]["y"]),
-                    glm::vec2(
-                        keyboard["right_velocity"]["x"],
-                        keyboard["right_velocity"]["y"]),
-                    glm::vec2(
-                        keyboard["down_velocity"]["x"],
-                        keyboard["down_velocity"]["y"]),
-                    glm::vec2(
-                        keyboard["left_velocity"]["x"],
-                        keyboard["left_velocity"]["y"]));
-            }
+                int x = i % cols;
+                int y = i / cols;
+                std::uint8_t code = data.tiles[i];
+                tile.group("tiles");
+                transform = TransformComponent(vec2(x * (tile_scale * tile_size), y * (tile_scale * tile_size)),
+                                               vec2(tile_scale, tile_scale), 0.0);
+                sprite = SpriteComponent(tile_texture, tile_size, tile_size,
+                                         0, false, (code % 10) * tile_size, (code / 10) * tile_size);
+            });
+    }
+    register_prefabs(data);
+
+    // prefab definitions only hold components, they don't become entities
+    std::vector<bool> is_definition(data.entities.size(), false);
+    for (auto &record : data.prefabs)
+    {
+        is_definition[record.entity] = true;
+    }
 
-            // MouseControl
-            sol::optional<sol::table> maybe_mouse = entity["components"]["mouse_control"];
-            if (maybe_mouse != sol::nullopt)
+    // each entity's full bundle: its prefab's components with its own on top
+    std::vector<Prefab> bundles(data.entities.size());
+    for (std::size_t i = 0; i < data.entities.size(); i++)
+    {
+        const EntityRecord &record = data.entities[i];
+        if (is_definition[i])
+        {
+            continue;
+        }
+        if (record.prefab >= 0)
+        {
+            if (prefabs->has(data.strings[record.prefab]))
             {
-                new_entity.add_component<MouseControlComponent>();
+                bundles[i] = prefabs->get(data.strings[record.prefab]);
             }
-
-            // Script
-            sol::optional<sol::table> maybe_script = entity["components"]["on_update_script"];
-            if (maybe_script != sol::nullopt)
+            else
             {
-                sol::function fun = entity["components"]["on_update_script"]["fun"];
-                new_entity.add_component<ScriptComponent>(fun);
+                Logger::error("Unknown prefab " + data.strings[record.prefab]);
             }
         }
-        i++;
+        if (record.group >= 0)
+        {
+            bundles[i].set_group(data.strings[record.group]);
+        }
     }
-}
\ No newline at end of file
+    convert_all_records(data, [&](std::uint32_t entity, const auto &component)
+                        {
+        if (!is_definition[entity])
+        {
+            bundles[entity].add(component);
+        } });
+
+    for (std::size_t i = 0; i < data.entities.size(); i++)
+    {
+        const EntityRecord &record = data.entities[i];
+        if (is_definition[i])
+        {
+            continue;
+        }
+        // untagged scenery only exists while its chunk is near the camera
+        if (world_streamer && record.tag < 0 && WorldStreamer::can_stream(bundles[i]))
+        {
+            world_streamer->add_scenery(bundles[i]);
+            continue;
+        }
+        Entity entity = bundles[i].instantiate(*registry);
+        if (record.tag >= 0)
+        {
+            entity.tag(data.strings[record.tag]);
+        }
+    }
+
+    if (registry->has_system<ScriptSystem>())
+    {
+        auto &scripts = registry->get_system<ScriptSystem>();
+        scripts.clear_group_scripts();
+        for (std::size_t i = 0; i < data.group_scripts.size(); i++)
+        {
+            scripts.set_group_script(data.strings[data.group_scripts[i].group], data.group_script_functions[i]);
+        }
+    }
+}
+
+bool LevelLoader::parse_prefabs_script(sol::state &lua, const std::string &script_path, LevelData &data)
+{
+    sol::load_result script = lua.load_file(script_path);
+    if (!script.valid())
+    {
+        sol::error err = script;
+        std::string errorMessage = err.what();
+        Logger::error("Error loading the prefabs script: " + errorMessage);
+        return false;
+    }
+    lua.script_file(script_path);
+
+    sol::table prefabs_table = lua["prefabs"];
+    parse_prefabs(prefabs_table, data);
+    return true;
+}
+
+void LevelLoader::load_prefabs(sol::state &lua, const std::string &script_path)
+{
+    LevelData data;
+    if (!parse_prefabs_script(lua, script_path, data))
+    {
+        return;
+    }
+    register_prefabs(data);
+    scripts = collect_scripts(data);
+}
+
+std::vector<LevelScript> LevelLoader::collect_scripts(const LevelData &data)
+{
+    // prefab name by definition entity
+    std::unordered_map<std::uint32_t, std::uint32_t> definitions;
+    for (auto &record : data.prefabs)
+    {
+        definitions[record.entity] = record.name;
+    }
+    // positions in level.entities, which leave out the definitions
+    std::vector<int> positions(data.entities.size(), -1);
+    int position = 0;
+    for (std::size_t i = 0; i < data.entities.size(); i++)
+    {
+        if (!definitions.count(i))
+        {
+            positions[i] = position++;
+        }
+    }
+
+    std::vector<LevelScript> collected;
+    for (std::size_t i = 0; i < data.scripts.records.size(); i++)
+    {
+        const std::uint32_t entity = data.scripts.entities[i];
+        const EntityRecord &record = data.entities[entity];
+        auto definition = definitions.find(entity);
+        std::string key;
+        if (definition != definitions.end())
+        {
+            key = "prefab:" + data.strings[definition->second];
+        }
+        else if (record.tag >= 0)
+        {
+            key = "tag:" + data.strings[record.tag];
+        }
+        else
+        {
+            key = "entity:" + std::to_string(positions[entity]);
+        }
+        collected.push_back({key, data.script_functions[i]});
+    }
+    for (std::size_t i = 0; i < data.group_scripts.size(); i++)
+    {
+        collected.push_back({"group:" + data.strings[data.group_scripts[i].group], data.group_script_functions[i]});
+    }
+    return collected;
+}
+
+void LevelLoader::rebind_scripts(const LevelData &data, std::vector<LevelScript> &scripts, ScriptSystem::Rebinding &rebinding)
+{
+    std::vector<LevelScript> reloaded = collect_scripts(data);
+    std::unordered_map<std::string, const LevelScript *> by_key;
+    for (auto &script : reloaded)
+    {
+        by_key[script.key] = &script;
+    }
+    // a script whose key is gone keeps running its old function, group scripts are the exception
+    std::vector<std::string> removed_groups;
+    for (auto &script : scripts)
+    {
+        auto it = by_key.find(script.key);
+        if (it != by_key.end())
+        {
+            rebinding[ScriptSystem::function_id(script.fun)] = it->second->fun;
+        }
+        else if (script.key.rfind("group:", 0) == 0)
+        {
+            removed_groups.push_back(script.key.substr(6));
+        }
+    }
+
+    // what is spawned from now on gets the new functions
+    register_prefabs(data);
+    if (registry->has_system<ScriptSystem>())
+    {
+        auto &script_system = registry->get_system<ScriptSystem>();
+        script_system.rebind(rebinding);
+        for (auto &group : removed_groups)
+        {
+            script_system.set_group_script(group, sol::function{});
+        }
+        for (std::size_t i = 0; i < data.group_scripts.size(); i++)
+        {
+            script_system.set_group_script(data.strings[data.group_scripts[i].group], data.group_script_functions[i]);
+        }
+    }
+    scripts = std::move(reloaded);
+}
+
+bool LevelLoader::reload_scripts(sol::state &lua, int level, std::vector<LevelScript> &scripts, ScriptSystem::Rebinding &rebinding)
+{
+    LevelData data;
+    try
+    {
+        if (!parse_script(lua, script_path(level), data))
+        {
+            return false;
+        }
+    }
+    catch (const sol::error &e)
+    {
+        Logger::error("Error running the lua script: "s + e.what());
+        return false;
+    }
+    rebind_scripts(data, scripts, rebinding);
+    return true;
+}
+
+bool LevelLoader::reload_prefabs(sol::state &lua, const std::string &script_path, std::vector<LevelScript> &scripts,
+                                 ScriptSystem::Rebinding &rebinding)
+{
+    LevelData data;
+    try
+    {
+        if (!parse_prefabs_script(lua, script_path, data))
+        {
+            return false;
+        }
+    }
+    catch (const sol::error &e)
+    {
+        Logger::error("Error running the prefabs script: "s + e.what());
+        return false;
+    }
+    rebind_scripts(data, scripts, rebinding);
+    return true;
+}
@@ -0,0 +1,206 @@
+#include "LuaArena.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+LuaArena::~LuaArena()
+{
+    for (Slab *slab : slabs)
+    {
+        std::free(slab);
+    }
+    for (void *block : kept_large)
+    {
+        std::free(block);
+    }
+}
+
+std::size_t LuaArena::class_of(std::size_t size)
+{
+    return (size - 1) / granularity;
+}
+
+LuaArena::Slab *LuaArena::slab_of(void *block)
+{
+    return reinterpret_cast<Slab *>(reinterpret_cast<std::uintptr_t>(block) & ~(slab_size - 1));
+}
+
+bool LuaArena::has_room(const Slab *slab)
+{
+    const std::size_t block_size = (slab->size_class + 1) * granularity;
+    return slab->free_blocks || reinterpret_cast<const char *>(slab) + slab_size - slab->bump >= block_size;
+}
+
+LuaArena::Slab *LuaArena::create_slab(std::size_t size_class)
+{
+    void *memory = std::aligned_alloc(slab_size, slab_size);
+    if (!memory)
+    {
+        return nullptr;
+    }
+    Slab *slab = static_cast<Slab *>(memory);
+    *slab = Slab{nullptr, nullptr, nullptr, static_cast<char *>(memory) + header_size, 0,
+                 static_cast<std::uint32_t>(size_class), slabs.size()};
+    slabs.push_back(slab);
+    link(slab);
+    return slab;
+}
+
+void LuaArena::destroy_slab(Slab *slab)
+{
+    slabs.back()->index = slab->index;
+    slabs[slab->index] = slabs.back();
+    slabs.pop_back();
+    std::free(slab);
+}
+
+void LuaArena::link(Slab *slab)
+{
+    Slab *&head = with_room[slab->size_class];
+    slab->prev = nullptr;
+    slab->next = head;
+    if (head)
+    {
+        head->prev = slab;
+    }
+    head = slab;
+}
+
+void LuaArena::unlink(Slab *slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        with_room[slab->size_class] = slab->next;
+    }
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = nullptr;
+    slab->next = nullptr;
+}
+
+void *LuaArena::allocate_small(std::size_t size)
+{
+    const std::size_t index = class_of(size);
+    const std::size_t block_size = (index + 1) * granularity;
+    Slab *slab = with_room[index];
+    if (!slab)
+    {
+        slab = create_slab(index);
+        if (!slab)
+        {
+            return nullptr;
+        }
+    }
+
+    void *block;
+    if (FreeBlock *free_block = slab->free_blocks)
+    {
+        slab->free_blocks = free_block->next;
+        block = free_block;
+    }
+    else
+    {
+        block = slab->bump;
+        slab->bump += block_size;
+    }
+    slab->live++;
+    small_bytes += block_size;
+    if (!has_room(slab))
+    {
+        unlink(slab);
+    }
+    return block;
+}
+
+void LuaArena::free_small(void *block)
+{
+    Slab *slab = slab_of(block);
+    const bool was_full = !has_room(slab);
+    auto *free_block = static_cast<FreeBlock *>(block);
+    free_block->next = slab->free_blocks;
+    slab->free_blocks = free_block;
+    slab->live--;
+    small_bytes -= (slab->size_class + 1) * granularity;
+
+    if (was_full)
+    {
+        link(slab);
+    }
+    // the last slab of a class with room is kept, a block going back and forth doesn't hit the system
+    else if (slab->live == 0 && (slab->prev || slab->next))
+    {
+        unlink(slab);
+        destroy_slab(slab);
+    }
+}
+
+bool LuaArena::take_kept_large(void *block)
+{
+    return !kept_large.empty() && kept_large.erase(block) > 0;
+}
+
+void *LuaArena::allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize)
+{
+    auto *arena = static_cast<LuaArena *>(ud);
+    // without a block osize is the type of the new object, not a size
+    const std::size_t old_size = ptr ? osize : 0;
+    const bool old_large = ptr && (old_size > max_small || arena->take_kept_large(ptr));
+    const bool old_small = ptr && !old_large;
+    const bool new_small = nsize > 0 && nsize <= max_small;
+
+    if (nsize == 0)
+    {
+        if (old_small)
+        {
+            arena->free_small(ptr);
+        }
+        else
+        {
+            std::free(ptr);
+        }
+        return nullptr;
+    }
+    if (old_large)
+    {
+        if (new_small)
+        {
+            // moving it into a slab could fail, lua counts on shrinking to succeed
+            arena->kept_large.insert(ptr);
+            return ptr;
+        }
+        return std::realloc(ptr, nsize);
+    }
+    // shrinking keeps the block, a slab block knows its class, frees don't go by the size lua reports
+    if (old_small && (nsize <= old_size || class_of(nsize) == class_of(old_size)))
+    {
+        return ptr;
+    }
+
+    void *block = new_small ? arena->allocate_small(nsize) : std::malloc(nsize);
+    if (!block)
+    {
+        return nullptr;
+    }
+    if (old_small)
+    {
+        std::memcpy(block, ptr, std::min(old_size, nsize));
+        arena->free_small(ptr);
+    }
+    return block;
+}
+
+std::size_t LuaArena::get_small_bytes() const
+{
+    return small_bytes;
+}
+
+std::size_t LuaArena::get_slab_bytes() const
+{
+    return slabs.size() * slab_size;
+}
@@ -0,0 +1,44 @@
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast<const char *>(mapping);
+            size = info.st_size;
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data)
+    {
+        munmap(const_cast<char *>(data), size);
+    }
+}
+
+const char *MappedFile::get_data() const
+{
+    return data;
+}
+
+std::size_t MappedFile::get_size() const
+{
+    return size;
+}
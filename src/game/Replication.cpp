@@ -0,0 +1,670 @@
+#include "Replication.hpp"
+#include "Snapshot.hpp"
+#include <Logger.hpp>
+#include <arpa/inet.h>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::uint32_t magic = 0x4e443252; // "R2DN"
+    constexpr std::size_t max_packet_size = 60000; // entities past this are sent on the next tick
+    constexpr std::size_t max_history = 64;        // states kept per client and by the client
+
+    enum class PacketType : std::uint8_t
+    {
+        client_update, // ack, camera and inputs
+        bye,
+        state
+    };
+
+    // which fields of an entity follow its id
+    enum FieldBits : std::uint8_t
+    {
+        spawn_bit = 1, // every field
+        position_bit = 2,
+        rotation_bit = 4,
+        frame_bit = 8,
+        health_bit = 16
+    };
+
+    sockaddr_in loopback(std::uint16_t port)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        return address;
+    }
+
+    bool same_address(const sockaddr_in &a, const sockaddr_in &b)
+    {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+
+    // false when nothing changed since before and nothing was written
+    bool write_entity(SnapshotWriter &writer, int id, const NetEntity &entity, const NetEntity *before)
+    {
+        std::uint8_t bits = spawn_bit;
+        if (before && before->same_kind(entity))
+        {
+            bits = 0;
+            if (entity.x != before->x || entity.y != before->y)
+            {
+                bits |= position_bit;
+            }
+            if (entity.rotation != before->rotation)
+            {
+                bits |= rotation_bit;
+            }
+            if (entity.frame_x != before->frame_x || entity.frame_y != before->frame_y)
+            {
+                bits |= frame_bit;
+            }
+            if (entity.health != before->health)
+            {
+                bits |= health_bit;
+            }
+        }
+        if (bits == 0)
+        {
+            return false;
+        }
+
+        writer.write<std::int32_t>(id);
+        writer.write(bits);
+        if (bits & spawn_bit)
+        {
+            writer.write_string(entity.asset_name);
+            writer.write(entity.width);
+            writer.write(entity.height);
+            writer.write(entity.z_index);
+            writer.write(entity.scale_x);
+            writer.write(entity.scale_y);
+            writer.write(entity.flip);
+            writer.write(entity.flags);
+        }
+        if (bits & (spawn_bit | position_bit))
+        {
+            writer.write(entity.x);
+            writer.write(entity.y);
+        }
+        if (bits & (spawn_bit | rotation_bit))
+        {
+            writer.write(entity.rotation);
+        }
+        if (bits & (spawn_bit | frame_bit))
+        {
+            writer.write(entity.frame_x);
+            writer.write(entity.frame_y);
+        }
+        if (bits & (spawn_bit | health_bit))
+        {
+            writer.write(entity.health);
+        }
+        return true;
+    }
+
+    void read_entity(SnapshotReader &reader, NetEntity &entity, std::uint8_t bits)
+    {
+        if (bits & spawn_bit)
+        {
+            entity.asset_name = reader.read_string();
+            entity.width = reader.read<std::uint16_t>();
+            entity.height = reader.read<std::uint16_t>();
+            entity.z_index = reader.read<std::int16_t>();
+            entity.scale_x = reader.read<std::uint16_t>();
+            entity.scale_y = reader.read<std::uint16_t>();
+            entity.flip = reader.read<std::uint8_t>();
+            entity.flags = reader.read<std::uint8_t>();
+        }
+        if (bits & (spawn_bit | position_bit))
+        {
+            entity.x = reader.read<std::int32_t>();
+            entity.y = reader.read<std::int32_t>();
+        }
+        if (bits & (spawn_bit | rotation_bit))
+        {
+            entity.rotation = reader.read<std::uint16_t>();
+        }
+        if (bits & (spawn_bit | frame_bit))
+        {
+            entity.frame_x = reader.read<std::uint16_t>();
+            entity.frame_y = reader.read<std::uint16_t>();
+        }
+        if (bits & (spawn_bit | health_bit))
+        {
+            entity.health = reader.read<std::uint8_t>();
+        }
+    }
+}
+
+// ============================================================
+// socket
+// ============================================================
+UdpSocket::~UdpSocket()
+{
+    close();
+}
+
+bool UdpSocket::open(std::uint16_t port)
+{
+    close();
+    fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    sockaddr_in address = loopback(port);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::fcntl(fd, F_SETFL, O_NONBLOCK) != 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void UdpSocket::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool UdpSocket::send_to(const sockaddr_in &address, const std::vector<char> &packet)
+{
+    const auto sent = ::sendto(fd, packet.data(), packet.size(), 0,
+                               reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    return sent == static_cast<decltype(sent)>(packet.size());
+}
+
+bool UdpSocket::receive(std::vector<char> &packet, sockaddr_in &from)
+{
+    packet.resize(65536);
+    socklen_t length = sizeof(from);
+    const auto size = ::recvfrom(fd, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr *>(&from), &length);
+    if (size < 0)
+    {
+        packet.clear();
+        return false;
+    }
+    packet.resize(size);
+    return true;
+}
+
+// ============================================================
+// entity
+// ============================================================
+NetEntity NetEntity::quantize(const Entity &entity)
+{
+    const auto &transform = entity.read_component<TransformComponent>();
+    const auto &sprite = entity.read_component<SpriteComponent>();
+
+    NetEntity net;
+    net.x = std::lround(transform.position.x * 16);
+    net.y = std::lround(transform.position.y * 16);
+    const double turns = transform.rotation / 360.0;
+    net.rotation = static_cast<std::uint16_t>(std::lround((turns - std::floor(turns)) * 65536) & 0xffff);
+    net.frame_x = sprite.src_rect.x;
+    net.frame_y = sprite.src_rect.y;
+    if (entity.has_component<HealthComponent>())
+    {
+        net.flags |= has_health;
+        net.health = std::clamp(entity.read_component<HealthComponent>().health, 0, 255);
+    }
+
+    net.asset_name = sprite.asset_name;
+    net.width = sprite.width;
+    net.height = sprite.height;
+    net.z_index = sprite.z_index;
+    net.scale_x = std::clamp<long>(std::lround(transform.scale.x * 256), 0, 65535);
+    net.scale_y = std::clamp<long>(std::lround(transform.scale.y * 256), 0, 65535);
+    net.flip = sprite.flip;
+    if (sprite.is_fixed)
+    {
+        net.flags |= is_fixed;
+    }
+    if (entity.has_component<RigidBodyComponent>() || entity.has_component<ScriptComponent>())
+    {
+        net.flags |= is_dynamic;
+    }
+    if (entity.has_component<CameraFollowComponent>())
+    {
+        net.flags |= follows_camera;
+    }
+    return net;
+}
+
+bool NetEntity::same_kind(const NetEntity &other) const
+{
+    return asset_name == other.asset_name && width == other.width && height == other.height &&
+           z_index == other.z_index && scale_x == other.scale_x && scale_y == other.scale_y &&
+           flip == other.flip && flags == other.flags;
+}
+
+// ============================================================
+// server
+// ============================================================
+ReplicationServer::ReplicationServer(std::shared_ptr<Registry> registry, std::uint32_t timeout)
+{
+    this->registry = registry;
+    this->timeout = timeout;
+}
+
+bool ReplicationServer::open(std::uint16_t port)
+{
+    return socket.open(port);
+}
+
+void ReplicationServer::receive(std::uint32_t now, std::vector<InputRecording::Input> &inputs)
+{
+    std::vector<sol::function> functions;
+    sockaddr_in from;
+    while (socket.receive(packet, from))
+    {
+        SnapshotReader reader(packet, functions);
+        if (reader.read<std::uint32_t>() != magic)
+        {
+            continue;
+        }
+        const auto type = reader.read<PacketType>();
+        auto client = std::find_if(clients.begin(), clients.end(), [&from](const Client &client)
+                                   { return same_address(client.address, from); });
+        if (type == PacketType::bye)
+        {
+            if (client != clients.end())
+            {
+                Logger::info("Client on port " + std::to_string(ntohs(from.sin_port)) + " left");
+                drop_player(*client);
+                clients.erase(client);
+            }
+            continue;
+        }
+        if (type != PacketType::client_update)
+        {
+            continue;
+        }
+
+        const auto ack = reader.read<std::uint32_t>();
+        const auto camera = reader.read<SDL_Rect>();
+        const auto input_count = reader.read<std::uint16_t>();
+        std::vector<InputRecording::Input> client_inputs(input_count);
+        for (auto &input : client_inputs)
+        {
+            input.type = reader.read<InputRecording::InputType>();
+            input.code = reader.read<std::int32_t>();
+        }
+        if (!reader.is_valid())
+        {
+            continue;
+        }
+
+        if (client == clients.end())
+        {
+            Logger::info("Client on port " + std::to_string(ntohs(from.sin_port)) + " joined");
+            clients.push_back(Client{from});
+            client = std::prev(clients.end());
+            if (player)
+            {
+                client->player = player->instantiate(*registry).id();
+            }
+        }
+        client->camera = camera;
+        client->last_heard = now;
+        client->acked_tick = std::max(client->acked_tick, ack);
+        for (auto &input : client_inputs)
+        {
+            // without players a client's input drives nothing rather than every controlled entity
+            input.entity_id = player ? client->player : std::numeric_limits<std::int32_t>::max();
+            inputs.push_back(input);
+        }
+    }
+
+    std::erase_if(clients, [&](const Client &client)
+                  {
+        if (now - client.last_heard <= timeout)
+        {
+            return false;
+        }
+        Logger::info("Client on port " + std::to_string(ntohs(client.address.sin_port)) + " timed out");
+        drop_player(client);
+        return true; });
+}
+
+void ReplicationServer::set_player(const Prefab &prefab)
+{
+    player = std::make_shared<Prefab>(prefab);
+}
+
+void ReplicationServer::drop_player(const Client &client)
+{
+    // the player may have been destroyed in play and its id handed to something else
+    Entity entity{client.player, registry.get()};
+    if (client.player >= 0 && entity.has_component<KeyboardControlComponent>())
+    {
+        registry->kill_entity(entity);
+    }
+}
+
+void ReplicationServer::send(std::uint32_t tick)
+{
+    for (auto &client : clients)
+    {
+        send_state(client, tick);
+    }
+}
+
+void ReplicationServer::send_state(Client &client, std::uint32_t tick)
+{
+    // the acknowledged state is the baseline, anything older won't be built on again
+    while (!client.sent.empty() && client.sent.front().first < client.acked_tick)
+    {
+        client.sent.pop_front();
+    }
+    static const NetState nothing;
+    const bool has_baseline = !client.sent.empty() && client.sent.front().first == client.acked_tick;
+    const NetState &baseline = has_baseline ? client.sent.front().second : nothing;
+
+    // interest: whatever is drawn around the client's camera
+    Signature drawn;
+    drawn.set(Component<SpriteComponent>::id());
+    registry->get_system<SpatialIndexSystem>().query(client.camera, drawn, visible);
+    NetState current;
+    current.reserve(visible.size());
+    for (const auto &entity : visible)
+    {
+        current.emplace(entity.id(), NetEntity::quantize(entity));
+    }
+
+    std::vector<sol::function> functions;
+    packet.clear();
+    SnapshotWriter writer(packet, functions);
+    writer.write(magic);
+    writer.write(PacketType::state);
+    writer.write(tick);
+    writer.write<std::uint32_t>(has_baseline ? client.acked_tick : 0);
+
+    std::vector<int> removed;
+    for (const auto &[id, entity] : baseline)
+    {
+        if (current.find(id) == current.end())
+        {
+            removed.push_back(id);
+        }
+    }
+    writer.write<std::uint32_t>(removed.size());
+    for (int id : removed)
+    {
+        writer.write<std::int32_t>(id);
+    }
+
+    const std::size_t count_offset = packet.size();
+    std::uint32_t count = 0;
+    writer.write(count);
+    for (auto it = current.begin(); it != current.end();)
+    {
+        auto before = baseline.find(it->first);
+        const NetEntity *previous = before != baseline.end() ? &before->second : nullptr;
+        if (packet.size() > max_packet_size)
+        {
+            // out of room, the client keeps what it had and gets the rest on the next tick
+            if (previous)
+            {
+                it->second = *previous;
+                ++it;
+            }
+            else
+            {
+                it = current.erase(it);
+            }
+            continue;
+        }
+        if (write_entity(writer, it->first, it->second, previous))
+        {
+            count++;
+        }
+        ++it;
+    }
+    std::memcpy(packet.data() + count_offset, &count, sizeof(count));
+
+    socket.send_to(client.address, packet);
+    client.bytes_sent += packet.size();
+    bytes_sent += packet.size();
+    client.sent.emplace_back(tick, std::move(current));
+    if (client.sent.size() > max_history)
+    {
+        client.sent.pop_front();
+    }
+}
+
+int ReplicationServer::get_client_count() const
+{
+    return clients.size();
+}
+
+std::uint64_t ReplicationServer::get_bytes_sent() const
+{
+    return bytes_sent;
+}
+
+// ============================================================
+// client
+// ============================================================
+ReplicationClient::ReplicationClient(std::shared_ptr<Registry> registry)
+{
+    this->registry = registry;
+}
+
+bool ReplicationClient::connect(std::uint16_t port)
+{
+    server = loopback(port);
+    return socket.open(0);
+}
+
+void ReplicationClient::queue_input(InputRecording::InputType type, std::int32_t code)
+{
+    inputs.push_back({0, type, code});
+}
+
+bool ReplicationClient::receive(std::uint32_t now, std::uint32_t timeout)
+{
+    if (last_heard == 0)
+    {
+        last_heard = now;
+    }
+    bool updated = false;
+    sockaddr_in from;
+    while (socket.receive(packet, from))
+    {
+        if (!same_address(from, server))
+        {
+            continue;
+        }
+        bytes_received += packet.size();
+        last_heard = now;
+        updated = read_state() || updated;
+    }
+    if (updated)
+    {
+        apply(received.back().second);
+    }
+    return now - last_heard <= timeout;
+}
+
+bool ReplicationClient::read_state()
+{
+    std::vector<sol::function> functions;
+    SnapshotReader reader(packet, functions);
+    if (reader.read<std::uint32_t>() != magic || reader.read<PacketType>() != PacketType::state)
+    {
+        return false;
+    }
+    const auto tick = reader.read<std::uint32_t>();
+    const auto baseline_tick = reader.read<std::uint32_t>();
+    if (!received.empty() && tick <= received.back().first)
+    {
+        // late or duplicated
+        return false;
+    }
+
+    NetState state;
+    if (baseline_tick != 0)
+    {
+        auto baseline = std::find_if(received.begin(), received.end(), [baseline_tick](const auto &received)
+                                     { return received.first == baseline_tick; });
+        if (baseline == received.end())
+        {
+            return false;
+        }
+        state = baseline->second;
+    }
+
+    const auto removed_count = reader.read<std::uint32_t>();
+    if (removed_count > reader.remaining() / sizeof(std::int32_t))
+    {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < removed_count; i++)
+    {
+        state.erase(reader.read<std::int32_t>());
+    }
+    const auto count = reader.read<std::uint32_t>();
+    if (count > reader.remaining() / (sizeof(std::int32_t) + 1))
+    {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        const auto id = reader.read<std::int32_t>();
+        const auto bits = reader.read<std::uint8_t>();
+        if (!(bits & spawn_bit) && state.find(id) == state.end())
+        {
+            return false;
+        }
+        read_entity(reader, state[id], bits);
+    }
+    if (!reader.is_valid())
+    {
+        return false;
+    }
+
+    received.emplace_back(tick, std::move(state));
+    if (received.size() > max_history)
+    {
+        received.pop_front();
+    }
+    return true;
+}
+
+Entity ReplicationClient::spawn(const NetEntity &net_entity)
+{
+    Entity entity = registry->create_entity();
+    entity.add_component<TransformComponent>(vec2(net_entity.x / 16.0f, net_entity.y / 16.0f),
+                                             vec2(net_entity.scale_x / 256.0f, net_entity.scale_y / 256.0f),
+                                             net_entity.rotation * 360.0 / 65536);
+    entity.add_component<SpriteComponent>(net_entity.asset_name, net_entity.width, net_entity.height, net_entity.z_index,
+                                          net_entity.flags & NetEntity::is_fixed, net_entity.frame_x, net_entity.frame_y);
+    entity.get_component<SpriteComponent>().flip = static_cast<SDL_RendererFlip>(net_entity.flip);
+    if (net_entity.flags & NetEntity::has_health)
+    {
+        entity.add_component<HealthComponent>(net_entity.health);
+    }
+    if (net_entity.flags & NetEntity::follows_camera)
+    {
+        entity.add_component<CameraFollowComponent>();
+    }
+    return entity;
+}
+
+void ReplicationClient::apply(const NetState &state)
+{
+    for (auto it = mirrors.begin(); it != mirrors.end();)
+    {
+        if (state.find(it->first) == state.end())
+        {
+            it->second.entity.kill();
+            it = mirrors.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (const auto &[id, net_entity] : state)
+    {
+        auto it = mirrors.find(id);
+        if (it == mirrors.end() || !it->second.state.same_kind(net_entity))
+        {
+            if (it != mirrors.end())
+            {
+                it->second.entity.kill();
+            }
+            mirrors.insert_or_assign(id, Mirror{spawn(net_entity), net_entity});
+            continue;
+        }
+
+        Mirror &mirror = it->second;
+        if (mirror.state.x != net_entity.x || mirror.state.y != net_entity.y || mirror.state.rotation != net_entity.rotation)
+        {
+            mirror.entity.patch<TransformComponent>([&](TransformComponent &transform)
+                                                    {
+                transform.position = vec2(net_entity.x / 16.0f, net_entity.y / 16.0f);
+                transform.rotation = net_entity.rotation * 360.0 / 65536; });
+        }
+        if (mirror.state.frame_x != net_entity.frame_x || mirror.state.frame_y != net_entity.frame_y)
+        {
+            mirror.entity.patch<SpriteComponent>([&](SpriteComponent &sprite)
+                                                 {
+                sprite.src_rect.x = net_entity.frame_x;
+                sprite.src_rect.y = net_entity.frame_y; });
+        }
+        if (mirror.state.health != net_entity.health && mirror.entity.has_component<HealthComponent>())
+        {
+            mirror.entity.get_component<HealthComponent>().health = net_entity.health;
+        }
+        mirror.state = net_entity;
+    }
+}
+
+void ReplicationClient::send(const SDL_Rect &camera)
+{
+    std::vector<sol::function> functions;
+    packet.clear();
+    SnapshotWriter writer(packet, functions);
+    writer.write(magic);
+    writer.write(PacketType::client_update);
+    writer.write<std::uint32_t>(received.empty() ? 0 : received.back().first);
+    writer.write(camera);
+    writer.write<std::uint16_t>(inputs.size());
+    for (const auto &input : inputs)
+    {
+        writer.write(input.type);
+        writer.write(input.code);
+    }
+    socket.send_to(server, packet);
+    inputs.clear();
+}
+
+void ReplicationClient::disconnect()
+{
+    std::vector<sol::function> functions;
+    packet.clear();
+    SnapshotWriter writer(packet, functions);
+    writer.write(magic);
+    writer.write(PacketType::bye);
+    socket.send_to(server, packet);
+    socket.close();
+}
+
+std::uint64_t ReplicationClient::get_bytes_received() const
+{
+    return bytes_received;
+}
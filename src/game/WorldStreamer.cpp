@@ -0,0 +1,271 @@
+#include "WorldStreamer.hpp"
+#include "AssetLoader.hpp"
+#include <algorithm>
+#include <cmath>
+
+WorldStreamer::WorldStreamer(std::shared_ptr<Registry> registry, std::shared_ptr<AssetLoader> asset_loader,
+                             int chunk_size, int residency_radius, int max_commits_per_frame)
+{
+    this->registry = registry;
+    this->asset_loader = asset_loader;
+    this->chunk_size = std::max(1, chunk_size);
+    this->residency_radius = std::max(0, residency_radius);
+    this->max_commits_per_frame = std::max(1, max_commits_per_frame);
+    ready = std::make_shared<ReadyQueue>();
+}
+
+float WorldStreamer::chunk_world_size() const
+{
+    return chunk_size * constants::tile_size * constants::tile_scale;
+}
+
+void WorldStreamer::set_tilemap(const std::string &texture, int rows, int cols, const std::vector<std::uint8_t> &tiles)
+{
+    clear();
+    chunk_rows = (rows + chunk_size - 1) / chunk_size;
+    chunk_cols = (cols + chunk_size - 1) / chunk_size;
+    chunks.resize(chunk_rows * chunk_cols);
+    source = std::make_shared<const TileSource>(TileSource{texture, rows, cols, chunk_size, chunk_cols, tiles});
+}
+
+bool WorldStreamer::can_stream(const Prefab &bundle)
+{
+    // anything that moves, collides, shoots, takes damage or runs a script has to stay resident
+    Signature streamable;
+    streamable.set(Component<TransformComponent>::id());
+    streamable.set(Component<SpriteComponent>::id());
+    streamable.set(Component<AnimationComponent>::id());
+
+    const Signature &signature = bundle.get_signature();
+    const SpriteComponent *sprite = bundle.get<SpriteComponent>();
+    // grouped entities are looked up by gameplay code, streamed ones are put in the "scenery" group instead
+    return (signature & ~streamable).none() && bundle.get_group().empty() &&
+           bundle.get<TransformComponent>() && sprite && !sprite->is_fixed;
+}
+
+void WorldStreamer::add_scenery(const Prefab &bundle)
+{
+    if (chunks.empty())
+    {
+        return;
+    }
+    const vec2 position = bundle.get<TransformComponent>()->position;
+    const int x = std::clamp(static_cast<int>(std::floor(position.x / chunk_world_size())), 0, chunk_cols - 1);
+    const int y = std::clamp(static_cast<int>(std::floor(position.y / chunk_world_size())), 0, chunk_rows - 1);
+
+    chunks[y * chunk_cols + x].scenery.push_back(scenery.size());
+    scenery.push_back(bundle);
+    scenery.back().set_group("scenery");
+}
+
+void WorldStreamer::clear()
+{
+    for (int index : resident_chunks)
+    {
+        for (auto &entity : chunks[index].entities)
+        {
+            entity.kill();
+        }
+    }
+    resident_chunks.clear();
+    chunks.clear();
+    scenery.clear();
+    chunk_rows = chunk_cols = 0;
+    source.reset();
+    generation++;
+    {
+        std::lock_guard<std::mutex> lock(ready->mutex);
+        ready->chunks.clear();
+    }
+}
+
+void WorldStreamer::resync()
+{
+    // the registry now holds whatever chunks were resident when the snapshot was taken,
+    // drop them and let update() stream the chunks around the camera again
+    for (const auto &group : {"tiles"s, "scenery"s})
+    {
+        for (auto &entity : registry->get_entities_by_group(group))
+        {
+            entity.kill();
+        }
+    }
+    for (int index : resident_chunks)
+    {
+        chunks[index].resident = false;
+        chunks[index].entities.clear();
+    }
+    resident_chunks.clear();
+    for (auto &chunk : chunks)
+    {
+        chunk.requested = false;
+    }
+    generation++;
+}
+
+WorldStreamer::PreparedChunk WorldStreamer::prepare(const TileSource &source, int index, int generation)
+{
+    using namespace constants;
+    const int first_col = (index % source.chunk_cols) * source.chunk_size;
+    const int first_row = (index / source.chunk_cols) * source.chunk_size;
+    const int last_col = std::min(source.cols, first_col + source.chunk_size);
+    const int last_row = std::min(source.rows, first_row + source.chunk_size);
+
+    PreparedChunk prepared{index, generation, {}, {}};
+    prepared.transforms.reserve((last_col - first_col) * (last_row - first_row));
+    prepared.sprites.reserve((last_col - first_col) * (last_row - first_row));
+    for (int y = first_row; y < last_row; y++)
+    {
+        for (int x = first_col; x < last_col; x++)
+        {
+            std::uint8_t code = source.tiles[y * source.cols + x];
+            prepared.transforms.emplace_back(vec2(x * (tile_scale * tile_size), y * (tile_scale * tile_size)),
+                                             vec2(tile_scale, tile_scale), 0.0);
+            prepared.sprites.emplace_back(source.texture, tile_size, tile_size,
+                                          0, false, (code % 10) * tile_size, (code / 10) * tile_size);
+        }
+    }
+    return prepared;
+}
+
+void WorldStreamer::commit(PreparedChunk &prepared)
+{
+    auto &chunk = chunks[prepared.index];
+    chunk.entities = registry->create_many<TransformComponent, SpriteComponent>(
+        prepared.transforms.size(),
+        [&](int i, Entity tile, TransformComponent &transform, SpriteComponent &sprite)
+        {
+            tile.group("tiles");
+            transform = prepared.transforms[i];
+            sprite = std::move(prepared.sprites[i]);
+        });
+    for (int id : chunk.scenery)
+    {
+        chunk.entities.push_back(scenery[id].instantiate(*registry));
+    }
+
+    chunk.resident = true;
+    chunk.requested = false;
+    resident_chunks.push_back(prepared.index);
+}
+
+void WorldStreamer::evict(int index)
+{
+    auto &chunk = chunks[index];
+    for (auto &entity : chunk.entities)
+    {
+        entity.kill();
+    }
+    chunk.entities.clear();
+    chunk.resident = false;
+}
+
+void WorldStreamer::update(const SDL_Rect &camera)
+{
+    if (chunks.empty())
+    {
+        return;
+    }
+
+    // chunk range covered by the camera
+    const float size = chunk_world_size();
+    const int view_x0 = std::clamp(static_cast<int>(std::floor(camera.x / size)), 0, chunk_cols - 1);
+    const int view_y0 = std::clamp(static_cast<int>(std::floor(camera.y / size)), 0, chunk_rows - 1);
+    const int view_x1 = std::clamp(static_cast<int>(std::floor((camera.x + camera.w) / size)), 0, chunk_cols - 1);
+    const int view_y1 = std::clamp(static_cast<int>(std::floor((camera.y + camera.h) / size)), 0, chunk_rows - 1);
+    auto distance = [&](int index)
+    {
+        const int x = index % chunk_cols;
+        const int y = index / chunk_cols;
+        const int dx = x < view_x0 ? view_x0 - x : (x > view_x1 ? x - view_x1 : 0);
+        const int dy = y < view_y0 ? view_y0 - y : (y > view_y1 ? y - view_y1 : 0);
+        return std::max(dx, dy);
+    };
+
+    // take what the workers finished, stale or no longer wanted chunks are dropped
+    std::vector<PreparedChunk> finished;
+    {
+        std::lock_guard<std::mutex> lock(ready->mutex);
+        finished.swap(ready->chunks);
+    }
+    int commits = 0;
+    for (auto &prepared : finished)
+    {
+        if (prepared.generation != generation || chunks[prepared.index].resident)
+        {
+            continue;
+        }
+        if (distance(prepared.index) > residency_radius + 1)
+        {
+            chunks[prepared.index].requested = false;
+        }
+        else if (commits < max_commits_per_frame)
+        {
+            commit(prepared);
+            commits++;
+        }
+        else
+        {
+            // over this frame's budget, try again next frame
+            std::lock_guard<std::mutex> lock(ready->mutex);
+            ready->chunks.push_back(std::move(prepared));
+        }
+    }
+
+    for (int y = std::max(0, view_y0 - residency_radius); y <= std::min(chunk_rows - 1, view_y1 + residency_radius); y++)
+    {
+        for (int x = std::max(0, view_x0 - residency_radius); x <= std::min(chunk_cols - 1, view_x1 + residency_radius); x++)
+        {
+            const int index = y * chunk_cols + x;
+            auto &chunk = chunks[index];
+            if (chunk.resident)
+            {
+                continue;
+            }
+            if (distance(index) == 0 || synchronous)
+            {
+                // visible now, can't wait for a worker
+                PreparedChunk prepared = prepare(*source, index, generation);
+                commit(prepared);
+            }
+            else if (!chunk.requested)
+            {
+                chunk.requested = true;
+                auto tile_source = source;
+                auto queue = ready;
+                int chunk_generation = generation;
+                asset_loader->run_in_background([tile_source, queue, index, chunk_generation]
+                                                {
+                    PreparedChunk prepared = prepare(*tile_source, index, chunk_generation);
+                    std::lock_guard<std::mutex> lock(queue->mutex);
+                    queue->chunks.push_back(std::move(prepared)); });
+            }
+        }
+    }
+
+    // one chunk of slack past the radius so chunks on the border don't flip every frame
+    auto it = std::remove_if(resident_chunks.begin(), resident_chunks.end(), [&](int index)
+                             {
+        if (distance(index) <= residency_radius + 1)
+        {
+            return false;
+        }
+        evict(index);
+        return true; });
+    resident_chunks.erase(it, resident_chunks.end());
+}
+
+void WorldStreamer::set_synchronous(bool synchronous)
+{
+    this->synchronous = synchronous;
+}
+
+int WorldStreamer::get_resident_chunk_count() const
+{
+    return resident_chunks.size();
+}
+
+int WorldStreamer::get_chunk_count() const
+{
+    return chunks.size();
+}
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <chrono>
 #include <ctime>
+#include <mutex>
+
+// asset loader workers log too, std::localtime and the streams are shared
+static std::mutex log_mutex;
 
 std::string CurrentDateTimeToString()
 {
@@ -16,12 +20,14 @@ std::string CurrentDateTimeToString()
 
 void Logger::info(std::string_view message)
 {
+    std::lock_guard<std::mutex> lock(log_mutex);
     std::cout << "\x1B[32m"
               << "[INFO " << CurrentDateTimeToString() + "] " << message << "\033[0m" << std::endl;
 }
 
 void Logger::error(std::string_view message)
 {
+    std::lock_guard<std::mutex> lock(log_mutex);
     std::cerr << "\x1B[91m"
               << "[ERROR " << CurrentDateTimeToString() + "] " << message << "\033[0m" << std::endl;
 }
\ No newline at end of file
@@ -1,10 +1,31 @@
 #include <iostream>
+#include <string>
 #include <Remap.hpp>
 #include "Game.hpp"
 
-int main()
+int main(int argc, char *argv[])
 {
     Game game{};
+    const std::string mode = argc > 1 ? argv[1] : "";
+    // --replay <file> plays a recorded session without a window and checks it ends up the same
+    if (argc == 3 && mode == "--replay")
+    {
+        return game.replay(argv[2]) ? 0 : 1;
+    }
+    // --server [seconds] simulates for clients on localhost, --client [--headless] joins it
+    if (mode == "--server")
+    {
+        return game.serve(argc > 2 ? std::stoi(argv[2]) : 0) ? 0 : 1;
+    }
+    if (mode == "--client")
+    {
+        return game.join(argc > 2 && std::string(argv[2]) == "--headless") ? 0 : 1;
+    }
+    // --script-bench [entities] compares script access through the bindings and the luajit ffi
+    if (mode == "--script-bench")
+    {
+        return game.bench_scripts(argc > 2 ? std::stoi(argv[2]) : 1000) ? 0 : 1;
+    }
     game.init();
     game.setup();
     game.run();
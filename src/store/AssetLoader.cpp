@@ -0,0 +1,245 @@
+#include "AssetLoader.hpp"
+#include "TextureAtlas.hpp"
+#include <SDL2/SDL_image.h>
+#include <Logger.hpp>
+#include <fstream>
+#include <iterator>
+
+AssetLoader::AssetLoader(int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers.emplace_back(&AssetLoader::work, this);
+    }
+    all_loaded_future = all_loaded.get_future().share();
+    all_loaded.set_value();
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        stopping = true;
+    }
+    jobs_available.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // nothing took ownership of results that were never polled
+    for (auto &texture : decoded_textures)
+    {
+        SDL_FreeSurface(texture.surface);
+    }
+}
+
+void AssetLoader::work()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_available.wait(lock, [this]
+                                { return stopping || !jobs.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void AssetLoader::enqueue(std::function<void()> job)
+{
+    // the first job after everything finished starts a new batch
+    if (is_done())
+    {
+        all_loaded = std::promise<void>();
+        all_loaded_future = all_loaded.get_future().share();
+    }
+    push_job(std::move(job));
+}
+
+void AssetLoader::push_job(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobs_available.notify_one();
+}
+
+void AssetLoader::run_in_background(std::function<void()> job)
+{
+    push_job(std::move(job));
+}
+
+void AssetLoader::queue_texture(const std::string &name, const std::string &file_path)
+{
+    enqueue([this, name, file_path]
+            {
+                SDL_Surface *surface = IMG_Load(file_path.c_str());
+                if (!surface)
+                {
+                    Logger::error("Failed to load texture " + file_path);
+                }
+                decoded++;
+                std::lock_guard<std::mutex> lock(results_mutex);
+                decoded_textures.push_back({name, surface}); });
+    total++;
+}
+
+void AssetLoader::queue_font(const std::string &name, const std::string &file_path, int size)
+{
+    // SDL_ttf isn't thread safe, workers only read the file and poll opens the font from memory
+    enqueue([this, name, file_path, size]
+            {
+                std::ifstream file(file_path, std::ios::binary);
+                std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                decoded++;
+                std::lock_guard<std::mutex> lock(results_mutex);
+                read_fonts.push_back({name, file_path, std::move(data), size}); });
+    total++;
+}
+
+void AssetLoader::queue_texture_atlas(std::shared_ptr<TextureAtlasBuilder> atlas, const std::string &cache_dir)
+{
+    const int num_sources = atlas->size();
+    if (num_sources == 0)
+    {
+        return;
+    }
+    enqueue([this, atlas, cache_dir, num_sources]
+            {
+                auto publish = [this, atlas, num_sources]
+                {
+                    std::lock_guard<std::mutex> lock(results_mutex);
+                    packed_atlases.push_back(atlas);
+                };
+
+                if (!cache_dir.empty() && atlas->load_cache(cache_dir))
+                {
+                    decoded += num_sources;
+                    publish();
+                    return;
+                }
+
+                // fan out one decode per source, whichever decode finishes last packs the pages
+                auto remaining = std::make_shared<std::atomic<int>>(num_sources);
+                for (int i = 0; i < num_sources; i++)
+                {
+                    push_job([this, atlas, cache_dir, remaining, publish, i]
+                            {
+                                atlas->decode(i);
+                                decoded++;
+                                if (--(*remaining) == 0)
+                                {
+                                    atlas->pack();
+                                    if (!cache_dir.empty())
+                                    {
+                                        atlas->save_cache(cache_dir);
+                                    }
+                                    publish();
+                                } });
+                } });
+    // after enqueue, which only opens a new batch while everything queued before is done
+    total += num_sources;
+}
+
+void AssetLoader::poll(SDL_Renderer *renderer, AssetStore &asset_store, int max_uploads)
+{
+    std::vector<DecodedTexture> textures;
+    std::vector<ReadFont> fonts;
+    std::vector<std::shared_ptr<TextureAtlasBuilder>> atlases;
+    {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        fonts.swap(read_fonts);
+        atlases.swap(packed_atlases);
+
+        // leave uploads over the budget for the next poll
+        const int num_textures = max_uploads < 0 ? decoded_textures.size() : std::min<int>(max_uploads, decoded_textures.size());
+        textures.assign(decoded_textures.begin(), decoded_textures.begin() + num_textures);
+        decoded_textures.erase(decoded_textures.begin(), decoded_textures.begin() + num_textures);
+    }
+
+    for (const auto &texture : textures)
+    {
+        asset_store.add_texture(renderer, texture.name, texture.surface);
+        loaded.insert(texture.name);
+        uploaded++;
+    }
+    for (auto &font : fonts)
+    {
+        asset_store.add_font(font.name, std::move(font.data), font.size);
+        if (!asset_store.has_font(font.name))
+        {
+            Logger::error("Failed to load font " + font.file_path);
+        }
+        loaded.insert(font.name);
+        uploaded++;
+    }
+    for (const auto &atlas : atlases)
+    {
+        asset_store.add_texture_atlas(renderer, *atlas);
+        for (int i = 0; i < atlas->size(); i++)
+        {
+            loaded.insert(atlas->get_name(i));
+        }
+        uploaded += atlas->size();
+    }
+
+    finish_if_done();
+}
+
+void AssetLoader::wait(SDL_Renderer *renderer, AssetStore &asset_store)
+{
+    while (!is_done())
+    {
+        poll(renderer, asset_store);
+        if (!is_done())
+        {
+            SDL_Delay(1);
+        }
+    }
+}
+
+void AssetLoader::finish_if_done()
+{
+    if (is_done() && all_loaded_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        all_loaded.set_value();
+    }
+}
+
+bool AssetLoader::is_loaded(const std::string &name) const
+{
+    return loaded.find(name) != loaded.end();
+}
+
+bool AssetLoader::is_done() const
+{
+    return uploaded >= total;
+}
+
+float AssetLoader::progress() const
+{
+    if (total == 0)
+    {
+        return 1.0f;
+    }
+    return std::min(1.0f, (decoded + uploaded) / (2.0f * total));
+}
+
+std::shared_future<void> AssetLoader::done() const
+{
+    return all_loaded_future;
+}
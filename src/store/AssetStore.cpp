@@ -1,5 +1,72 @@
 #include "Store.hpp"
+#include "TextureAtlas.hpp"
 #include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <filesystem>
+
+// ============================================================
+// AssetHandle and AssetScope
+// ============================================================
+AssetHandle::AssetHandle(std::shared_ptr<AssetStore> asset_store, AssetType type, const std::string &name)
+    : asset_store(asset_store), type(type), name(name)
+{
+    asset_store->retain(type, name);
+}
+
+AssetHandle::AssetHandle(const AssetHandle &other) : asset_store(other.asset_store), type(other.type), name(other.name)
+{
+    if (asset_store)
+    {
+        asset_store->retain(type, name);
+    }
+}
+
+AssetHandle &AssetHandle::operator=(AssetHandle other)
+{
+    std::swap(asset_store, other.asset_store);
+    std::swap(type, other.type);
+    std::swap(name, other.name);
+    return *this;
+}
+
+AssetHandle::~AssetHandle()
+{
+    // moved-from handles no longer hold a reference
+    if (asset_store)
+    {
+        asset_store->release(type, name);
+    }
+}
+
+const std::string &AssetHandle::get_name() const
+{
+    return name;
+}
+
+void AssetScope::add(AssetHandle handle)
+{
+    handles.push_back(std::move(handle));
+}
+
+void AssetScope::clear()
+{
+    handles.clear();
+}
+
+std::size_t AssetScope::size() const
+{
+    return handles.size();
+}
+
+// ============================================================
+// AssetStore
+// ============================================================
+static std::size_t texture_size_in_bytes(SDL_Texture *texture)
+{
+    int width = 0, height = 0;
+    SDL_QueryTexture(texture, NULL, NULL, &width, &height);
+    return static_cast<std::size_t>(width) * height * 4;
+}
 
 AssetStore::~AssetStore()
 {
@@ -8,41 +75,425 @@ AssetStore::~AssetStore()
 
 void AssetStore::clear_assets()
 {
-    for (const auto &texture : textures)
+    for (int texture_id = 0; texture_id < textures.size(); texture_id++)
+    {
+        unload_texture(texture_id);
+    }
+    for (int page = 0; page < atlas_pages.size(); page++)
+    {
+        unload_page(page);
+    }
+    for (auto &[name, font] : fonts)
     {
-        SDL_DestroyTexture(texture.second);
+        unload_font(font);
     }
+}
+
+void AssetStore::set_texture(const std::string &name, SDL_Texture *texture, SDL_Point offset, int page, std::size_t bytes)
+{
+    const auto texture_id = get_texture_id(name);
+    // replacing a texture frees what it pointed at before
+    unload_texture(texture_id);
+
+    auto &entry = textures[texture_id];
+    entry.texture = texture;
+    entry.offset = offset;
+    entry.page = page;
+    entry.bytes = bytes;
+    entry.last_used = ++clock;
 
-    for (const auto &font : fonts)
+    if (page < 0)
     {
-        TTF_CloseFont(font.second);
+        texture_bytes += bytes;
     }
+    else
+    {
+        atlas_pages[page].texture_ids.push_back(texture_id);
+    }
+}
 
-    textures.clear();
-    fonts.clear();
+void AssetStore::unload_texture(int texture_id)
+{
+    auto &entry = textures[texture_id];
+    if (!entry.texture)
+    {
+        return;
+    }
+
+    if (entry.page < 0)
+    {
+        SDL_DestroyTexture(entry.texture);
+        texture_bytes -= entry.bytes;
+    }
+    else
+    {
+        // a region only detaches from its page, the page goes once it has no regions left
+        auto &page = atlas_pages[entry.page];
+        page.texture_ids.erase(std::remove(page.texture_ids.begin(), page.texture_ids.end(), texture_id), page.texture_ids.end());
+        if (page.texture_ids.empty())
+        {
+            unload_page(entry.page);
+        }
+    }
+
+    entry.texture = nullptr;
+    entry.offset = {0, 0};
+    entry.page = -1;
+}
+
+void AssetStore::unload_page(int page)
+{
+    auto &atlas_page = atlas_pages[page];
+    if (!atlas_page.texture)
+    {
+        return;
+    }
+
+    for (const auto texture_id : atlas_page.texture_ids)
+    {
+        auto &entry = textures[texture_id];
+        entry.texture = nullptr;
+        entry.offset = {0, 0};
+        entry.page = -1;
+    }
+    atlas_page.texture_ids.clear();
+
+    SDL_DestroyTexture(atlas_page.texture);
+    texture_bytes -= atlas_page.bytes;
+    atlas_page.texture = nullptr;
+}
+
+void AssetStore::unload_font(FontEntry &font)
+{
+    if (!font.font)
+    {
+        return;
+    }
+    TTF_CloseFont(font.font);
+    font_bytes -= font.bytes;
+    font.font = nullptr;
+    font.data = std::string();
 }
 
 void AssetStore::add_texture(SDL_Renderer *renderer, const std::string &name, const std::string &file_path)
 {
-    const auto surface = IMG_Load(file_path.c_str());
+    add_texture(renderer, name, IMG_Load(file_path.c_str()));
+}
+
+void AssetStore::add_texture(SDL_Renderer *renderer, const std::string &name, SDL_Surface *surface)
+{
     const auto texture = SDL_CreateTextureFromSurface(renderer, surface);
     SDL_FreeSurface(surface);
 
-    textures.emplace(name, texture);
+    set_texture(name, texture, {0, 0}, -1, texture ? texture_size_in_bytes(texture) : 0);
+    enforce_budget();
+}
+
+void AssetStore::add_texture_atlas(SDL_Renderer *renderer, const TextureAtlasBuilder &atlas)
+{
+    const int first_page = atlas_pages.size();
+    for (const auto surface : atlas.get_pages())
+    {
+        AtlasPage page;
+        page.texture = SDL_CreateTextureFromSurface(renderer, surface);
+        page.bytes = static_cast<std::size_t>(surface->w) * surface->h * 4;
+        texture_bytes += page.bytes;
+        atlas_pages.push_back(page);
+    }
+
+    for (const auto &[name, region] : atlas.get_regions())
+    {
+        const auto page = first_page + region.page;
+        set_texture(name, atlas_pages[page].texture, {region.rect.x, region.rect.y}, page,
+                    static_cast<std::size_t>(region.rect.w) * region.rect.h * 4);
+    }
+
+    for (const auto &[name, file_path] : atlas.get_oversized())
+    {
+        add_texture(renderer, name, file_path);
+    }
+    enforce_budget();
 }
 
 SDL_Texture *AssetStore::get_texture(const std::string &name)
 {
-    return textures[name];
+    auto &entry = textures[get_texture_id(name)];
+    entry.last_used = ++clock;
+    return entry.texture;
+}
+
+int AssetStore::get_texture_id(const std::string &name)
+{
+    auto it = texture_ids.find(name);
+    if (it != texture_ids.end())
+    {
+        return it->second;
+    }
+
+    // ids can be handed out before the texture is loaded, the entry is filled by add_texture
+    const int texture_id = textures.size();
+    texture_ids.emplace(name, texture_id);
+    textures.push_back(TextureEntry{name});
+    return texture_id;
+}
+
+SDL_Texture *AssetStore::get_texture(int texture_id) const
+{
+    return textures[texture_id].texture;
+}
+
+const SDL_Point &AssetStore::get_texture_offset(int texture_id) const
+{
+    return textures[texture_id].offset;
+}
+
+int AssetStore::get_texture_batch(int texture_id) const
+{
+    const auto &entry = textures[texture_id];
+    return entry.page >= 0 ? entry.page : atlas_pages.size() + texture_id;
+}
+
+bool AssetStore::has_texture(const std::string &name) const
+{
+    auto it = texture_ids.find(name);
+    return it != texture_ids.end() && textures[it->second].texture;
 }
 
 void AssetStore::add_font(SDL_Renderer *renderer, const std::string &name, const std::string &file_path, int size)
 {
-    const auto font = TTF_OpenFont(file_path.c_str(), size);
-    fonts.emplace(name, font);
+    std::error_code ec;
+    const auto bytes = std::filesystem::file_size(file_path, ec);
+    add_font(name, TTF_OpenFont(file_path.c_str(), size), ec ? 0 : bytes);
+}
+
+void AssetStore::add_font(const std::string &name, TTF_Font *font, std::size_t bytes)
+{
+    auto &entry = fonts[name];
+    unload_font(entry);
+    entry.font = font;
+    entry.bytes = font ? bytes : 0;
+    entry.last_used = ++clock;
+    font_bytes += entry.bytes;
+    enforce_budget();
+}
+
+void AssetStore::add_font(const std::string &name, std::string data, int size)
+{
+    auto &entry = fonts[name];
+    unload_font(entry);
+    // FreeType reads glyphs from the buffer for as long as the font is open
+    entry.data = std::move(data);
+    SDL_RWops *source = entry.data.empty() ? nullptr : SDL_RWFromConstMem(entry.data.data(), entry.data.size());
+    entry.font = source ? TTF_OpenFontRW(source, 1, size) : nullptr;
+    entry.bytes = entry.font ? entry.data.size() : 0;
+    if (!entry.font)
+    {
+        entry.data = std::string();
+    }
+    entry.last_used = ++clock;
+    font_bytes += entry.bytes;
+    enforce_budget();
 }
 
 TTF_Font *AssetStore::get_font(const std::string &name)
 {
-    return fonts[name];
-}
\ No newline at end of file
+    auto &entry = fonts[name];
+    entry.last_used = ++clock;
+    return entry.font;
+}
+
+bool AssetStore::has_font(const std::string &name) const
+{
+    auto it = fonts.find(name);
+    return it != fonts.end() && it->second.font;
+}
+
+// ============================================================
+// reference counting and eviction
+// ============================================================
+AssetHandle AssetStore::acquire(AssetType type, const std::string &name)
+{
+    return AssetHandle(shared_from_this(), type, name);
+}
+
+void AssetStore::retain(AssetType type, const std::string &name)
+{
+    if (type == AssetType::texture)
+    {
+        auto &entry = textures[get_texture_id(name)];
+        entry.ref_count++;
+        entry.last_used = ++clock;
+    }
+    else
+    {
+        auto &entry = fonts[name];
+        entry.ref_count++;
+        entry.last_used = ++clock;
+    }
+}
+
+void AssetStore::release(AssetType type, const std::string &name)
+{
+    if (type == AssetType::texture)
+    {
+        auto &entry = textures[get_texture_id(name)];
+        entry.ref_count = std::max(0, entry.ref_count - 1);
+        entry.last_used = ++clock;
+    }
+    else
+    {
+        auto &entry = fonts[name];
+        entry.ref_count = std::max(0, entry.ref_count - 1);
+        entry.last_used = ++clock;
+    }
+    enforce_budget();
+}
+
+bool AssetStore::is_page_referenced(int page) const
+{
+    for (const auto texture_id : atlas_pages[page].texture_ids)
+    {
+        if (textures[texture_id].ref_count > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t AssetStore::page_last_used(int page) const
+{
+    std::uint64_t last_used = 0;
+    for (const auto texture_id : atlas_pages[page].texture_ids)
+    {
+        last_used = std::max(last_used, textures[texture_id].last_used);
+    }
+    return last_used;
+}
+
+void AssetStore::set_memory_budget(std::size_t texture_budget, std::size_t font_budget)
+{
+    this->texture_budget = texture_budget;
+    this->font_budget = font_budget;
+    enforce_budget();
+}
+
+void AssetStore::enforce_budget()
+{
+    // textures: standalone ones and whole atlas pages compete on the same LRU order
+    while (texture_budget > 0 && texture_bytes > texture_budget)
+    {
+        int victim_texture = -1;
+        int victim_page = -1;
+        std::uint64_t oldest = UINT64_MAX;
+        for (int texture_id = 0; texture_id < textures.size(); texture_id++)
+        {
+            const auto &entry = textures[texture_id];
+            if (entry.texture && entry.page < 0 && entry.ref_count == 0 && entry.last_used < oldest)
+            {
+                oldest = entry.last_used;
+                victim_texture = texture_id;
+            }
+        }
+        for (int page = 0; page < atlas_pages.size(); page++)
+        {
+            if (atlas_pages[page].texture && !is_page_referenced(page) && page_last_used(page) < oldest)
+            {
+                oldest = page_last_used(page);
+                victim_page = page;
+                victim_texture = -1;
+            }
+        }
+
+        if (victim_page >= 0)
+        {
+            unload_page(victim_page);
+        }
+        else if (victim_texture >= 0)
+        {
+            unload_texture(victim_texture);
+        }
+        else
+        {
+            break; // everything left is referenced
+        }
+    }
+
+    while (font_budget > 0 && font_bytes > font_budget)
+    {
+        FontEntry *victim = nullptr;
+        for (auto &[name, entry] : fonts)
+        {
+            if (entry.font && entry.ref_count == 0 && (!victim || entry.last_used < victim->last_used))
+            {
+                victim = &entry;
+            }
+        }
+        if (!victim)
+        {
+            break;
+        }
+        unload_font(*victim);
+    }
+}
+
+void AssetStore::unload_unreferenced()
+{
+    for (int texture_id = 0; texture_id < textures.size(); texture_id++)
+    {
+        if (textures[texture_id].page < 0 && textures[texture_id].ref_count == 0)
+        {
+            unload_texture(texture_id);
+        }
+    }
+    for (int page = 0; page < atlas_pages.size(); page++)
+    {
+        if (!is_page_referenced(page))
+        {
+            unload_page(page);
+        }
+    }
+    for (auto &[name, entry] : fonts)
+    {
+        if (entry.ref_count == 0)
+        {
+            unload_font(entry);
+        }
+    }
+}
+
+void AssetStore::collect_unreferenced()
+{
+    if (texture_budget == 0 && font_budget == 0)
+    {
+        unload_unreferenced();
+    }
+    else
+    {
+        enforce_budget();
+    }
+}
+
+std::vector<AssetStats> AssetStore::get_stats() const
+{
+    std::vector<AssetStats> stats;
+    for (const auto &entry : textures)
+    {
+        stats.push_back({entry.name, AssetType::texture, entry.bytes, entry.ref_count, entry.texture != nullptr});
+    }
+    for (const auto &[name, entry] : fonts)
+    {
+        stats.push_back({name, AssetType::font, entry.bytes, entry.ref_count, entry.font != nullptr});
+    }
+    return stats;
+}
+
+std::size_t AssetStore::get_texture_bytes() const
+{
+    return texture_bytes;
+}
+
+std::size_t AssetStore::get_font_bytes() const
+{
+    return font_bytes;
+}
@@ -0,0 +1,257 @@
+#include "TextureAtlas.hpp"
+#include <SDL2/SDL_image.h>
+#include <Logger.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+TextureAtlasBuilder::TextureAtlasBuilder(int max_size, int padding)
+{
+    this->max_size = max_size;
+    this->padding = padding;
+}
+
+TextureAtlasBuilder::~TextureAtlasBuilder()
+{
+    for (auto &source : sources)
+    {
+        SDL_FreeSurface(source.surface);
+    }
+    free_pages();
+}
+
+void TextureAtlasBuilder::free_pages()
+{
+    for (auto page : pages)
+    {
+        SDL_FreeSurface(page);
+    }
+    pages.clear();
+    regions.clear();
+    oversized.clear();
+}
+
+void TextureAtlasBuilder::add(const std::string &name, const std::string &file_path)
+{
+    sources.push_back({name, file_path, nullptr});
+}
+
+bool TextureAtlasBuilder::empty() const
+{
+    return sources.empty();
+}
+
+std::size_t TextureAtlasBuilder::size() const
+{
+    return sources.size();
+}
+
+const std::string &TextureAtlasBuilder::get_name(int index) const
+{
+    return sources[index].name;
+}
+
+void TextureAtlasBuilder::build()
+{
+    for (int i = 0; i < sources.size(); i++)
+    {
+        decode(i);
+    }
+    pack();
+}
+
+void TextureAtlasBuilder::decode(int index)
+{
+    auto &source = sources[index];
+    SDL_Surface *loaded = IMG_Load(source.file_path.c_str());
+    if (!loaded)
+    {
+        Logger::error("Failed to load texture " + source.file_path);
+        return;
+    }
+    source.surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    // copy alpha as is instead of blending onto the transparent page
+    SDL_SetSurfaceBlendMode(source.surface, SDL_BLENDMODE_NONE);
+}
+
+void TextureAtlasBuilder::pack()
+{
+    free_pages();
+
+    std::vector<Source *> packable;
+    for (auto &source : sources)
+    {
+        if (!source.surface)
+        {
+            continue;
+        }
+        if (source.surface->w + 2 * padding > max_size || source.surface->h + 2 * padding > max_size)
+        {
+            oversized.emplace(source.name, source.file_path);
+            continue;
+        }
+        packable.push_back(&source);
+    }
+
+    std::stable_sort(packable.begin(), packable.end(), [](const Source *a, const Source *b)
+                     { return a->surface->h > b->surface->h; });
+
+    // place images left to right on shelves, open a new page when the current one is full
+    std::vector<int> page_heights;
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    for (auto source : packable)
+    {
+        const int width = source->surface->w + 2 * padding;
+        const int height = source->surface->h + 2 * padding;
+
+        if (page_heights.empty() || shelf_x + width > max_size)
+        {
+            shelf_x = 0;
+            shelf_y += shelf_height;
+            shelf_height = 0;
+        }
+        if (page_heights.empty() || shelf_y + height > max_size)
+        {
+            page_heights.push_back(0);
+            shelf_x = shelf_y = shelf_height = 0;
+        }
+
+        const int page = page_heights.size() - 1;
+        regions[source->name] = {page, {shelf_x + padding, shelf_y + padding, source->surface->w, source->surface->h}};
+        shelf_x += width;
+        shelf_height = std::max(shelf_height, height);
+        page_heights[page] = std::max(page_heights[page], shelf_y + shelf_height);
+    }
+
+    for (const auto height : page_heights)
+    {
+        pages.push_back(SDL_CreateRGBSurfaceWithFormat(0, max_size, height, 32, SDL_PIXELFORMAT_RGBA32));
+    }
+    for (auto source : packable)
+    {
+        auto &region = regions[source->name];
+        SDL_BlitSurface(source->surface, NULL, pages[region.page], &region.rect);
+    }
+
+    for (auto &source : sources)
+    {
+        SDL_FreeSurface(source.surface);
+        source.surface = nullptr;
+    }
+
+    Logger::info("Packed " + std::to_string(regions.size()) + " textures into " + std::to_string(pages.size()) + " atlas pages");
+}
+
+// identifies the inputs of a packing run, a cached atlas is reused only when this matches
+std::string TextureAtlasBuilder::cache_signature() const
+{
+    std::ostringstream signature;
+    signature << "atlas 1 " << max_size << " " << padding << "\n";
+    for (const auto &source : sources)
+    {
+        std::error_code ec;
+        const auto size = fs::file_size(source.file_path, ec);
+        const auto modified = fs::last_write_time(source.file_path, ec).time_since_epoch().count();
+        signature << "source " << source.name << " " << source.file_path << " " << size << " " << modified << "\n";
+    }
+    return signature.str();
+}
+
+bool TextureAtlasBuilder::load_cache(const std::string &cache_dir)
+{
+    std::ifstream manifest(fs::path(cache_dir) / "atlas.manifest");
+    if (!manifest.is_open())
+    {
+        return false;
+    }
+
+    const auto expected = cache_signature();
+    std::string header(expected.size(), '\0');
+    manifest.read(header.data(), header.size());
+    if (header != expected)
+    {
+        return false;
+    }
+
+    free_pages();
+    std::string kind;
+    while (manifest >> kind)
+    {
+        if (kind == "page")
+        {
+            std::string file;
+            manifest >> file;
+            SDL_Surface *page = IMG_Load((fs::path(cache_dir) / file).string().c_str());
+            if (!page)
+            {
+                free_pages();
+                return false;
+            }
+            pages.push_back(page);
+        }
+        else if (kind == "region")
+        {
+            std::string name;
+            AtlasRegion region;
+            manifest >> name >> region.page >> region.rect.x >> region.rect.y >> region.rect.w >> region.rect.h;
+            regions[name] = region;
+        }
+        else if (kind == "oversized")
+        {
+            std::string name, file_path;
+            manifest >> name >> file_path;
+            oversized[name] = file_path;
+        }
+    }
+
+    Logger::info("Loaded " + std::to_string(pages.size()) + " atlas pages from " + cache_dir);
+    return true;
+}
+
+void TextureAtlasBuilder::save_cache(const std::string &cache_dir) const
+{
+    std::error_code ec;
+    fs::create_directories(cache_dir, ec);
+
+    std::ofstream manifest(fs::path(cache_dir) / "atlas.manifest", std::ios::trunc);
+    if (!manifest.is_open())
+    {
+        Logger::error("Failed to write atlas cache to " + cache_dir);
+        return;
+    }
+
+    manifest << cache_signature();
+    for (int i = 0; i < pages.size(); i++)
+    {
+        const auto file = "page" + std::to_string(i) + ".png";
+        IMG_SavePNG(pages[i], (fs::path(cache_dir) / file).string().c_str());
+        manifest << "page " << file << "\n";
+    }
+    for (const auto &[name, region] : regions)
+    {
+        manifest << "region " << name << " " << region.page << " " << region.rect.x << " " << region.rect.y << " " << region.rect.w << " " << region.rect.h << "\n";
+    }
+    for (const auto &[name, file_path] : oversized)
+    {
+        manifest << "oversized " << name << " " << file_path << "\n";
+    }
+}
+
+const std::vector<SDL_Surface *> &TextureAtlasBuilder::get_pages() const
+{
+    return pages;
+}
+
+const std::map<std::string, AtlasRegion> &TextureAtlasBuilder::get_regions() const
+{
+    return regions;
+}
+
+const std::map<std::string, std::string> &TextureAtlasBuilder::get_oversized() const
+{
+    return oversized;
+}
@@ -13,7 +13,7 @@ void AnimationSystem::update()
         auto &sprite = entity.get_component<SpriteComponent>();
         auto &animation = entity.get_component<AnimationComponent>();
 
-        animation.current_frame = ((SDL_GetTicks() - animation.start_time) * animation.frame_rate / 1000) % animation.num_frames;
+        animation.current_frame = ((Clock::now() - animation.start_time) * animation.frame_rate / 1000) % animation.num_frames;
         sprite.src_rect.x = animation.current_frame * sprite.width;
     }
 }
\ No newline at end of file
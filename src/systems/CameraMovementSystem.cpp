@@ -6,17 +6,17 @@ CameraMovementSystem::CameraMovementSystem()
     require_component<TransformComponent>();
 }
 
-void CameraMovementSystem::update(SDL_Rect &camera)
+void CameraMovementSystem::update(SDL_Rect &camera, const vec2 map_size)
 {
     for (const auto &entity : entities())
     {
-        const auto transform = entity.get_component<TransformComponent>();
-        if (transform.position.x + (camera.w / 2) < constants::map_width)
+        const auto transform = entity.read_component<TransformComponent>();
+        if (transform.position.x + (camera.w / 2) < map_size.x)
         {
             camera.x = transform.position.x - (constants::window_width / 2);
         }
 
-        if (transform.position.y + (camera.h / 2) < constants::map_height)
+        if (transform.position.y + (camera.h / 2) < map_size.y)
         {
             camera.y = transform.position.y - (constants::window_height / 2);
         }
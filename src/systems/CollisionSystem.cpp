@@ -8,10 +8,10 @@ CollisionSystem::CollisionSystem()
 
 bool CollisionSystem::collide(const Entity &entity, const Entity &other)
 {
-    auto &transform1 = entity.get_component<TransformComponent>();
-    auto &transform2 = other.get_component<TransformComponent>();
-    auto &box1 = entity.get_component<BoxColliderComponent>();
-    auto &box2 = other.get_component<BoxColliderComponent>();
+    const auto &transform1 = entity.read_component<TransformComponent>();
+    const auto &transform2 = other.read_component<TransformComponent>();
+    const auto &box1 = entity.read_component<BoxColliderComponent>();
+    const auto &box2 = other.read_component<BoxColliderComponent>();
 
     bool B_left_A = transform1.position.x - box1.offset.x < transform2.position.x + box2.width + box2.offset.x;
     bool A_left_B = transform1.position.x + box1.width + box1.offset.x > transform2.position.x - box2.offset.x;
@@ -31,13 +31,14 @@ bool CollisionSystem::collide(const Entity &entity, const Entity &other)
 void CollisionSystem::update(std::shared_ptr<EventBus> event_bus)
 {
     const auto _entities = entities();
+    auto &collisions = event_bus->channel<CollisionEvent>();
     for (auto it = _entities.begin(); it != _entities.end(); it++)
     {
         for (auto it_other = it + 1; it_other != _entities.end(); it_other++)
         {
             if (collide(*it, *it_other))
             {
-                event_bus->emit<CollisionEvent>(*it, *it_other);
+                collisions.emit(*it, *it_other);
             }
         }
     }
@@ -8,7 +8,7 @@ DamageSystem::DamageSystem()
 
 void DamageSystem::on_projectile_hit_player(Entity &projectile, Entity &player)
 {
-    const auto &projectile_component = projectile.get_component<ProjectileComponent>();
+    const auto &projectile_component = projectile.read_component<ProjectileComponent>();
     if (!projectile_component.is_friendly && player.has_component<HealthComponent>())
     {
         auto &health_component = player.get_component<HealthComponent>();
@@ -23,7 +23,7 @@ void DamageSystem::on_projectile_hit_player(Entity &projectile, Entity &player)
 
 void DamageSystem::on_projectile_hit_enemy(Entity &projectile, Entity &enemy)
 {
-    const auto &projectile_component = projectile.get_component<ProjectileComponent>();
+    const auto &projectile_component = projectile.read_component<ProjectileComponent>();
     if (projectile_component.is_friendly && enemy.has_component<HealthComponent>())
     {
         auto &health_component = enemy.get_component<HealthComponent>();
@@ -64,7 +64,7 @@ void DamageSystem::on_collision(CollisionEvent &e)
 
 void DamageSystem::subscribe_events(std::shared_ptr<EventBus> event_bus)
 {
-    event_bus->subscribe(this, &DamageSystem::on_collision);
+    event_bus->subscribe<&DamageSystem::on_collision>(this);
 }
 
 void DamageSystem::update()
@@ -10,11 +10,11 @@ KeyboardControlSystem::KeyboardControlSystem()
 void speed_up(Entity &entity)
 {
     SprintComponent &sprint = entity.get_component<SprintComponent>();
-    bool can_sprint = SDL_GetTicks() > sprint.last_sprint_time + sprint.sprint_cooldown + sprint.sprint_duration;
+    bool can_sprint = Clock::now() > sprint.last_sprint_time + sprint.sprint_cooldown + sprint.sprint_duration;
     if (!sprint.in_sprint && can_sprint)
     {
         sprint.in_sprint = true;
-        sprint.last_sprint_time = SDL_GetTicks();
+        sprint.last_sprint_time = Clock::now();
     }
 }
 
@@ -22,7 +22,11 @@ void KeyboardControlSystem::on_key_pressed(KeyPressedEvent &e)
 {
     for (auto &entity : entities())
     {
-        const auto &keyboard = entity.get_component<KeyboardControlComponent>();
+        if (e.entity_id >= 0 && entity.id() != e.entity_id)
+        {
+            continue;
+        }
+        const auto &keyboard = entity.read_component<KeyboardControlComponent>();
         auto &rigid_body = entity.get_component<RigidBodyComponent>();
         auto &sprite = entity.get_component<SpriteComponent>();
 
@@ -61,7 +65,7 @@ void KeyboardControlSystem::on_key_pressed(KeyPressedEvent &e)
 
 void KeyboardControlSystem::subscribe_events(std::shared_ptr<EventBus> event_bus)
 {
-    event_bus->subscribe(this, &KeyboardControlSystem::on_key_pressed);
+    event_bus->subscribe<&KeyboardControlSystem::on_key_pressed>(this);
 }
 
 void KeyboardControlSystem::update()
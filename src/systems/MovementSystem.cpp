@@ -42,10 +42,10 @@ void MovementSystem::on_collision(CollisionEvent &e)
 
 void MovementSystem::subscribe_events(std::shared_ptr<EventBus> event_bus)
 {
-    event_bus->subscribe(this, &MovementSystem::on_collision);
+    event_bus->subscribe<&MovementSystem::on_collision>(this);
 };
 
-void MovementSystem::update(float dt)
+void MovementSystem::update(float dt, const vec2 map_size)
 {
     for (const auto &entity : entities())
     {
@@ -56,7 +56,7 @@ void MovementSystem::update(float dt)
         if (entity.has_component<SprintComponent>())
         {
             auto &sprint = entity.get_component<SprintComponent>();
-            bool no_sprint = (SDL_GetTicks() - sprint.last_sprint_time > sprint.sprint_duration);
+            bool no_sprint = (Clock::now() - sprint.last_sprint_time > sprint.sprint_duration);
             movement *= (sprint.in_sprint ? sprint.sprint_speed : 1);
             if (sprint.in_sprint && no_sprint)
             {
@@ -74,7 +74,7 @@ void MovementSystem::update(float dt)
         // kill entity outside the map
         if (!entity.has_tag("player"))
         {
-            bool outside_map = transform.position.x < 0 || transform.position.x > constants::map_width || transform.position.y < 0 || transform.position.y > constants::map_height;
+            bool outside_map = transform.position.x < 0 || transform.position.x > map_size.x || transform.position.y < 0 || transform.position.y > map_size.y;
             if (outside_map)
             {
                 entity.kill();
@@ -93,9 +93,9 @@ void MovementSystem::update(float dt)
                 transform.position.x = padding_left;
             }
 
-            if (transform.position.x > constants::map_width - sprite.width - padding_right)
+            if (transform.position.x > map_size.x - sprite.width - padding_right)
             {
-                transform.position.x = constants::map_width - sprite.width - padding_right;
+                transform.position.x = map_size.x - sprite.width - padding_right;
             }
 
             if (transform.position.y < padding_top)
@@ -103,9 +103,9 @@ void MovementSystem::update(float dt)
                 transform.position.y = padding_top;
             }
 
-            if (transform.position.y > constants::map_height - sprite.height - padding_bottom)
+            if (transform.position.y > map_size.y - sprite.height - padding_bottom)
             {
-                transform.position.y = constants::map_height - sprite.height - padding_bottom;
+                transform.position.y = map_size.y - sprite.height - padding_bottom;
             }
         }
     }
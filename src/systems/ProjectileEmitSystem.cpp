@@ -1,7 +1,9 @@
 #include "ECS.hpp"
+#include "Prefab.hpp"
 
-ProjectileEmitSystem::ProjectileEmitSystem()
+ProjectileEmitSystem::ProjectileEmitSystem(std::shared_ptr<PrefabRegistry> prefabs)
 {
+    this->prefabs = prefabs;
     require_component<ProjectileEmitterComponent>();
     require_component<TransformComponent>();
 }
@@ -10,13 +12,13 @@ void ProjectileEmitSystem::emit_from(const Entity &entity, bool const_direction)
 {
 
     auto &projectile = entity.get_component<ProjectileEmitterComponent>();
-    const auto &transform = entity.get_component<TransformComponent>();
-    const auto &rigid_body = entity.get_component<RigidBodyComponent>();
+    const auto &transform = entity.read_component<TransformComponent>();
+    const auto &rigid_body = entity.read_component<RigidBodyComponent>();
 
     auto projectile_position = transform.position;
     if (entity.has_component<SpriteComponent>())
     {
-        auto sprite = entity.get_component<SpriteComponent>();
+        auto sprite = entity.read_component<SpriteComponent>();
         projectile_position += glm::vec2(sprite.width / 2, sprite.height / 2);
     }
 
@@ -30,15 +32,14 @@ void ProjectileEmitSystem::emit_from(const Entity &entity, bool const_direction)
         projectile_velocity.y *= direction_y;
     }
 
-    auto p = entity.registry->create_entity();
-    p.group("projectiles");
-    p.add_component<TransformComponent>(projectile_position, transform.scale, transform.rotation);
-    p.add_component<RigidBodyComponent>(projectile_velocity);
-    p.add_component<SpriteComponent>("bullet-texture", 4, 4, 1);
-    p.add_component<BoxColliderComponent>(4, 4);
-    p.add_component<ProjectileComponent>(projectile.duration, projectile.is_friendly, projectile.damage);
+    // sprite, collider and group come from the prefab, the rest depends on the emitter
+    prefabs->instantiate(*entity.registry, "projectile", [&](Entity p)
+                         {
+        p.add_component<TransformComponent>(projectile_position, transform.scale, transform.rotation);
+        p.add_component<RigidBodyComponent>(projectile_velocity);
+        p.add_component<ProjectileComponent>(projectile.duration, projectile.is_friendly, projectile.damage); });
 
-    projectile.last_emission_time = SDL_GetTicks();
+    projectile.last_emission_time = Clock::now();
 }
 
 void ProjectileEmitSystem::on_mouse_clicked(MouseClickedEvent &event)
@@ -48,7 +49,7 @@ void ProjectileEmitSystem::on_mouse_clicked(MouseClickedEvent &event)
     case (SDL_BUTTON_LEFT):
         for (const auto &entity : entities())
         {
-            if (entity.has_component<MouseControlComponent>())
+            if (entity.has_component<MouseControlComponent>() && (event.entity_id < 0 || entity.id() == event.entity_id))
             {
                 emit_from(entity, false);
             }
@@ -64,7 +65,10 @@ void ProjectileEmitSystem::on_key_pressed(KeyPressedEvent &e)
     case SDLK_SPACE:
         for (const auto &entity : entities())
         {
-            emit_from(entity, false);
+            if (e.entity_id < 0 || entity.id() == e.entity_id)
+            {
+                emit_from(entity, false);
+            }
         }
         break;
     }
@@ -72,16 +76,16 @@ void ProjectileEmitSystem::on_key_pressed(KeyPressedEvent &e)
 
 void ProjectileEmitSystem::subscribe_events(std::shared_ptr<EventBus> event_bus)
 {
-    event_bus->subscribe(this, &ProjectileEmitSystem::on_key_pressed);
-    event_bus->subscribe(this, &ProjectileEmitSystem::on_mouse_clicked);
+    event_bus->subscribe<&ProjectileEmitSystem::on_key_pressed>(this);
+    event_bus->subscribe<&ProjectileEmitSystem::on_mouse_clicked>(this);
 }
 
 void ProjectileEmitSystem::update(std::shared_ptr<Registry> registry)
 {
     for (const auto &entity : entities())
     {
-        const auto &projectile = entity.get_component<ProjectileEmitterComponent>();
-        if (projectile.freq != 0 && SDL_GetTicks() - projectile.last_emission_time > projectile.freq)
+        const auto &projectile = entity.read_component<ProjectileEmitterComponent>();
+        if (projectile.freq != 0 && Clock::now() - projectile.last_emission_time > projectile.freq)
         {
             emit_from(entity, true);
         }
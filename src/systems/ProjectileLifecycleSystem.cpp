@@ -9,8 +9,8 @@ void ProjectileLifecycleSystem::update()
 {
     for (auto entity : entities())
     {
-        const auto &projectile = entity.get_component<ProjectileComponent>();
-        if (SDL_GetTicks() > (projectile.start_time + projectile.duration))
+        const auto &projectile = entity.read_component<ProjectileComponent>();
+        if (Clock::now() > (projectile.start_time + projectile.duration))
         {
             entity.kill();
         }
@@ -6,12 +6,13 @@ RenderColliderSystem::RenderColliderSystem()
     require_component<BoxColliderComponent>();
 }
 
-void RenderColliderSystem::update(SDL_Renderer *renderer, SDL_Rect &camera)
+void RenderColliderSystem::update(SDL_Renderer *renderer, SDL_Rect &camera, const SpatialIndexSystem &spatial_index)
 {
-    for (const auto &entity : entities())
+    spatial_index.query(camera, get_component_signature(), visible_entities);
+    for (const auto &entity : visible_entities)
     {
-        const auto &transform = entity.get_component<TransformComponent>();
-        const auto &box = entity.get_component<BoxColliderComponent>();
+        const auto &transform = entity.read_component<TransformComponent>();
+        const auto &box = entity.read_component<BoxColliderComponent>();
 
         SDL_Rect collider_rect = {
             (int)(transform.position.x - box.offset.x - camera.x),
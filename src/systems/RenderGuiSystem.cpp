@@ -1,9 +1,11 @@
 #include "ECS.hpp"
+#include "Prefab.hpp"
 #include "imgui_impl_sdl.h"
 #include "imgui_impl_sdlrenderer.h"
 
-RenderGuiSystem::RenderGuiSystem()
+RenderGuiSystem::RenderGuiSystem(std::shared_ptr<PrefabRegistry> prefabs)
 {
+    this->prefabs = prefabs;
 }
 
 void RenderGuiSystem::update(std::shared_ptr<Registry> registry, SDL_Rect &camera)
@@ -71,16 +73,19 @@ void RenderGuiSystem::update(std::shared_ptr<Registry> registry, SDL_Rect &camer
 
         if (ImGui::Button("Create new enemy"))
         {
-            auto enemy = registry->create_entity();
-            enemy.group("enemies");
-            enemy.add_component<TransformComponent>(vec2(enemy_position_x, enemy_position_y), vec2(enemy_scale_x, enemy_scale_y), glm::degrees(enemy_rotation));
-            enemy.add_component<RigidBodyComponent>(vec2(enemy_speed_x, enemy_speed_y));
-            enemy.add_component<SpriteComponent>(enemy_images[enemy_image_index], tile_size, tile_size,
-                                                 3);
-            enemy.add_component<BoxColliderComponent>(tile_size * enemy_scale_x, tile_size * enemy_scale_y);
-            enemy.add_component<ProjectileEmitterComponent>(vec2(cos(projectile_angle) * projectile_speed, sin(projectile_angle) * projectile_speed), projectile_freq * 1000, projectile_duration * 1000,
-                                                            projectile_friendly, projectile_damage);
-            enemy.add_component<HealthComponent>(enemy_health);
+            // the prefab supplies group, sprite size and layer, the panel overrides the rest
+            prefabs->instantiate(*registry, "enemy", [&](Entity enemy)
+                                 {
+                enemy.add_component<TransformComponent>(vec2(enemy_position_x, enemy_position_y), vec2(enemy_scale_x, enemy_scale_y), glm::degrees(enemy_rotation));
+                enemy.add_component<RigidBodyComponent>(vec2(enemy_speed_x, enemy_speed_y));
+                if (enemy.has_component<SpriteComponent>())
+                {
+                    enemy.get_component<SpriteComponent>().asset_name = enemy_images[enemy_image_index];
+                }
+                enemy.add_component<BoxColliderComponent>(tile_size * enemy_scale_x, tile_size * enemy_scale_y);
+                enemy.add_component<ProjectileEmitterComponent>(vec2(cos(projectile_angle) * projectile_speed, sin(projectile_angle) * projectile_speed), projectile_freq * 1000, projectile_duration * 1000,
+                                                                projectile_friendly, projectile_damage);
+                enemy.add_component<HealthComponent>(enemy_health); });
 
             // reset values
             enemy_scale_x = enemy_scale_y = 1;
@@ -93,6 +98,19 @@ void RenderGuiSystem::update(std::shared_ptr<Registry> registry, SDL_Rect &camer
 
     ImGui::End();
 
+    // pauses of the collector the script system runs after each frame
+    const auto &gc_stats = registry->get_system<ScriptSystem>().get_gc_stats();
+    if (gc_stats.frames > 0)
+    {
+        if (ImGui::Begin("Lua GC", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+        {
+            ImGui::Text("%.3f ms last frame, %.3f ms average, %.3f ms worst",
+                        gc_stats.last_ms, gc_stats.total_ms / gc_stats.frames, gc_stats.max_ms);
+            ImGui::Text("%d cycles, %d over budget, %d KB in use", gc_stats.cycles, gc_stats.forced, gc_stats.memory_kb);
+        }
+        ImGui::End();
+    }
+
     // window showing map coordinates
     window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoNav;
     ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always, ImVec2(0, 0));
@@ -107,6 +125,61 @@ void RenderGuiSystem::update(std::shared_ptr<Registry> registry, SDL_Rect &camer
     }
     ImGui::End();
 
+    // last frame's cost of every script function while F6 profiling is on, slowest first
+    const ScriptProfiler *profiler = registry->get_system<ScriptSystem>().get_profiler();
+    if (profiler)
+    {
+        if (ImGui::Begin("Script profiler", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+        {
+            ImGui::Text("%.3f ms in scripts, %.3f ms average over %d frames",
+                        profiler->get_frame_ms(), profiler->get_average_ms(), profiler->get_frames());
+            ImGui::Text("lua allocated %.1f KB this frame, %.1f MB in total",
+                        profiler->get_frame_allocated() / 1024.0, profiler->get_allocated() / (1024.0 * 1024.0));
+
+            std::vector<const ScriptProfiler::FunctionStats *> sorted;
+            for (const auto &stats : profiler->get_functions())
+            {
+                sorted.push_back(&stats);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b)
+                      { return a->frame_ms > b->frame_ms; });
+
+            if (ImGui::BeginTable("functions", 6))
+            {
+                ImGui::TableSetupColumn("function");
+                ImGui::TableSetupColumn("calls");
+                ImGui::TableSetupColumn("ms");
+                ImGui::TableSetupColumn("slowest entity");
+                ImGui::TableSetupColumn("bytes");
+                ImGui::TableSetupColumn("binding calls");
+                ImGui::TableHeadersRow();
+                for (const auto *stats : sorted)
+                {
+                    std::uint64_t binding_calls = 0;
+                    for (auto count : stats->binding_calls)
+                    {
+                        binding_calls += count;
+                    }
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%s", stats->source.c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d", stats->frame_calls);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f", stats->frame_ms);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d (%.1f us)", stats->slowest_entity, stats->slowest_ms * 1000);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", static_cast<unsigned long long>(stats->frame_allocated));
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f per call", stats->calls > 0 ? static_cast<double>(binding_calls) / stats->calls : 0.0);
+                }
+                ImGui::EndTable();
+            }
+        }
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
 }
@@ -9,13 +9,14 @@ RenderHealthSystem::RenderHealthSystem()
     require_component<SpriteComponent>();
 }
 
-void RenderHealthSystem::update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera)
+void RenderHealthSystem::update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera, const SpatialIndexSystem &spatial_index)
 {
-    for (const auto &entity : entities())
+    spatial_index.query(camera, get_component_signature(), visible_entities);
+    for (const auto &entity : visible_entities)
     {
-        const auto &health = entity.get_component<HealthComponent>();
-        const auto &transform = entity.get_component<TransformComponent>();
-        const auto &sprite = entity.get_component<SpriteComponent>();
+        const auto &health = entity.read_component<HealthComponent>();
+        const auto &transform = entity.read_component<TransformComponent>();
+        const auto &sprite = entity.read_component<SpriteComponent>();
 
         SDL_Color healthbar_color = {255, 255, 255};
 
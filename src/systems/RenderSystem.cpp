@@ -8,51 +8,104 @@ RenderSystem::RenderSystem()
     require_component<SpriteComponent>();
 }
 
-class RenderableEntity
+std::uint64_t RenderSystem::make_sort_key(const SpriteComponent &sprite, int batch, int entity_id)
 {
-public:
-    RenderableEntity(const TransformComponent &transform, const SpriteComponent &sprite) : transform_component(transform), sprite_component(sprite){};
-    TransformComponent transform_component;
-    SpriteComponent sprite_component;
-};
-
-// override System::add_entity and sort by z-index
-void RenderSystem::add_entity(Entity entity)
-{
-    // sort entity when inserted
-    auto it = std::upper_bound(_entities.begin(), _entities.end(), entity, [](const Entity &entity, const Entity &other)
-                               { return entity.get_component<SpriteComponent>().z_index < other.get_component<SpriteComponent>().z_index; });
-
-    _entities.insert(it, entity);
+    // z_index decides the order as it always did, biased so negative values sort first. among equal
+    // z_index fixed sprites go above the world, then draws are grouped by the texture they bind
+    const std::uint64_t z_index = static_cast<std::uint16_t>(sprite.z_index + 0x8000);
+    const std::uint64_t layer = sprite.is_fixed ? 1 : 0;
+    const std::uint64_t texture = static_cast<std::uint16_t>(batch);
+    const std::uint64_t id = static_cast<std::uint32_t>(entity_id) & 0xFFFFFF;
+    return (z_index << 48) | (layer << 40) | (texture << 24) | id;
 }
 
-void RenderSystem::update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera)
+// LSD radix sort over 8-bit digits, passes whose digit is the same for every key are skipped
+void RenderSystem::radix_sort()
 {
-    for (const auto &entity : entities())
+    const auto n = render_items.size();
+    if (n < 2)
+    {
+        return;
+    }
+    sort_buffer.resize(n);
+
+    std::uint64_t differing_bits = 0;
+    for (const auto &item : render_items)
     {
+        differing_bits |= item.key ^ render_items[0].key;
+    }
 
-        auto &transform = entity.get_component<TransformComponent>();
-        auto &sprite = entity.get_component<SpriteComponent>();
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((differing_bits >> shift) & 0xFF) == 0)
+        {
+            continue;
+        }
 
-        // bypass entities outside of camera view
-        int padding = 50;
+        std::size_t offsets[256] = {};
+        for (const auto &item : render_items)
+        {
+            offsets[(item.key >> shift) & 0xFF]++;
+        }
 
-        bool is_outside_camera = (transform.position.x + sprite.width + padding < camera.x ||
-                                  transform.position.x > camera.x + camera.w + sprite.width + padding ||
-                                  transform.position.y + sprite.height + padding < camera.y ||
-                                  transform.position.y > camera.y + camera.h + sprite.height + padding);
+        std::size_t total = 0;
+        for (auto &offset : offsets)
+        {
+            const auto count = offset;
+            offset = total;
+            total += count;
+        }
 
-        if (!is_outside_camera || sprite.is_fixed)
+        for (const auto &item : render_items)
         {
-            // source rectangle and dest rectangle
-            SDL_Rect src_rect = sprite.src_rect;
+            sort_buffer[offsets[(item.key >> shift) & 0xFF]++] = item;
+        }
+        render_items.swap(sort_buffer);
+    }
+}
 
-            SDL_Rect dest_rect = {(int)(transform.position.x - (sprite.is_fixed ? 0 : camera.x)),
-                                  (int)(transform.position.y - (sprite.is_fixed ? 0 : camera.y)),
-                                  (int)(sprite.width * transform.scale.x),
-                                  (int)(sprite.height * transform.scale.y)};
+void RenderSystem::update(SDL_Renderer *renderer, std::shared_ptr<AssetStore> asset_store, SDL_Rect &camera, const SpatialIndexSystem &spatial_index)
+{
+    // only entities overlapping the camera view (plus fixed sprites) come back from the index
+    spatial_index.query(camera, get_component_signature(), visible_entities);
 
-            SDL_RenderCopyEx(renderer, asset_store->get_texture(sprite.asset_name), &src_rect, &dest_rect, transform.rotation, NULL, sprite.flip);
+    // keys are rebuilt every frame, so z_index changes at runtime are picked up
+    render_items.clear();
+    for (int i = 0; i < visible_entities.size(); i++)
+    {
+        const auto &sprite = visible_entities[i].read_component<SpriteComponent>();
+        if (sprite.texture_id < 0)
+        {
+            // written once the name resolves, an unresolved sprite is asked again next frame without being stamped
+            const int texture_id = asset_store->get_texture_id(sprite.asset_name);
+            if (texture_id >= 0)
+            {
+                visible_entities[i].get_component<SpriteComponent>().texture_id = texture_id;
+            }
+            else
+            {
+                continue;
+            }
         }
+        render_items.push_back({make_sort_key(sprite, asset_store->get_texture_batch(sprite.texture_id), visible_entities[i].id()), i});
     }
-};
\ No newline at end of file
+    radix_sort();
+
+    for (const auto &item : render_items)
+    {
+        const auto &entity = visible_entities[item.index];
+        const auto &transform = entity.read_component<TransformComponent>();
+        const auto &sprite = entity.read_component<SpriteComponent>();
+
+        // source rectangle and dest rectangle, src_rect is relative to the texture's region in its atlas page
+        const auto &offset = asset_store->get_texture_offset(sprite.texture_id);
+        SDL_Rect src_rect = {sprite.src_rect.x + offset.x, sprite.src_rect.y + offset.y, sprite.src_rect.w, sprite.src_rect.h};
+
+        SDL_Rect dest_rect = {(int)(transform.position.x - (sprite.is_fixed ? 0 : camera.x)),
+                              (int)(transform.position.y - (sprite.is_fixed ? 0 : camera.y)),
+                              (int)(sprite.width * transform.scale.x),
+                              (int)(sprite.height * transform.scale.y)};
+
+        SDL_RenderCopyEx(renderer, asset_store->get_texture(sprite.texture_id), &src_rect, &dest_rect, transform.rotation, NULL, sprite.flip);
+    }
+};
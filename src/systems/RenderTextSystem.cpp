@@ -9,7 +9,7 @@ void RenderTextSystem::update(SDL_Renderer *renderer, std::shared_ptr<AssetStore
 {
     for (const auto &entity : entities())
     {
-        const auto text_component = entity.get_component<TextComponent>();
+        const auto text_component = entity.read_component<TextComponent>();
         const auto font = asset_store->get_font(text_component.font_name);
         const auto label = text_component.text.c_str();
         SDL_Surface *surface = TTF_RenderText_Blended(font, label, text_component.color);
@@ -1,11 +1,14 @@
 #include "ECS.hpp"
+#include "Prefab.hpp"
+#include <chrono>
+#include <stdexcept>
 
 ScriptSystem::ScriptSystem()
 {
     require_component<ScriptComponent>();
 }
 
-void set_position(Entity entity, int x, int y)
+void set_position(Entity entity, double x, double y)
 {
     if (entity.has_component<TransformComponent>())
     {
@@ -15,11 +18,11 @@ void set_position(Entity entity, int x, int y)
     }
 }
 
-std::tuple<int, int> get_position(Entity &entity)
+std::tuple<double, double> get_position(Entity &entity)
 {
     if (entity.has_component<TransformComponent>())
     {
-        const auto &transform = entity.get_component<TransformComponent>();
+        const auto &transform = entity.read_component<TransformComponent>();
         return std::make_tuple(transform.position.x, transform.position.y);
     }
     else
@@ -32,7 +35,7 @@ std::tuple<double, double> get_velocity(Entity entity)
 {
     if (entity.has_component<RigidBodyComponent>())
     {
-        const auto rigid_body = entity.get_component<RigidBodyComponent>();
+        const auto rigid_body = entity.read_component<RigidBodyComponent>();
         return std::make_tuple(rigid_body.velocity.x, rigid_body.velocity.y);
     }
     else
@@ -79,28 +82,758 @@ void set_projectile_velocity(Entity entity, double x, double y)
     }
 }
 
-void ScriptSystem::create_lua_bindings(sol::state &lua)
+// spawn_wave{count, texture_asset_id, width, height, position, spacing, velocity, health, group}
+// creates a whole line of enemies with one bulk create, returns how many were spawned
+int spawn_wave(Registry &registry, sol::table wave)
 {
+    int count = wave["count"].get_or(1);
+    std::string texture_asset_id = wave["texture_asset_id"];
+    int width = wave["width"].get_or(32);
+    int height = wave["height"].get_or(32);
+    vec2 position = vec2(wave["position"]["x"].get_or(0.0), wave["position"]["y"].get_or(0.0));
+    vec2 spacing = vec2(wave["spacing"]["x"].get_or(0.0), wave["spacing"]["y"].get_or(0.0));
+    vec2 velocity = vec2(wave["velocity"]["x"].get_or(0.0), wave["velocity"]["y"].get_or(0.0));
+    int health = wave["health"].get_or(100);
+    std::string group = wave["group"].get_or("enemies"s);
+
+    registry.create_many<TransformComponent, RigidBodyComponent, SpriteComponent, BoxColliderComponent, HealthComponent>(
+        count,
+        [&](int i, Entity enemy, TransformComponent &transform, RigidBodyComponent &rigid_body,
+            SpriteComponent &sprite, BoxColliderComponent &collider, HealthComponent &health_component)
+        {
+            enemy.group(group);
+            transform.position = position + spacing * static_cast<float>(i);
+            rigid_body.velocity = velocity;
+            sprite = SpriteComponent(texture_asset_id, width, height, 1);
+            collider = BoxColliderComponent(width, height);
+            health_component.health = health;
+        });
+    return count;
+}
+
+// the binding as scripts see it, counted for the script running at the time while profiling is on
+template <ScriptProfiler::Binding binding, typename TReturn, typename... TArgs>
+static auto counted(const std::shared_ptr<ScriptProfiler> &profiler, TReturn (*function)(TArgs...))
+{
+    const std::shared_ptr<ScriptProfiler> *profiler_ptr = &profiler;
+    return [profiler_ptr, function](TArgs... args) -> TReturn
+    {
+        if (*profiler_ptr)
+        {
+            (*profiler_ptr)->count_binding(binding);
+        }
+        return function(args...);
+    };
+}
+
+// what entity:transform() and friends return. the component is looked up again on every field access, so a
+// reference kept across frames survives the pool growing or moving it, and every write marks it changed
+template <typename TComponent>
+struct ComponentRef
+{
+    Entity entity;
+
+    const TComponent &read() const
+    {
+        if (!entity.has_component<TComponent>())
+        {
+            throw std::runtime_error("entity " + std::to_string(entity.id()) + " no longer has the component");
+        }
+        return entity.read_component<TComponent>();
+    }
+    TComponent &modify() const
+    {
+        read();
+        return entity.get_component<TComponent>();
+    }
+};
+
+// a vec2 of a component, so transform.position.x = 5 writes the pool and not a copy
+template <typename TComponent>
+struct Vec2Ref
+{
+    ComponentRef<TComponent> component;
+    vec2 TComponent::*member;
+};
+
+template <typename TComponent, typename TField>
+static auto field(TField TComponent::*member)
+{
+    return sol::property([member](const ComponentRef<TComponent> &ref)
+                         { return ref.read().*member; },
+                         [member](const ComponentRef<TComponent> &ref, TField value)
+                         { ref.modify().*member = value; });
+}
+
+template <typename TComponent>
+static auto vec2_field(vec2 TComponent::*member)
+{
+    return sol::property([member](const ComponentRef<TComponent> &ref)
+                         { return Vec2Ref<TComponent>{ref, member}; },
+                         [member](const ComponentRef<TComponent> &ref, const vec2 &value)
+                         { ref.modify().*member = value; });
+}
+
+template <typename TComponent>
+static void bind_vec2_ref(sol::state &lua, const std::string &name)
+{
+    lua.new_usertype<Vec2Ref<TComponent>>(
+        name, sol::no_constructor,
+        "x", sol::property([](const Vec2Ref<TComponent> &ref)
+                           { return (ref.component.read().*ref.member).x; },
+                           [](const Vec2Ref<TComponent> &ref, float x)
+                           { (ref.component.modify().*ref.member).x = x; }),
+        "y", sol::property([](const Vec2Ref<TComponent> &ref)
+                           { return (ref.component.read().*ref.member).y; },
+                           [](const Vec2Ref<TComponent> &ref, float y)
+                           { (ref.component.modify().*ref.member).y = y; }));
+}
+
+// entity:transform() and friends, a reference to the component or nil when the entity has none
+template <typename TComponent>
+static auto component_binding(const std::shared_ptr<ScriptProfiler> &profiler)
+{
+    const std::shared_ptr<ScriptProfiler> *profiler_ptr = &profiler;
+    return [profiler_ptr](Entity &entity) -> sol::optional<ComponentRef<TComponent>>
+    {
+        if (*profiler_ptr)
+        {
+            (*profiler_ptr)->count_binding(ScriptProfiler::component);
+        }
+        if (!entity.has_component<TComponent>())
+        {
+            return sol::nullopt;
+        }
+        return ComponentRef<TComponent>{entity};
+    };
+}
+
+// what registry:view(group) returns, called by a generic for it hands out one entity per step and nil at the end
+struct EntityView
+{
+    std::vector<Entity> entities;
+    std::size_t next{0};
+};
+
+#ifdef USE_LUAJIT
+// the pools scripts can reach through the ffi, scripts/ffi.lua declares the same structs and pool numbers
+static_assert(std::is_standard_layout_v<TransformComponent> && sizeof(TransformComponent) == 24);
+static_assert(std::is_standard_layout_v<RigidBodyComponent> && sizeof(RigidBodyComponent) == 8);
+static_assert(std::is_standard_layout_v<ProjectileEmitterComponent> && sizeof(ProjectileEmitterComponent) == 28);
+
+enum FfiPool
+{
+    ffi_transforms,
+    ffi_rigid_bodies,
+    ffi_projectile_emitters,
+    ffi_pool_count
+};
+
+const ScriptSystem::PoolView *ScriptSystem::pool_view(Registry *registry, int pool)
+{
+    static PoolView views[ffi_pool_count];
+    auto fill = [&](auto component_pool)
+    {
+        views[pool] = PoolView{component_pool->get_data(), component_pool->get_entity_index(),
+                               static_cast<int>(component_pool->get_entity_index_size())};
+        return &views[pool];
+    };
+    switch (pool)
+    {
+    case ffi_transforms:
+        return fill(registry->get_pool<TransformComponent>());
+    case ffi_rigid_bodies:
+        return fill(registry->get_pool<RigidBodyComponent>());
+    case ffi_projectile_emitters:
+        return fill(registry->get_pool<ProjectileEmitterComponent>());
+    default:
+        return nullptr;
+    }
+}
+
+void ScriptSystem::touch(Registry *registry, int pool, int entity_id)
+{
+    switch (pool)
+    {
+    case ffi_transforms:
+        registry->get_component<TransformComponent>(Entity{entity_id, registry});
+        break;
+    case ffi_rigid_bodies:
+        registry->get_component<RigidBodyComponent>(Entity{entity_id, registry});
+        break;
+    case ffi_projectile_emitters:
+        registry->get_component<ProjectileEmitterComponent>(Entity{entity_id, registry});
+        break;
+    }
+}
+#endif
+
+void ScriptSystem::create_lua_bindings(sol::state &lua, std::shared_ptr<Registry> registry, std::shared_ptr<PrefabRegistry> prefabs)
+{
+    // components are bound by reference, entity:transform().position.x = 5 writes the pool in place.
+    // references hold the entity and not the component, so they can be kept in upvalues or tables, and
+    // using one after its entity lost the component is a lua error
+    lua.new_usertype<vec2>(
+        "vec2", sol::constructors<vec2(), vec2(float, float)>(),
+        "x", &vec2::x,
+        "y", &vec2::y);
+    bind_vec2_ref<TransformComponent>(lua, "transform_vec2");
+    lua.new_usertype<ComponentRef<TransformComponent>>(
+        "transform_component", sol::no_constructor,
+        "position", vec2_field(&TransformComponent::position),
+        "scale", vec2_field(&TransformComponent::scale),
+        "rotation", field(&TransformComponent::rotation));
+    bind_vec2_ref<RigidBodyComponent>(lua, "rigid_body_vec2");
+    lua.new_usertype<ComponentRef<RigidBodyComponent>>(
+        "rigid_body_component", sol::no_constructor,
+        "velocity", vec2_field(&RigidBodyComponent::velocity));
+    lua.new_usertype<ComponentRef<AnimationComponent>>(
+        "animation_component", sol::no_constructor,
+        "current_frame", field(&AnimationComponent::current_frame),
+        "num_frames", field(&AnimationComponent::num_frames),
+        "frame_rate", field(&AnimationComponent::frame_rate),
+        "should_loop", field(&AnimationComponent::should_loop));
+    bind_vec2_ref<BoxColliderComponent>(lua, "box_collider_vec2");
+    lua.new_usertype<ComponentRef<BoxColliderComponent>>(
+        "box_collider_component", sol::no_constructor,
+        "width", field(&BoxColliderComponent::width),
+        "height", field(&BoxColliderComponent::height),
+        "offset", vec2_field(&BoxColliderComponent::offset));
+    lua.new_usertype<ComponentRef<HealthComponent>>(
+        "health_component", sol::no_constructor,
+        "health", field(&HealthComponent::health));
+    bind_vec2_ref<ProjectileEmitterComponent>(lua, "projectile_emitter_vec2");
+    lua.new_usertype<ComponentRef<ProjectileEmitterComponent>>(
+        "projectile_emitter_component", sol::no_constructor,
+        "velocity", vec2_field(&ProjectileEmitterComponent::velocity),
+        "freq", field(&ProjectileEmitterComponent::freq),
+        "duration", field(&ProjectileEmitterComponent::duration),
+        "is_friendly", field(&ProjectileEmitterComponent::is_friendly),
+        "damage", field(&ProjectileEmitterComponent::damage));
     lua.new_usertype<Entity>(
         "entity",
         "id", &Entity::id,
         "kill", &Entity::kill,
         "has_tag", &Entity::has_tag,
-        "belongs_to_group", &Entity::belongs_to_group);
-    lua.set_function("set_position", set_position);
-    lua.set_function("get_position", get_position);
-    lua.set_function("set_velocity", set_velocity);
-    lua.set_function("get_velocity", get_velocity);
-    lua.set_function("set_rotation", set_rotation);
-    lua.set_function("set_animation_frame", set_animation_frame);
-    lua.set_function("set_projectile_velocity", set_projectile_velocity);
+        "belongs_to_group", &Entity::belongs_to_group,
+        "transform", component_binding<TransformComponent>(profiler),
+        "rigid_body", component_binding<RigidBodyComponent>(profiler),
+        "animation", component_binding<AnimationComponent>(profiler),
+        "box_collider", component_binding<BoxColliderComponent>(profiler),
+        "health", component_binding<HealthComponent>(profiler),
+        "projectile_emitter", component_binding<ProjectileEmitterComponent>(profiler));
+    lua.set_function("set_position", counted<ScriptProfiler::set_position>(profiler, set_position));
+    lua.set_function("get_position", counted<ScriptProfiler::get_position>(profiler, get_position));
+    lua.set_function("set_velocity", counted<ScriptProfiler::set_velocity>(profiler, set_velocity));
+    lua.set_function("get_velocity", counted<ScriptProfiler::get_velocity>(profiler, get_velocity));
+    lua.set_function("set_rotation", counted<ScriptProfiler::set_rotation>(profiler, set_rotation));
+    lua.set_function("set_animation_frame", counted<ScriptProfiler::set_animation_frame>(profiler, set_animation_frame));
+    lua.set_function("set_projectile_velocity", counted<ScriptProfiler::set_projectile_velocity>(profiler, set_projectile_velocity));
+    // the lua state is destroyed before the registry, a plain pointer avoids keeping it alive from lua
+    Registry *registry_ptr = registry.get();
+    const std::shared_ptr<ScriptProfiler> *profiler_ptr = &profiler;
+    lua.set_function("spawn_wave", [registry_ptr, profiler_ptr](sol::table wave)
+                     {
+        if (*profiler_ptr)
+        {
+            (*profiler_ptr)->count_binding(ScriptProfiler::spawn_wave);
+        }
+        return spawn_wave(*registry_ptr, wave); });
+    // for enemy in registry:view("enemies") do ... end walks the group as it was when the view was made,
+    // registry:entity(tag) is the tagged entity or nil
+    lua.new_usertype<EntityView>(
+        "entity_view", sol::no_constructor,
+        sol::meta_function::call, [](EntityView &view, sol::variadic_args) -> sol::optional<Entity>
+        {
+            if (view.next >= view.entities.size())
+            {
+                return sol::nullopt;
+            }
+            return view.entities[view.next++];
+        },
+        sol::meta_function::length, [](const EntityView &view)
+        { return view.entities.size(); });
+    lua.new_usertype<Registry>(
+        "registry_type", sol::no_constructor,
+        "view", [profiler_ptr](Registry &registry, const std::string &group)
+        {
+            if (*profiler_ptr)
+            {
+                (*profiler_ptr)->count_binding(ScriptProfiler::view);
+            }
+            return EntityView{registry.get_entities_by_group(group)};
+        },
+        "entity", [](Registry &registry, const std::string &tag) -> sol::optional<Entity>
+        {
+            if (!registry.has_entity_with_tag(tag))
+            {
+                return sol::nullopt;
+            }
+            return registry.get_entity_by_tag(tag);
+        });
+    lua["registry"] = registry_ptr;
+    // spawn(prefab_name, x, y) stamps a prefab at a position and returns the new entity
+    PrefabRegistry *prefabs_ptr = prefabs.get();
+    lua.set_function("spawn", [registry_ptr, prefabs_ptr, profiler_ptr](const std::string &name, double x, double y)
+                     {
+        if (*profiler_ptr)
+        {
+            (*profiler_ptr)->count_binding(ScriptProfiler::spawn);
+        }
+        return prefabs_ptr->instantiate(*registry_ptr, name, [x, y](Entity entity)
+                                        { set_position(entity, x, y); }); });
+    // set_group_script(group, fun) for groups filled at runtime, e.g. by spawn_wave
+    lua.set_function("set_group_script", [this](const std::string &group, sol::function fun)
+                     { set_group_script(group, fun); });
+    // wait(seconds) and wait_until(condition) suspend a coroutine script, wait() sleeps until the next frame
+    lua.set_function("wait", sol::yielding([](sol::optional<double> seconds)
+                                           { return seconds.value_or(0.0); }));
+    lua.set_function("wait_until", sol::yielding([](sol::function condition)
+                                                 { return condition; }));
+    // send(id, name, value) reaches the sandboxed script of entity id on its next run
+    lua.set_function("send", [this](int to, const std::string &name, double value)
+                     {
+        if (workers)
+        {
+            workers->send(to, name, value);
+        } });
+    lua_state = lua.lua_state();
+#ifdef USE_LUAJIT
+    // ffi_get_position(id) and friends read and write the pools in place, see scripts/ffi.lua
+    sol::table ffi_bindings = lua.create_named_table("ffi_bindings");
+    ffi_bindings["registry"] = static_cast<void *>(registry_ptr);
+    ffi_bindings["pool_view"] = reinterpret_cast<void *>(&ScriptSystem::pool_view);
+    ffi_bindings["touch"] = reinterpret_cast<void *>(&ScriptSystem::touch);
+    lua.script_file("./scripts/ffi.lua");
+#endif
+}
+
+void ScriptSystem::set_group_script(const std::string &group, sol::function fun)
+{
+    auto it = std::find_if(group_scripts.begin(), group_scripts.end(), [&](const GroupScript &script)
+                           { return script.group == group; });
+    if (!fun.valid())
+    {
+        if (it != group_scripts.end())
+        {
+            group_scripts.erase(it);
+        }
+        return;
+    }
+    if (it == group_scripts.end())
+    {
+        // the arrays are created once and refilled every frame so the script leaves no garbage behind
+        GroupScript script;
+        script.group = group;
+        lua_State *L = fun.lua_state();
+        script.batch = sol::table(L, sol::create);
+        script.x = sol::table(L, sol::create);
+        script.y = sol::table(L, sol::create);
+        script.vx = sol::table(L, sol::create);
+        script.vy = sol::table(L, sol::create);
+        script.rotation = sol::table(L, sol::create);
+        script.entities = sol::table(L, sol::create);
+        script.batch["x"] = script.x;
+        script.batch["y"] = script.y;
+        script.batch["vx"] = script.vx;
+        script.batch["vy"] = script.vy;
+        script.batch["rotation"] = script.rotation;
+        script.batch["entities"] = script.entities;
+        group_scripts.push_back(std::move(script));
+        it = group_scripts.end() - 1;
+    }
+    it->fun = fun;
+}
+
+void ScriptSystem::clear_group_scripts()
+{
+    group_scripts.clear();
 }
 
-void ScriptSystem::update(double delta_time, int elapsed_time)
+void ScriptSystem::run_group_script(Registry &registry, GroupScript &script, double delta_time, int elapsed_time)
 {
+    std::vector<Entity> members = registry.get_entities_by_group(script.group);
+    members.erase(std::remove_if(members.begin(), members.end(), [](const Entity &entity)
+                                 { return !entity.has_component<TransformComponent>(); }),
+                  members.end());
+    if (members.empty())
+    {
+        return;
+    }
+    const int count = members.size();
+
+    if (members != script.members)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            script.entities.raw_set(i + 1, members[i]);
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const auto &transform = members[i].read_component<TransformComponent>();
+        vec2 velocity = members[i].has_component<RigidBodyComponent>()
+                            ? members[i].read_component<RigidBodyComponent>().velocity
+                            : vec2(0);
+        script.x.raw_set(i + 1, transform.position.x);
+        script.y.raw_set(i + 1, transform.position.y);
+        script.vx.raw_set(i + 1, velocity.x);
+        script.vy.raw_set(i + 1, velocity.y);
+        script.rotation.raw_set(i + 1, transform.rotation);
+    }
+    // entries left over from a bigger group are cleared so # matches count
+    for (int i = count; i < script.count; i++)
+    {
+        script.x.raw_set(i + 1, sol::lua_nil);
+        script.y.raw_set(i + 1, sol::lua_nil);
+        script.vx.raw_set(i + 1, sol::lua_nil);
+        script.vy.raw_set(i + 1, sol::lua_nil);
+        script.rotation.raw_set(i + 1, sol::lua_nil);
+        script.entities.raw_set(i + 1, sol::lua_nil);
+    }
+    script.members = std::move(members);
+    script.count = count;
+    script.batch["count"] = count;
+
+    if (profiler)
+    {
+        profiler->begin_call(script.fun, -1);
+    }
+    script.fun(script.batch, delta_time, elapsed_time);
+    if (profiler)
+    {
+        profiler->end_call();
+    }
+
+    // only what the script changed is written, untouched entities stay out of delta snapshots
+    for (int i = 0; i < count; i++)
+    {
+        Entity entity = script.members[i];
+        vec2 position(script.x.raw_get<double>(i + 1), script.y.raw_get<double>(i + 1));
+        double rotation = script.rotation.raw_get<double>(i + 1);
+        const auto &transform = entity.read_component<TransformComponent>();
+        if (position != transform.position || rotation != transform.rotation)
+        {
+            auto &written = entity.get_component<TransformComponent>();
+            written.position = position;
+            written.rotation = rotation;
+        }
+        if (entity.has_component<RigidBodyComponent>())
+        {
+            vec2 velocity(script.vx.raw_get<double>(i + 1), script.vy.raw_get<double>(i + 1));
+            if (velocity != entity.read_component<RigidBodyComponent>().velocity)
+            {
+                entity.get_component<RigidBodyComponent>().velocity = velocity;
+            }
+        }
+    }
+}
+
+void ScriptSystem::start_profiling(sol::state &lua)
+{
+    // the old profiler hands the allocator back before the new one wraps it
+    profiler.reset();
+    profiler = std::make_shared<ScriptProfiler>(lua.lua_state());
+}
+
+void ScriptSystem::stop_profiling()
+{
+    profiler.reset();
+}
+
+void ScriptSystem::start_workers(sol::state &lua, std::shared_ptr<Registry> registry, int state_count)
+{
+    workers = std::make_shared<ScriptWorkers>(lua, registry.get(), state_count);
+}
+
+const ScriptWorkers *ScriptSystem::get_workers() const
+{
+    return workers.get();
+}
+
+ScriptWorkers *ScriptSystem::get_workers()
+{
+    return workers.get();
+}
+
+const void *ScriptSystem::function_id(const sol::function &fun)
+{
+    if (!fun.valid())
+    {
+        return nullptr;
+    }
+    lua_State *state = fun.lua_state();
+    fun.push();
+    const void *id = lua_topointer(state, -1);
+    lua_pop(state, 1);
+    return id;
+}
+
+void ScriptSystem::rebind(const Rebinding &rebinding)
+{
+    if (rebinding.empty())
+    {
+        return;
+    }
+    if (profiler)
+    {
+        profiler->clear_cache();
+    }
     for (auto entity : entities())
     {
-        auto &script = entity.get_component<ScriptComponent>();
+        auto it = rebinding.find(function_id(entity.read_component<ScriptComponent>().fun));
+        if (it == rebinding.end())
+        {
+            continue;
+        }
+        entity.get_component<ScriptComponent>().fun = it->second;
+        drop_coroutine(entity.id());
+    }
+}
+
+const ScriptProfiler *ScriptSystem::get_profiler() const
+{
+    return profiler.get();
+}
+
+void ScriptSystem::set_gc_budget(sol::state &lua, double budget_ms)
+{
+    lua_State *L = lua.lua_state();
+    gc_stats = GcStats{};
+    if (budget_ms <= 0)
+    {
+        gc_state = nullptr;
+        lua_gc(L, LUA_GCRESTART, 0);
+        return;
+    }
+    lua_gc(L, LUA_GCSTOP, 0);
+    gc_state = L;
+    gc_budget_ms = budget_ms;
+    gc_cycle_running = false;
+    gc_threshold_kb = std::max(min_gc_threshold_kb, 2 * lua_gc(L, LUA_GCCOUNT, 0));
+}
+
+void ScriptSystem::collect_garbage()
+{
+    if (!gc_state)
+    {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const int memory_kb = lua_gc(gc_state, LUA_GCCOUNT, 0);
+    if (!gc_cycle_running && memory_kb >= gc_threshold_kb)
+    {
+        gc_cycle_running = true;
+    }
+
+    if (gc_cycle_running)
+    {
+        bool finished = false;
+        // scripts are making garbage faster than the budget collects it, a spike beats running out of memory
+        if (memory_kb >= 2 * gc_threshold_kb)
+        {
+            lua_gc(gc_state, LUA_GCCOLLECT, 0);
+            finished = true;
+            gc_stats.forced++;
+        }
+        else
+        {
+            std::chrono::duration<double, std::milli> elapsed{0};
+            while (!finished && elapsed.count() < gc_budget_ms)
+            {
+                finished = lua_gc(gc_state, LUA_GCSTEP, 0) != 0;
+                elapsed = std::chrono::steady_clock::now() - start;
+            }
+        }
+        if (finished)
+        {
+            // like lua's default pause, the next cycle waits until memory doubled from what survived this one
+            gc_cycle_running = false;
+            gc_threshold_kb = std::max(min_gc_threshold_kb, 2 * lua_gc(gc_state, LUA_GCCOUNT, 0));
+            gc_stats.cycles++;
+        }
+    }
+
+    std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+    gc_stats.last_ms = pause.count();
+    gc_stats.max_ms = std::max(gc_stats.max_ms, gc_stats.last_ms);
+    gc_stats.total_ms += gc_stats.last_ms;
+    gc_stats.frames++;
+    gc_stats.memory_kb = lua_gc(gc_state, LUA_GCCOUNT, 0);
+}
+
+const ScriptSystem::GcStats &ScriptSystem::get_gc_stats() const
+{
+    return gc_stats;
+}
+
+void ScriptSystem::remove_entity(Entity entity)
+{
+    System::remove_entity(entity);
+    drop_coroutine(entity.id());
+}
+
+void ScriptSystem::remove_all_entities()
+{
+    System::remove_all_entities();
+    for (std::size_t id = 0; id < coroutines.size(); id++)
+    {
+        drop_coroutine(id);
+    }
+    timers.clear();
+    polling.clear();
+    if (workers)
+    {
+        workers->clear_messages();
+    }
+}
+
+void ScriptSystem::drop_coroutine(int entity_id)
+{
+    if (entity_id >= coroutines.size() || !coroutines[entity_id].active)
+    {
+        return;
+    }
+    Coroutine &dropped = coroutines[entity_id];
+    dropped = Coroutine{false, false, dropped.generation + 1};
+}
+
+void ScriptSystem::start_coroutine(Entity entity, const ScriptComponent &script, double delta_time, int elapsed_time)
+{
+    if (entity.id() >= coroutines.size())
+    {
+        coroutines.resize(entity.id() + 1);
+    }
+    Coroutine &started = coroutines[entity.id()];
+    started.active = true;
+    started.done = false;
+    started.fun = script.fun;
+    started.thread = sol::thread::create(lua_state);
+    started.coroutine = sol::coroutine(started.thread.thread_state(), script.fun);
+    resume_coroutine(entity, delta_time, elapsed_time);
+}
+
+void ScriptSystem::resume_coroutine(Entity entity, double delta_time, int elapsed_time)
+{
+    Coroutine &running = coroutines[entity.id()];
+    running.condition = sol::lua_nil;
+    if (profiler)
+    {
+        profiler->begin_call(running.fun, entity.id());
+    }
+    sol::protected_function_result result = running.coroutine(entity, delta_time, elapsed_time);
+    if (profiler)
+    {
+        profiler->end_call();
+    }
+
+    if (!result.valid())
+    {
+        sol::error err = result;
+        Logger::error("Script coroutine of entity " + std::to_string(entity.id()) + " failed: " + err.what());
+        running.done = true;
+        return;
+    }
+    if (running.coroutine.status() != sol::call_status::yielded)
+    {
+        running.done = true;
+        return;
+    }
+    sol::object yielded = result;
+    if (yielded.is<sol::function>())
+    {
+        running.condition = yielded.as<sol::function>();
+        polling.push_back(entity.id());
+    }
+    else
+    {
+        // a bare coroutine.yield() sleeps until the next frame like wait()
+        double seconds = yielded.is<double>() ? yielded.as<double>() : 0.0;
+        timers.schedule(elapsed_time + static_cast<std::uint32_t>(std::max(0.0, seconds) * 1000), entity.id(),
+                        running.generation);
+    }
+}
+
+void ScriptSystem::update(std::shared_ptr<Registry> registry, double delta_time, int elapsed_time)
+{
+    if (profiler)
+    {
+        profiler->begin_frame();
+    }
+
+    // coroutines whose wait ran out, then those whose condition came true
+    due_timers.clear();
+    timers.advance(elapsed_time, due_timers);
+    for (const auto &timer : due_timers)
+    {
+        if (timer.id < coroutines.size() && coroutines[timer.id].generation == timer.generation &&
+            coroutines[timer.id].active && !coroutines[timer.id].done)
+        {
+            resume_coroutine(Entity{timer.id, registry.get()}, delta_time, elapsed_time);
+        }
+    }
+    std::vector<int> waiting = std::move(polling);
+    polling.clear();
+    for (int id : waiting)
+    {
+        Coroutine &coroutine = coroutines[id];
+        if (!coroutine.active || coroutine.done || !coroutine.condition.valid())
+        {
+            continue;
+        }
+        sol::protected_function_result ready = coroutine.condition();
+        if (!ready.valid())
+        {
+            sol::error err = ready;
+            Logger::error("wait_until condition of entity " + std::to_string(id) + " failed: " + err.what());
+            coroutine.done = true;
+        }
+        else if (ready.get<bool>())
+        {
+            resume_coroutine(Entity{id, registry.get()}, delta_time, elapsed_time);
+        }
+        else
+        {
+            polling.push_back(id);
+        }
+    }
+
+    for (auto entity : entities())
+    {
+        const auto &script = entity.read_component<ScriptComponent>();
+        // a function that can't be moved, e.g. one bound from c++ or capturing locals, stays in the main state
+        if (script.is_sandboxed && workers && workers->add(entity.id(), script.fun))
+        {
+            continue;
+        }
+        if (script.is_coroutine && !script.is_sandboxed)
+        {
+            if (entity.id() >= coroutines.size() || !coroutines[entity.id()].active)
+            {
+                start_coroutine(entity, script, delta_time, elapsed_time);
+            }
+            continue;
+        }
+        if (profiler)
+        {
+            profiler->begin_call(script.fun, entity.id());
+        }
         script.fun(entity, delta_time, elapsed_time);
+        if (profiler)
+        {
+            profiler->end_call();
+        }
+    }
+    if (workers)
+    {
+        workers->run(delta_time, elapsed_time);
+    }
+    for (auto &script : group_scripts)
+    {
+        run_group_script(*registry, script, delta_time, elapsed_time);
+    }
+    if (profiler)
+    {
+        profiler->end_frame();
     }
 }
\ No newline at end of file
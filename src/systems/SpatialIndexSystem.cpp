@@ -0,0 +1,324 @@
+#include "ECS.hpp"
+#include <algorithm>
+#include <cmath>
+
+SpatialIndexSystem::SpatialIndexSystem()
+{
+    require_component<TransformComponent>();
+}
+
+std::int64_t SpatialIndexSystem::cell_key(int cell_x, int cell_y)
+{
+    return (static_cast<std::int64_t>(cell_x) << 32) | static_cast<std::uint32_t>(cell_y);
+}
+
+// world-space box covering both the scaled sprite and the collider outline
+SDL_FRect SpatialIndexSystem::compute_bounds(const Entity &entity)
+{
+    const auto &transform = entity.read_component<TransformComponent>();
+    float left = transform.position.x;
+    float top = transform.position.y;
+    float right = left;
+    float bottom = top;
+
+    if (entity.has_component<SpriteComponent>())
+    {
+        const auto &sprite = entity.read_component<SpriteComponent>();
+        right = std::max(right, left + sprite.width * transform.scale.x);
+        bottom = std::max(bottom, top + sprite.height * transform.scale.y);
+    }
+
+    if (entity.has_component<BoxColliderComponent>())
+    {
+        const auto &box = entity.read_component<BoxColliderComponent>();
+        left = std::min(left, transform.position.x - box.offset.x);
+        top = std::min(top, transform.position.y - box.offset.y);
+        right = std::max(right, transform.position.x + box.width + box.offset.x);
+        bottom = std::max(bottom, transform.position.y + box.height + box.offset.y);
+    }
+
+    return SDL_FRect{left, top, right - left, bottom - top};
+}
+
+void SpatialIndexSystem::remove_from(std::vector<Entity> &entities, int slot, int Record::*slot_member)
+{
+    // swap with the last entity and patch its slot
+    const auto &last = entities.back();
+    records[last.id()].*slot_member = slot;
+    entities[slot] = last;
+    entities.pop_back();
+}
+
+void SpatialIndexSystem::insert_into_cell(const Entity &entity, Record &record)
+{
+    const int cell_x = static_cast<int>(std::floor(record.bounds.x / constants::spatial_cell_size));
+    const int cell_y = static_cast<int>(std::floor(record.bounds.y / constants::spatial_cell_size));
+    record.cell = cell_key(cell_x, cell_y);
+
+    auto &cell = cells[record.cell];
+    record.slot = cell.size();
+    cell.push_back(entity);
+
+    max_width = std::max(max_width, record.bounds.w);
+    max_height = std::max(max_height, record.bounds.h);
+}
+
+void SpatialIndexSystem::remove_from_cell(Record &record)
+{
+    auto it = cells.find(record.cell);
+    if (it == cells.end())
+    {
+        return;
+    }
+    remove_from(it->second, record.slot, &Record::slot);
+    if (it->second.empty())
+    {
+        cells.erase(it);
+    }
+}
+
+void SpatialIndexSystem::add_entity(Entity entity)
+{
+    const auto entity_id = entity.id();
+    if (entity_id >= records.size())
+    {
+        records.resize(entity_id + 1);
+    }
+
+    auto &record = records[entity_id];
+    if (record.active)
+    {
+        return;
+    }
+
+    record.active = true;
+    record.is_fixed = entity.has_component<SpriteComponent>() && entity.read_component<SpriteComponent>().is_fixed;
+    record.signature = entity.registry->get_component_signature(entity);
+    record.bounds = compute_bounds(entity);
+
+    if (record.is_fixed)
+    {
+        record.slot = fixed_entities.size();
+        fixed_entities.push_back(entity);
+    }
+    else
+    {
+        insert_into_cell(entity, record);
+    }
+
+    System::add_entity(entity);
+}
+
+void SpatialIndexSystem::add_entities(const std::vector<Entity> &entities)
+{
+    // records are grown once for the highest id in the batch
+    int max_id = 0;
+    for (const auto &entity : entities)
+    {
+        max_id = std::max(max_id, entity.id());
+    }
+    if (max_id >= records.size())
+    {
+        records.resize(max_id + 1);
+    }
+    _entities.reserve(_entities.size() + entities.size());
+
+    for (const auto &entity : entities)
+    {
+        add_entity(entity);
+    }
+}
+
+void SpatialIndexSystem::remove_entity(Entity entity)
+{
+    const auto entity_id = entity.id();
+    if (entity_id >= records.size() || !records[entity_id].active)
+    {
+        return;
+    }
+
+    auto &record = records[entity_id];
+    if (record.is_fixed)
+    {
+        remove_from(fixed_entities, record.slot, &Record::slot);
+    }
+    else
+    {
+        remove_from_cell(record);
+        release_extents(record.bounds);
+    }
+
+    record.active = false;
+    System::remove_entity(entity);
+}
+
+void SpatialIndexSystem::remove_all_entities()
+{
+    records.clear();
+    cells.clear();
+    fixed_entities.clear();
+    max_width = 0;
+    max_height = 0;
+    extents_dirty = false;
+    System::remove_all_entities();
+}
+
+// bounds that no longer count may have been the widest or tallest ones
+void SpatialIndexSystem::release_extents(const SDL_FRect &bounds)
+{
+    if (bounds.w >= max_width || bounds.h >= max_height)
+    {
+        extents_dirty = true;
+    }
+}
+
+void SpatialIndexSystem::recompute_extents()
+{
+    max_width = 0;
+    max_height = 0;
+    for (const auto &record : records)
+    {
+        if (record.active && !record.is_fixed)
+        {
+            max_width = std::max(max_width, record.bounds.w);
+            max_height = std::max(max_height, record.bounds.h);
+        }
+    }
+    extents_dirty = false;
+}
+
+void SpatialIndexSystem::refresh(Registry *registry, int entity_id)
+{
+    if (entity_id >= records.size() || !records[entity_id].active)
+    {
+        return;
+    }
+    Entity entity{entity_id, registry};
+    // the transform was just removed, the entity leaves the system on the next registry update
+    if (!entity.has_component<TransformComponent>())
+    {
+        return;
+    }
+
+    auto &record = records[entity_id];
+    const SDL_FRect previous = record.bounds;
+    const bool is_fixed = entity.has_component<SpriteComponent>() && entity.read_component<SpriteComponent>().is_fixed;
+    record.signature = registry->get_component_signature(entity);
+    record.bounds = compute_bounds(entity);
+
+    if (is_fixed != record.is_fixed)
+    {
+        if (record.is_fixed)
+        {
+            remove_from(fixed_entities, record.slot, &Record::slot);
+            record.is_fixed = false;
+            insert_into_cell(entity, record);
+        }
+        else
+        {
+            remove_from_cell(record);
+            release_extents(previous);
+            record.is_fixed = true;
+            record.slot = fixed_entities.size();
+            fixed_entities.push_back(entity);
+        }
+        return;
+    }
+    if (record.is_fixed)
+    {
+        return;
+    }
+
+    const int cell_x = static_cast<int>(std::floor(record.bounds.x / constants::spatial_cell_size));
+    const int cell_y = static_cast<int>(std::floor(record.bounds.y / constants::spatial_cell_size));
+    if (cell_key(cell_x, cell_y) != record.cell)
+    {
+        remove_from_cell(record);
+        insert_into_cell(entity, record);
+    }
+    else
+    {
+        // a sprite or collider can grow without the entity changing cell
+        max_width = std::max(max_width, record.bounds.w);
+        max_height = std::max(max_height, record.bounds.h);
+    }
+    if (record.bounds.w < previous.w || record.bounds.h < previous.h)
+    {
+        release_extents(previous);
+    }
+}
+
+void SpatialIndexSystem::update(Registry &registry)
+{
+    if (!tracking)
+    {
+        // writes before the first update are covered by refreshing everything once
+        registry.track_changes<TransformComponent>();
+        registry.track_changes<SpriteComponent>();
+        registry.track_changes<BoxColliderComponent>();
+        tracking = true;
+        for (int entity_id = 0; entity_id < records.size(); entity_id++)
+        {
+            refresh(&registry, entity_id);
+        }
+    }
+
+    // entities written since the last update, by systems, scripts, worker commands or a snapshot alike
+    registry.take_changed_entities(changed_ids);
+    for (int entity_id : changed_ids)
+    {
+        refresh(&registry, entity_id);
+    }
+    if (extents_dirty)
+    {
+        recompute_extents();
+    }
+}
+
+void SpatialIndexSystem::query(const SDL_Rect &rect, const Signature &signature, std::vector<Entity> &result) const
+{
+    result.clear();
+
+    const float left = rect.x - constants::culling_padding;
+    const float top = rect.y - constants::culling_padding;
+    const float right = rect.x + rect.w + constants::culling_padding;
+    const float bottom = rect.y + rect.h + constants::culling_padding;
+
+    // an entity can stick out of its cell by at most its own size, so widen the search to the left and top
+    const int first_x = static_cast<int>(std::floor((left - max_width) / constants::spatial_cell_size));
+    const int first_y = static_cast<int>(std::floor((top - max_height) / constants::spatial_cell_size));
+    const int last_x = static_cast<int>(std::floor(right / constants::spatial_cell_size));
+    const int last_y = static_cast<int>(std::floor(bottom / constants::spatial_cell_size));
+
+    for (int cell_y = first_y; cell_y <= last_y; cell_y++)
+    {
+        for (int cell_x = first_x; cell_x <= last_x; cell_x++)
+        {
+            auto it = cells.find(cell_key(cell_x, cell_y));
+            if (it == cells.end())
+            {
+                continue;
+            }
+
+            for (const auto &entity : it->second)
+            {
+                const auto &record = records[entity.id()];
+                const auto &bounds = record.bounds;
+                bool overlaps = bounds.x <= right && bounds.x + bounds.w >= left &&
+                                bounds.y <= bottom && bounds.y + bounds.h >= top;
+                if (overlaps && (record.signature & signature) == signature)
+                {
+                    result.push_back(entity);
+                }
+            }
+        }
+    }
+
+    for (const auto &entity : fixed_entities)
+    {
+        if ((records[entity.id()].signature & signature) == signature)
+        {
+            result.push_back(entity);
+        }
+    }
+}